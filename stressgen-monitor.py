@@ -7,6 +7,7 @@ import time
 import threading
 import re
 import signal
+import struct
 
 """
 Simple Web Server for StressGen 
@@ -26,6 +27,15 @@ HEARTBEAT_PORT = 60888
 HostList = {}
 HostStatus = {"on":0, "off":0}
 
+# binary heartbeat (see stressgen.c): header, host name, records
+HB_MAGIC = 'SGHB'
+HB_VERSION = 1
+HB_HEADER = struct.Struct('>4sBBBBIIQIHH')
+HB_RECORD = struct.Struct('>BBH')
+HB_REC_OS, HB_REC_LOAD, HB_REC_IFACE = 1, 2, 3
+HB_LOAD = struct.Struct('>5I')
+HB_IFACE = struct.Struct('>16s6Q')
+
 Style = """
 <style type="text/css">
 h3#status {
@@ -89,15 +99,21 @@ def get_table():
         s = HostList[i]
         row = ""
         is_alive = HOST_ALIVE
-        if s.has_key('t0') and s.has_key('N1'):
-            dt = s['t1'] - s['t0']
+        if s.has_key('R') or (s.has_key('t0') and s.has_key('N1')):
             net_stat = '<table>'
             try:
-                for iface in s['N1']:
-                    net_stat += '<tr><td>%s</td><td>%d</td><td>%d</td></tr>\n' % \
-                        (iface,
-                        int((s['N1'][iface]['Tx']-s['N0'][iface]['Tx'])/dt),
-                        int((s['N1'][iface]['Rx']-s['N0'][iface]['Rx'])/dt))
+                if s.has_key('R'):
+                    # binary heartbeat: agent sends rates itself
+                    for iface in sorted(s['R']):
+                        net_stat += '<tr><td>%s</td><td>%d</td><td>%d</td></tr>\n' % \
+                            (iface, s['R'][iface]['Tx'], s['R'][iface]['Rx'])
+                else:
+                    dt = s['t1'] - s['t0']
+                    for iface in s['N1']:
+                        net_stat += '<tr><td>%s</td><td>%d</td><td>%d</td></tr>\n' % \
+                            (iface,
+                            int((s['N1'][iface]['Tx']-s['N0'][iface]['Tx'])/dt),
+                            int((s['N1'][iface]['Rx']-s['N0'][iface]['Rx'])/dt))
             except:
                 net_stat += '<tr><td>???</td></tr>'
             net_stat += "</table>\n"
@@ -149,8 +165,49 @@ class HeartbeatListener(threading.Thread):
         self.heartbeat_lstnr = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
         self.heartbeat_lstnr.bind(('', HEARTBEAT_PORT))
         self.reg = re.compile('^\s*(?P<iface>[a-z0-9]+):\s*(?P<rx>[0-9]+)\s*([0-9]+\s*){7}(?P<tx>[0-9]+)\s*')
+        # parts of binary heartbeats: (host, seq) -> {part: records}
+        self.parts = {}
         threading.Thread.__init__(self)
 
+    def parse_binary(self, raw_msg):
+        """ returns (host, stats) when all parts of heartbeat are here """
+        (magic, version, part, parts, host_len, seq, interval, stamp,
+            ip, records, reserved) = HB_HEADER.unpack_from(raw_msg)
+        if HB_VERSION != version:
+            return None, None
+        host = '%s (%s)' % (raw_msg[HB_HEADER.size:HB_HEADER.size+host_len],
+            socket.inet_ntoa(struct.pack('>I', ip)))
+        off = HB_HEADER.size + ((host_len + 3) & ~3)
+        recs = []
+        for i in range(records):
+            rtype, flags, length = HB_RECORD.unpack_from(raw_msg, off)
+            if length < HB_RECORD.size:
+                break
+            recs.append((rtype, raw_msg[off+HB_RECORD.size:off+length]))
+            off += length
+        got = self.parts.setdefault((host, seq), {})
+        got[part] = recs
+        if len(got) < parts:
+            return None, None
+        del self.parts[(host, seq)]
+        # forget heartbeats which lost a part
+        for k in [k for k in self.parts if k[0] == host and k[1] < seq]:
+            del self.parts[k]
+        stats = {'t1': time.time(), 'C':'???', 'S':'???', 'R':{}}
+        for p in sorted(got):
+            for rtype, data in got[p]:
+                if HB_REC_OS == rtype:
+                    stats['S'] = data.rstrip('\x00')
+                elif HB_REC_LOAD == rtype:
+                    u = HB_LOAD.unpack_from(data)
+                    stats['C'] = '%.2f %.2f %.2f' % (u[0]/100.0, u[1]/100.0, u[2]/100.0)
+                elif HB_REC_IFACE == rtype:
+                    u = HB_IFACE.unpack_from(data)
+                    iface = u[0].rstrip('\x00')
+                    if 'lo' != iface:
+                        stats['R'][iface] = {'Rx':u[1], 'Tx':u[2]}
+        return host, stats
+
     def parse_stats(self, raw_msg):
         stats = {'t1': time.time(), 'C':'???'}
         a = raw_msg.split('\x00')
@@ -194,11 +251,20 @@ class HeartbeatListener(threading.Thread):
 
     def run(self):
         while True:
-            # payload buffer size is 1024, but there is a header (~68 bytes) also, so 2048
+            # text payload buffer size is 1024, but there is a header (~68 bytes) also, so 2048;
+            # binary heartbeat datagrams are at most 1400 bytes
             msg, addr = self.heartbeat_lstnr.recvfrom(2048)
             if DEBUG:
                 print "========== FROM %s =========" % addr[0]
                 print repr(msg)
+            if msg.startswith(HB_MAGIC):
+                try:
+                    host, stats = self.parse_binary(msg)
+                except struct.error:
+                    host = None
+                if host:
+                    HostList[host] = stats
+                continue
             if HostList.has_key(addr[0]) and HostList[addr[0]].has_key('N1'):
                 HostList[addr[0]]['t0'] = HostList[addr[0]]['t1']
                 HostList[addr[0]]['N0'] = HostList[addr[0]]['N1']
@@ -4,57 +4,165 @@
 
     CPU Load:
         Creating N threads with tight loop ("short-circuit")
+        or PWM-like duty cycle: given % of every (sub-)millisecond period.
+        The loop body is a selectable kernel (integer, branchy, FMA with
+        AVX2/AVX-512 picked by CPUID, cache-tier pointer chase); every
+        kernel counts its ops/sec, reported in heartbeats
     Network Load:
         Creating N UDP clients, sending packets with size/interval given
+        Payload: constant junk, incompressible (xorshift128+, AVX2 lanes),
+        given % compressible, repeated pattern or file contents; bodies
+        are generated once into a pool and rotated per datagram
 
     Other Features:
         - "Heartbeats" - sending host load info (cpu % and net traffic stats)
-            to given "master host" or broadcast
+            to given "master host" or broadcast: compact binary records
+            with per second rates, host name and address (NAT-proof),
+            or legacy text /proc dumps
+        - Counters of every generator thread: packets, bytes, send errors
+            by errno, loop iterations, lateness against schedule and
+            HDR-like histogram of inter-send jitter; in heartbeats and
+            dumped to syslog and /tmp/stressgen[-name].stats on SIGUSR1
+        - Capture replay (-r): pcap or pcapng file streamed through
+            raw socket at original timing, N times faster or fixed pps,
+            optionally looped, MACs and IPv4 nets rewritten (checksums
+            patched); file is mapped, never loaded as a whole
+        - Self benchmark (--bench): real sender threads of every path
+            (sendto, sendmmsg batches, GSO, raw socket, PACKET_MMAP ring)
+            run unpaced over a sweep of message sizes and thread counts;
+            pps, Gbit/s and CPU cost per packet printed as a table
+        - Scheduler (-j): thousands of UDP destinations on a few
+            worker threads; per destination token buckets are timers
+            of a hierarchical timer wheel (as are phases and binary
+            heartbeats), datagrams of all due ones go in one sendmmsg()
+        - Fleet collector (-G): binary heartbeats of up to thousands
+            of hosts taken in bulk (recvmmsg) on master port, ring of
+            samples per host in one preallocated arena; totals of rx/tx,
+            host CPU distribution and hosts online/offline written as
+            JSON or CSV snapshot or stream every interval
+        - Control channel: load changed without restart by commands
+            on /tmp/stressgen[-name].ctl (stressgen -c"<command>")
+            or UDP from master host (-U): CPU threads and utilization,
+            net rate, message size, schedule, pause/resume per load
+        - TCP load (-q): long-lived bulk streams, idle connections held
+            and connect/close churn at given rate, non-blocking sockets
+            on a few epoll threads; TCP sink (-L tcp) accepts and drains
+        - Request/response load (-Q): UDP or TCP requests at fixed rate
+            (open loop, latency counted from schedule) or N in flight
+            (closed loop), response size asked in request; -L answers;
+            latency p50/p99/p99.9 in heartbeats
+        - Receiver (-L): UDP load datagrams carry probe header (flow id,
+            sequence number, send time); receiver threads on SO_REUSEPORT
+            sockets take them in bulk (recvmmsg, kernel receive time stamps)
+            and report per flow rate, loss, reordering and one-way latency
+        - Closed loop (-T): host CPU %, interface tx bytes/sec or
+            sender loss held at a goal by PID loop over CPU threads and
+            duty cycle, or net rate (and UDP message size), as other
+            workloads come and go
+        - Load profiles (-O): levels of cpu, threads, net rate, message
+            size, memory and disk rates follow a scripted time series of
+            const, ramp, step, sine and random walk segments, optionally
+            looped or time-compressed, applied through control commands
         - Schedule: both cpu and net loads could be launched 
             as continuous flow (default)
-            or in "pulse" mode: active and sleep periods alternate
+            or in "pulse" mode: active and sleep periods alternate;
+            with -J cycles start on wall clock boundaries (start +
+            offset + k * period), so that a clock synced fleet bursts
+            at once or in staggered waves; switch error in heartbeats
 
     Some Details:
     Net:
-        assuming 1 Gigabit network: 125 Mbyte/sec
-        Maximum traffic is 
-        Max Size Packet (65000 bytes) with 525 microsec interval:
-        (1000000(usec/sec)/525(usec))*65000(bytes) = 123.760.000(bytes/sec) 
+        Every generator is paced by its own token bucket:
+        bucket is refilled at target rate (bytes/sec) and may hold
+        up to 'burst' bytes. Waiting is done against absolute deadlines:
+        clock_nanosleep() for the bulk of the interval and spinning
+        for the last PACER_SPIN_NS, so rate error does not accumulate
+        and does not depend on message size.
+        Without -N the interval between packets (-d) is paced the same way.
+        Host names are resolved before any generator starts: distinct
+        names once each, by a pool of getaddrinfo() threads, IPv4 or
+        IPv6; senders of a name take its addresses in turn.
+
+    Disk Load:
+        io_uring (registered buffers) or pread/pwrite fallback,
+        given block size, queue depth, read/write mix, IOPS or bytes/sec
+
+    Placement:
+        Load threads pinned round-robin to CPU list, physical cores
+        or NUMA nodes, with given scheduling policy and nice value;
+        senders allocate buffers on the NIC's NUMA node
+
+    Memory Load:
+        Pre-faulted arenas (hugepages, NUMA node, mlock optional) held
+        resident or swept STREAM-like (read/write/copy) at given rate,
+        or pointer-chased for latency load
 
     TODO:
-    - Adaptive message size
-    - Add option to simulate "eating" memory
-    - Add option to simulate disk I/O usage
     - FreeBSD broadcast message sent to gateway MAC instead of ff
             (? try MSG_DONTROUTE as flag in sendto)
-    - Need to include host name or/and ip which sent from,
-        because of NAT
     - Exclude header overhead
-    - Receiving commands from master host
     - sys log on Solaris
 */
+#if defined(__linux__)
+    #define _GNU_SOURCE
+#endif
 #include <pthread.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
 #include <ctype.h>
 #include <unistd.h>
 #include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
 #include <netdb.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <time.h>
+#include <math.h>
+#include <getopt.h>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    /* AVX2/AVX-512 kernels are compiled per function (target attribute)
+     * and picked at run time by CPUID */
+    #define CPU_KERNELS_X86
+    #include <immintrin.h>
+#endif
 #if defined(__linux__)
     #include <net/ethernet.h>
     #include <linux/if_ether.h>
-    #include <netpacket/packet.h>
+    /* tpacket ring structures; also defines sockaddr_ll */
+    #include <linux/if_packet.h>
+    #include <sys/syscall.h>
+    #include <poll.h>
     #include <netinet/ether.h>
     #include <sys/ioctl.h>
     #include <net/if.h>
     #include <netinet/in.h>
     #include <arpa/inet.h>
+    #include <netinet/udp.h>
+    #include <netinet/tcp.h>
+    #include <sys/epoll.h>
+    /* MSG_ZEROCOPY completion records */
+    #include <linux/errqueue.h>
+    /* SO_TIMESTAMPING of received probes */
+    #include <linux/net_tstamp.h>
+    /* BLKGETSIZE64 */
+    #include <linux/fs.h>
+    #include <sched.h>
+    #include <sys/resource.h>
+    #if defined(__NR_io_uring_setup)
+        /* disk load through io_uring, raw syscalls: no liburing needed */
+        #define DISK_IO_URING
+        #include <linux/io_uring.h>
+    #endif
 #endif
 #ifdef __FreeBSD__
     #include <netinet/in.h>
@@ -86,22 +194,275 @@ char *os_name = "Unknown";
 #endif
 
 #define LOCK_FILE_NAME "/tmp/stressgen.lock"
+#define LOCK_FILE_FORMAT "/tmp/stressgen-%s.lock"
+/* control socket of running instance */
+#define CTL_SOCK_NAME "/tmp/stressgen.ctl"
+#define CTL_SOCK_FORMAT "/tmp/stressgen-%s.ctl"
+#define CTL_CLIENT_FORMAT "/tmp/stressgen-client-%d.ctl"
+#define CTL_MSG_MAX 4096
+#define CTL_PATH_LEN 104 /* fits sun_path of sockaddr_un everywhere */
+/* longest uninterrupted sleep: control changes apply within it */
+#define CTL_POLL_NS 10000000ULL
+/* generator counters are written here (and to syslog) on SIGUSR1 */
+#define STATS_FILE_NAME "/tmp/stressgen.stats"
+#define STATS_FILE_FORMAT "/tmp/stressgen-%s.stats"
+/* fleet collector (-G) snapshot or stream of aggregates */
+#define FLEET_FILE_NAME "/tmp/stressgen.fleet"
+#define FLEET_FILE_FORMAT "/tmp/stressgen-%s.fleet"
+#define LOCK_FILE_NAME_LEN 256
 #define VECTOR_SIZE 64
-#define MAX_BYTES_PER_SEC (123760000)
 #define MICROSEC_PER_SEC (1000000)
+#define NANOSEC_PER_SEC (1000000000ULL)
 #define PING_PORT_DEFAULT 50888
 #define MASTER_PORT_DEFAULT 60888
 #define UDP_PING_MSG_SIZE_MAX 65000
 #define RAW_PING_MSG_SIZE_MAX (ETH_DATA_LEN - 100)
+/* UDP GSO: kernel splits super-buffer of up to 64 segments */
+#define UDP_GSO_SEGMENTS_MAX 64
+#define UDP_GSO_BUFFER_MAX 65000
+/* MSG_ZEROCOPY: pieces of pinned user memory one datagram may take (MAX_SKB_FRAGS) */
+#define ZEROCOPY_FRAGS_MAX 17
+/* MSG_ZEROCOPY: notifications pending before sender waits for them */
+#define ZEROCOPY_PENDING_MAX 1024
+#if defined(__linux__)
+    #ifndef UDP_SEGMENT
+        #define UDP_SEGMENT 103
+    #endif
+    #ifndef SO_ZEROCOPY
+        #define SO_ZEROCOPY 60
+    #endif
+    #ifndef MSG_ZEROCOPY
+        #define MSG_ZEROCOPY 0x4000000
+    #endif
+    #ifndef SO_EE_ORIGIN_ZEROCOPY
+        #define SO_EE_ORIGIN_ZEROCOPY 5
+    #endif
+#endif
+/* PACKET_MMAP TX ring geometry: 2K frame holds any ETH_FRAME_LEN frame */
+#define RAW_RING_FRAME_SIZE 2048
+#define RAW_RING_BLOCK_SIZE (1<<16)
+#define RAW_RING_BLOCK_NR 64
+#define RAW_RING_BATCH_DEFAULT 64
+/* refill waits this long (msec) for frames still queued to kernel */
+#define RAW_RING_FILL_WAIT_MS 10
+#define RAW_THREADS_MAX 64
+/* Ethernet + 802.1Q + IPv4 (no options) + UDP */
+#define FLOW_HDR_MAX (ETH_HLEN + 4 + 20 + 8)
+/* pcap replay: Ethernet + two VLAN tags + IPv4 with options + TCP,
+ * the part of frame copied out of the capture when rewriting */
+#define PCAP_HDR_MAX (ETH_HLEN + 8 + 60 + 20)
+#define PCAP_IFACES_MAX 16
+/* pages of capture behind the cursor are dropped every window */
+#define PCAP_WINDOW (64UL << 20)
+#define PCAP_BATCH_DEFAULT 32
+#define PCAP_LINKTYPE_ETHERNET 1
 #define PING_MSG_SIZE_DEFAULT 1024
 #define PING_DELAY_DEFAULT 1*MICROSEC_PER_SEC
 #define HEARTBEAT_DELAY_DEFAULT 10*MICROSEC_PER_SEC
+enum hb_format {
+    HB_BINARY, HB_TEXT
+};
+#define CPU_PERIOD_DEFAULT 10000
+#define CPU_PERIOD_MIN 100
+#define CPU_UTIL_TARGETS_MAX 256
+/* CPU threads may be added at run time up to this */
+#define CPU_THREADS_MAX 256
+/* busy loop iterations between CPU clock readings */
+#define CPU_CLOCK_CHECK_EVERY 1024
+#define CPU_KERNEL_NAME_LEN 16
+/* cache sizes if not reported by the system */
+#define CACHE_L1_DEFAULT (32*1024)
+#define CACHE_L2_DEFAULT (1024*1024)
+#define CACHE_L3_DEFAULT (16*1024*1024)
+#define CACHE_LINE 64
+/* DRAM working set: at least this, and 4 times L3 */
+#define DRAM_WORKING_SET_MIN (256*1024*1024)
+/* memory load: bytes moved between pacing/clock checks */
+#define MEM_CHUNK (256*1024)
+#define MEM_THREADS_MAX 256
+#define PAGE_SIZE_DEFAULT 4096
+#ifndef MPOL_PREFERRED
+    #define MPOL_PREFERRED 1
+#endif
+#ifndef MPOL_BIND
+    #define MPOL_BIND 2
+#endif
+/* thread placement: CPU sets threads are spread over ; NUMA nodes scanned */
+#define PLACE_SETS_MAX 256
+#define PLACE_NODES_MAX 64
+#define PLACE_DESCR_LEN 64
+#define DISK_TARGETS_MAX 16
+/* closed loop: default PID gains (error and output on 0..1 scale), period, floor of output */
+#define TARGET_KP_DEFAULT 0.2
+#define TARGET_KI_DEFAULT 0.6
+#define TARGET_PERIOD_DEFAULT 1000
+#define TARGET_OUT_MIN 0.001
+/* losses grow steeply near capacity: error is taken on 10% scale */
+#define TARGET_LOSS_SCALE 10.0
+/* tx: message size doubles after this many short samples in a row,
+ * halves after as many met ones once the rate fell to half */
+#define TARGET_SIZE_SAMPLES 3
+#define DISK_BLOCK_DEFAULT 4096
+#define DISK_QUEUE_DEFAULT 32
+#define DISK_QUEUE_MAX 1024
+/* O_DIRECT buffers alignment */
+#define DISK_ALIGN 4096
+/* file is laid out with chunks of this size */
+#define DISK_LAYOUT_CHUNK (1024*1024)
+/* number of datagrams handed to kernel with one sendmmsg() call */
+#define BATCH_SIZE_DEFAULT 1
+#define BATCH_SIZE_MAX 1024
+/* payload pool: bodies rotated per datagram (-f), bytes per sender at most */
+#define PAYLOAD_POOL_DEFAULT 64
+#define PAYLOAD_POOL_BYTES_MAX (16*1024*1024)
+/* ratio=: every block is random, then zeros for the compressible part */
+#define PAYLOAD_RATIO_BLOCK 256
+#define PAYLOAD_FILE_MAX (64*1024*1024)
+/* load profile (-O): segments, line length, scheduler tick, change pushed if above */
+#define PROFILE_SEGMENTS_MAX 4096
+#define PROFILE_LINE_MAX 1024
+#define PROFILE_TICK_NS 100000000ULL
+#define PROFILE_DEADBAND 0.005
+/* pacer sleeps until (deadline - PACER_SPIN_NS) then spins */
+#define PACER_SPIN_NS 50000ULL
+/* jitter histogram, HDR-like: 2^JITTER_SUB_BITS linear buckets
+ * per power of 2 ns, i.e. relative error is below 1/8 */
+#define JITTER_SUB_BITS 3
+#define JITTER_BUCKETS ((64 - JITTER_SUB_BITS + 1) << JITTER_SUB_BITS)
 /* TODO:
  * Max Packet size:  MTU - (Max IP Header Size) - (UDP Header Size) = 1500 - 60 - 8 = 1432
  * but for relyability probably it should be:
  * (min IP pack size) - (Max IP Header Size) - (UDP Header Size) = 576 - 60 - 8 = 508 ???
  */
 #define STATS_SIZE 1024
+/*
+ * Binary heartbeat (version 1), all numbers big-endian.
+ * Datagram: header, host name (padded to 4), records.
+ *   0 "SGHB"            8 u32 sequence           24 u32 IPv4 of sender
+ *   4 u8 version       12 u32 ms since previous  28 u16 records
+ *   5 u8 part          16 u64 unix time, ns      30 u16 reserved
+ *   6 u8 parts
+ *   7 u8 host name length
+ * Record: u8 type, u8 reserved, u16 length (with this 4 byte head), data.
+ * Heartbeat which does not fit one datagram is sent in 'parts' ones
+ * with the same sequence; unknown record types are to be skipped.
+ */
+#define HB_MAGIC "SGHB"
+#define HB_VERSION 1
+#define HB_HEADER_SIZE 32
+#define HB_DGRAM_MAX 1400
+#define HB_PARTS_MAX 255
+#define HB_IFACES_MAX 256
+#define HB_NAME_LEN 16
+#define HB_PROC_BUF_SIZE (64*1024)
+enum hb_record {
+    /* char os[8] */
+    HB_REC_OS = 1,
+    /* u32 load 1/5/15 min (x100), u32 running, u32 total tasks */
+    HB_REC_LOAD,
+    /* char iface[16], u64 rx/tx bytes/sec, rx/tx packets/sec, rx/tx bytes total */
+    HB_REC_IFACE,
+    /* char kernel[12], u64 ops/sec, u32 achieved % of core (x100) */
+    HB_REC_CPU,
+    /* char mode[8], u64 bytes/sec (loads/sec for chase), u32 ns/load (x10) */
+    HB_REC_MEM,
+    /* char path[32] (tail), u64 iops, read bytes/sec, write bytes/sec, errors */
+    HB_REC_DISK,
+    /* char "<thread> <cpus> <policy>"[PLACE_DESCR_LEN] */
+    HB_REC_PLACE,
+    /* char thread[12], u64 packets, bytes, loop iterations, late avg ns,
+     * late max ns, jitter p50, p99, p99.9, max ns, errors[SEND_ERRORS]
+     * (eagain enobufs econnrefused emsgsize other) */
+    HB_REC_GEN,
+    /* u32 source IPv4 (0 for IPv6), u16 source port, u16 0, u32 flow id, u64 packets,
+     * bytes, bytes/sec, lost, reordered, latency p50, p99, p99.9, max ns */
+    HB_REC_FLOW,
+    /* char thread[12], u64 requests, responses, timeouts,
+     * latency p50, p99, p99.9, max ns */
+    HB_REC_RPC,
+    /* u32 host CPU busy % since previous heartbeat (x100), u32 CPUs online */
+    HB_REC_HOST,
+    /* u64 period ns, offset ns, switches, switch error last, mean, max ns */
+    HB_REC_SYNC
+};
+/*
+ * Probe header leading every load datagram (UDP senders), big endian:
+ * "SGPB", u8 version, 3 x 0, u32 flow id, u64 sequence number,
+ * u64 send time (CLOCK_REALTIME ns), 4 x 0
+ */
+#define PROBE_MAGIC "SGPB"
+#define PROBE_VERSION 1
+#define PROBE_SIZE 32
+/* receiver (-L): flows tracked per socket thread, sockets, recvmmsg depth */
+#define RX_FLOWS_MAX 256
+#define RX_THREADS_MAX 64
+#define RX_BATCH_DEFAULT 64
+/* socket buffer of receiver: default one holds a few 64K datagrams */
+#define RX_RCVBUF (8*1024*1024)
+/* TCP load (-q): epoll threads, connects in flight of churn per thread,
+ * events per epoll_wait(), pause before reopening failed connections */
+#define TCP_THREADS_MAX 64
+#define TCP_CHURN_INFLIGHT 4096
+#define TCP_EVENTS 256
+#define TCP_RETRY_NS 100000000ULL
+#define TCP_WRITE_DEFAULT 65536
+#define TCP_SINK_BUF (256*1024)
+/*
+ * Request/response load (-Q), header of request echoed in response:
+ *   0 "SGRQ" ("SGRS" in response)   8 u32 request length    16 u32 slot
+ *   4 u8 version, 3 x 0             12 u32 response length  20 u32 0
+ *  24 u64 scheduled send time (CLOCK_MONOTONIC ns of requester)
+ * Lengths include the header; the rest of messages is payload.
+ * Responders (-L udp and tcp) answer requests of any sender.
+ */
+#define RPC_MAGIC "SGRQ"
+#define RPC_REPLY_MAGIC "SGRS"
+#define RPC_VERSION 1
+#define RPC_HDR_SIZE 32
+#define RPC_SIZE_DEFAULT 64
+#define RPC_THREADS_MAX 64
+/* closed loop over UDP: request unanswered this long is reissued */
+#define RPC_TIMEOUT_NS 1000000000ULL
+#define RPC_CHECK_NS 10000000ULL
+/* fleet collector (-G): hosts tracked, samples kept per host,
+ * heartbeats per recvmmsg(), socket threads */
+#define FLEET_HOSTS_DEFAULT 16384
+#define FLEET_HISTORY_DEFAULT 60
+#define FLEET_BATCH 64
+#define FLEET_THREADS_MAX 16
+/* host is offline after missing this many heartbeat intervals */
+#define FLEET_MISSED 3
+#define FLEET_NAME_LEN 64
+#define FLEET_CPU_BUCKETS 10
+/* sample of host which does not report its CPU (old or non-Linux agent) */
+#define FLEET_CPU_NONE 0xffffffffU
+/* self benchmark (--bench): values per list, threads per cell,
+ * measured time per cell, warm-up before it */
+#define BENCH_LIST_MAX 16
+#define BENCH_THREADS_MAX 256
+#define BENCH_MSEC_DEFAULT 1000
+#define BENCH_WARMUP_NS 200000000ULL
+#define BENCH_BATCH_DEFAULT 64
+/* sampled: wall ns, process CPU ns, TSC, packets, bytes, errors */
+#define BENCH_COUNTERS 6
+/* hierarchical timer wheel: levels of 256 slots, tick of 1024 ns,
+ * level 0 spans 262 usec, level 3 about 73 min */
+#define WHEEL_BITS 8
+#define WHEEL_SIZE (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SIZE - 1)
+#define WHEEL_LEVELS 4
+#define WHEEL_TICK_SHIFT 10
+/* scheduler (-j): workers, datagrams of all due destinations per sendmmsg() */
+#define SCHED_THREADS_MAX 256
+#define SCHED_SEND_MAX 256
+/* start up name resolution: lookups in parallel, all of them within timeout */
+#define RESOLVE_THREADS_DEFAULT 32
+#define RESOLVE_THREADS_MAX 256
+#define RESOLVE_TIMEOUT_DEFAULT 5000
+#define RESOLVE_ADDRS_MAX 16
+/* long options have no letter */
+#define OPT_BENCH 256
+#define OPT_RESOLVE 257
 #define INVALID_ADDR 0
 
 #ifdef SYSLOGGING
@@ -114,38 +475,767 @@ char *os_name = "Unknown";
 #ifndef max
 #define max(a,b) ((a)>(b)?(a):(b))
 #endif
+#ifndef min
+#define min(a,b) ((a)<(b)?(a):(b))
+#endif
 
 struct schedule {
     unsigned int active, sleep;
 };
 
+/* per thread scratch of CPU load kernel */
+struct cpu_kernel_state {
+    int vector[VECTOR_SIZE];
+    unsigned long long rnd;
+    /* working set of cache/memory tier kernels (chase: offset of next line in 'pos') */
+    char *buf;
+    size_t size, pos;
+    /* keeps results alive: compiler must not drop the work */
+    volatile unsigned long long sink;
+};
+
+/*
+ * CPU load kernel: run() does CPU_CLOCK_CHECK_EVERY iterations
+ * and returns number of "ops" done (FLOPs, ALU ops, branches,
+ * cache lines touched - whatever is natural for the kernel).
+ */
+struct cpu_kernel {
+    char *name;
+    /* 0 => registers only; 1,2,3 => cache level; 4 => DRAM */
+    int tier;
+    int (*supported)();
+    unsigned long int (*run)(struct cpu_kernel_state*);
+};
+
+struct cpu_load_info {
+    struct schedule phases;
+    struct cpu_kernel *kernel;
+    /* PWM mode: target % of one core (100 => always busy), period in usec */
+    double util;
+    unsigned int period;
+    /* % of one core actually consumed, updated every period */
+    volatile double achieved;
+    /* kernel throughput, updated about every second */
+    volatile unsigned long int ops_per_sec;
+    struct gen_stats *stats;
+    /* removed at run time ; thread has not exited yet (under control.lock) */
+    volatile unsigned short quit, running;
+    /* started with the instance: main joins it, so it is parked when
+     * removed and goes on when added again */
+    unsigned short stay;
+};
+
+enum mem_mode {
+    MEM_HOLD, MEM_READ, MEM_WRITE, MEM_COPY, MEM_CHASE, MEM_MODES
+};
+
+struct mem_load_info {
+    struct schedule phases;
+    enum mem_mode mode;
+    /* arena slice of this thread; bytes/sec (0 => as fast as possible) */
+    unsigned long int size, rate;
+    /* hugepages ; mlock() ; NUMA node (-1 => any) */
+    unsigned short huge, lock;
+    int node;
+    /* achieved: bytes/sec moved (loads/sec for chase) ; ns per load */
+    volatile unsigned long int per_sec;
+    volatile double latency_ns;
+};
+
+struct disk_load_info {
+    struct schedule phases;
+    char *path;
+    /* region (0 => whole device/file), block, queue depth */
+    unsigned long int size, block;
+    unsigned int queue;
+    /* % of reads ; random offsets ; O_DIRECT ; allow writes to device */
+    unsigned short read_pct, random, direct, force;
+    /* bytes/sec (iops are converted), 0 => as fast as possible */
+    unsigned long int rate;
+    /* achieved */
+    volatile unsigned long int iops, read_per_sec, write_per_sec, errors;
+    volatile unsigned short engine_uring;
+};
+
 struct udp_ping_info {
     char *host;
-    unsigned int port, msg_size, delay;
+    unsigned int port, msg_size, delay, batch;
+    /* bytes/sec (0 => one packet per 'delay' usec) and bucket depth */
+    unsigned long int rate, burst;
+    /* UDP_SEGMENT super-buffers ; MSG_ZEROCOPY sends */
+    unsigned short gso, zerocopy;
+    /* buffers preferably on this NUMA node (-1 => any) */
+    int node;
+    /* 0 => not counted (heartbeat) */
+    struct gen_stats *stats;
     unsigned int (*fill_buffer_procedure)(char*, unsigned int);
     unsigned short update_every_packet;
+    /* every datagram starts with probe header of this flow */
+    unsigned short stamp;
+    unsigned int flow_id;
     struct schedule phases;
+    /* largest datagram payload not fragmented on the path (0 => unknown) */
+    volatile unsigned int path_payload;
+    /* set by benchmark to end the thread */
+    volatile unsigned short quit;
 };
 
 #if defined(__linux__)
+/* every header field cycles through base .. base + count - 1 */
+struct flow_range {
+    unsigned long long base;
+    unsigned long int count;
+};
+
+enum flow_field {
+    FLOW_SMAC, FLOW_DMAC, FLOW_VLAN, FLOW_SIP, FLOW_DIP, FLOW_SPORT, FLOW_DPORT,
+    FLOW_FIELDS
+};
+
+struct flow_spec {
+    struct flow_range range[FLOW_FIELDS];
+};
+
+/*
+ * Header template of the current flow. Stepping to the next flow
+ * rewrites only changed fields and patches IPv4 and UDP checksums
+ * incrementally (RFC 1624), payload is never touched.
+ */
+struct flow_gen {
+    struct flow_spec *spec;
+    unsigned long int cur[FLOW_FIELDS], stride;
+    unsigned char hdr[FLOW_HDR_MAX];
+    unsigned int hdr_len, ip_off, udp_off;
+};
+
 struct raw_ping_info {
     unsigned char source_mac[ETH_ALEN], target_mac[ETH_ALEN];
-    unsigned int msg_size, delay;
+    unsigned int msg_size, delay, batch;
+    unsigned long int rate, burst;
+    /* use PACKET_MMAP TX ring ; bypass qdisc layer */
+    unsigned short ring, qdisc_bypass;
+    int if_index;
+    /* IPv4/UDP flows (0 => legacy 0x8200 frames); this thread
+     * takes every 'flow_stride'-th flow starting from 'flow_offset' */
+    struct flow_spec *flows;
+    unsigned int flow_offset, flow_stride;
+    /* buffers preferably on this NUMA node (-1 => any) */
+    int node;
+    struct gen_stats *stats;
     unsigned int (*fill_buffer_procedure)(char*, unsigned int);
     unsigned short update_every_packet;
     struct schedule phases;
+    /* set by benchmark to end the thread */
+    volatile unsigned short quit;
+};
+
+/*
+ * Capture replayed through raw socket: pcap (usec/nsec) or pcapng,
+ * either byte order. File is mapped read-only and walked record by
+ * record, so its size costs only a window of memory. Rewritten
+ * headers are copies: the mapping itself is never written.
+ */
+struct pcap_replay {
+    char *path;
+    /* 1 => original timing, N => N times faster, 0 => top speed */
+    double speed;
+    /* fixed packets/sec instead of time stamps (0 => time stamps) */
+    unsigned long int pps;
+    unsigned short loop;
+    /* MACs replaced; IPv4 addresses keep host part, net part replaced */
+    unsigned char smac[ETH_ALEN], dmac[ETH_ALEN];
+    unsigned short set_smac, set_dmac;
+    unsigned long int sip, dip;
+    unsigned int sip_len, dip_len;
+    unsigned int batch;
+    int if_index, node;
+    struct gen_stats *stats;
+    /* file walk */
+    unsigned char *map;
+    size_t size, pos, dropped;
+    unsigned short ng, big;
+    /* pcapng: per interface link type and time stamp units per second */
+    unsigned int linktype[PCAP_IFACES_MAX];
+    unsigned long long units[PCAP_IFACES_MAX];
+    unsigned int ifaces;
+    unsigned long long ts_ns;
+};
+#endif
+
+/*
+ * Batch of datagrams owned by one sender thread.
+ * Messages either share one payload (refilling it refreshes the whole
+ * batch) or each has its own copy (per-packet headers vary).
+ * No locking: socket and batch are private to the thread which created them.
+ */
+struct send_batch {
+    int sock, flags;
+    unsigned int depth;
+    struct iovec *iov;
+    /* probe headers: 'segs' per message, each followed by a body
+     * of 'pool_len' bytes out of 'pool_nr' ones, rotated per datagram */
+    char *stamps, *pool;
+    unsigned int segs, pool_len, pool_nr, pool_next;
+    /* MSG_ZEROCOPY: headers are rotated over 'sets' copies, a copy is
+     * stamped again only when all sends which used it are completed
+     * (kernel numbers zerocopy sends: 'zc_first'.. of set, 'zc_next') */
+    unsigned int sets, set, zc_next;
+    unsigned int *zc_first, *zc_nr, *zc_left;
+#if defined(__linux__)
+    struct mmsghdr *msgs;
+    #define BATCH_MSG(b, i) ((b)->msgs[i].msg_hdr)
+#else
+    struct msghdr *msgs;
+    #define BATCH_MSG(b, i) ((b)->msgs[i])
+#endif
+};
+
+#if defined(__linux__)
+/*
+ * TPACKET_V2 TX ring mapped into sender address space.
+ * Frames are pre-built once in every slot; sending is just handing
+ * slots to kernel (status = SEND_REQUEST) and one send() per batch.
+ */
+struct raw_ring {
+    int sock;
+    char *map;
+    size_t map_size;
+    unsigned int frame_nr, head;
+};
+#endif
+
+enum load_class {
+    LOAD_CPU, LOAD_NET, LOAD_MEM, LOAD_DISK, LOAD_CLASSES
+};
+
+/*
+ * Token bucket expressed as "virtual time": next_ns is the moment
+ * the bucket holds enough tokens for the next packet. Idle time gives
+ * credit of at most burst_ns (= burst bytes at target rate).
+ * Commands to load class 'cls' cut waiting short.
+ */
+struct pacer {
+    unsigned long long rate, interval_ns, burst_ns;
+    unsigned long long next_ns, remainder;
+    enum load_class cls;
+};
+
+enum send_error {
+    SEND_EAGAIN, SEND_ENOBUFS, SEND_ECONNREFUSED, SEND_EMSGSIZE, SEND_EOTHER, SEND_ERRORS
+};
+
+/*
+ * Generator counters: what load was really applied.
+ * Written by the owning thread only, read by heartbeat and SIGUSR1 dump;
+ * aligned, so that threads never share a cache line.
+ */
+struct gen_stats {
+    char name[16];
+    unsigned long long packets, bytes, iterations;
+    unsigned long long errors[SEND_ERRORS];
+    /* actual - scheduled send (or wake-up) time, ns */
+    unsigned long long late_sum, late_max, late_nr, late_prev;
+    /* |change of lateness| between sends, i.e. inter-send jitter, ns */
+    unsigned long long jitter[JITTER_BUCKETS];
+} __attribute__((aligned(CACHE_LINE)));
+
+#if defined(__linux__)
+/*
+ * Flow seen by receiver: source address, port and flow id of probe.
+ * Sequence numbers below the highest one seen are reordered packets;
+ * lost = expected (highest - first + 1) - received.
+ * Written by its receiver thread only, read by reports without locking.
+ */
+struct rx_flow {
+    /* source address as IPv6 one, IPv4 one mapped */
+    unsigned char addr[16];
+    unsigned int port, id;
+    unsigned long long first_seq, next_seq, packets, bytes, reordered;
+    /* bytes/sec over the last second or so */
+    unsigned long long win_ns, win_bytes, rate;
+    /* one-way latency (receive - send time), ns; negative => clock offset */
+    unsigned long long negative, latency[JITTER_BUCKETS];
+    volatile unsigned short used;
+};
+
+struct rx_info {
+    int port;
+    unsigned int batch;
+    char name[16];
+    struct rx_flow *flows;
+    /* datagrams without probe header ; of new flows with table full */
+    unsigned long long foreign, overflow;
+    /* requests of request/response load answered */
+    unsigned long long answered;
+};
+
+enum tcp_kind {
+    TCP_BULK, TCP_HOLD, TCP_CHURN
+};
+
+struct tcp_conn {
+    int fd;
+    unsigned int dst;
+    unsigned short kind, connected, writable;
+};
+
+/*
+ * TCP load of one epoll thread: its share of bulk streams, idle held
+ * connections and connection churn, spread over all destinations.
+ * Counters are written by the owning thread only.
+ */
+struct tcp_load_info {
+    char **hosts;
+    unsigned int hosts_nr, port, msg_size, offset;
+    unsigned int bulk, hold;
+    /* new connections/sec ; closed by RST instead of FIN (no TIME_WAIT) */
+    unsigned long int churn;
+    unsigned short reset;
+    /* bulk bytes/sec (0 => as fast as possible) and bucket depth */
+    unsigned long int rate, burst;
+    int node;
+    struct gen_stats *stats;
+    struct schedule phases;
+    volatile unsigned long int open;
+    volatile unsigned long long connects, failures;
+};
+
+/* accepting side of TCP load: one SO_REUSEPORT listener per thread */
+struct tcp_sink_info {
+    int port;
+    char name[16];
+    volatile unsigned long int open;
+    volatile unsigned long long accepts, bytes, answered;
+};
+
+/*
+ * Accepted connection: plain stream (drained) or framed requests.
+ * Reading stops while a response is being written: backpressure.
+ */
+struct tcp_peer {
+    int fd;
+    unsigned short rpc;
+    unsigned int got, out_hdr;
+    unsigned long int skip, out;
+    unsigned char hdr[RPC_HDR_SIZE];
+};
+
+/*
+ * Request/response load of one thread: its share of connections to all
+ * destinations. Open loop sends at 'rps' and measures latency from the
+ * scheduled time (no coordinated omission); closed loop keeps
+ * 'outstanding' requests in flight.
+ */
+struct rpc_info {
+    char **hosts;
+    unsigned int hosts_nr, port, offset, conns, outstanding;
+    unsigned long int rps;
+    unsigned int req_size, resp_size;
+    unsigned short tcp;
+    int node;
+    struct gen_stats *stats;
+    struct schedule phases;
+    volatile unsigned long long answered, timeouts;
+    unsigned long long latency[JITTER_BUCKETS];
+};
+
+/* connection of requester: response being read; closed TCP one (-1)
+ * is opened again at 'retry' */
+struct rpc_conn {
+    int fd;
+    unsigned int got;
+    unsigned long int skip;
+    unsigned char hdr[RPC_HDR_SIZE];
+    struct sockaddr_storage sa;
+    socklen_t sa_len;
+    unsigned long long retry;
+};
+
+/*
+ * One heartbeat of a host in fleet collector: parts of the heartbeat
+ * (same sequence) add up, 'got' of 'parts' have arrived. Rates are
+ * bytes/sec of all interfaces but loopback; CPU and load are x100.
+ */
+struct fleet_sample {
+    unsigned int seq, time, load, cpu;
+    unsigned short parts, got;
+    unsigned long long rx, tx;
+};
+
+/*
+ * Host of the fleet: slot of open addressing table keyed by host name
+ * and address of sender (from heartbeat header: NAT-proof), ring of
+ * 'history' samples out of collector arena. Samples are written by the
+ * receiving thread of the host only (SO_REUSEPORT keeps a sender on one
+ * socket) and read by exporter without locking: 'head' moves only after
+ * the next sample is initialized.
+ */
+struct fleet_host {
+    char name[FLEET_NAME_LEN];
+    unsigned long int ip;
+    unsigned int interval_ms;
+    volatile unsigned int head, nr;
+    /* CLOCK_MONOTONIC of last datagram */
+    volatile unsigned long long seen_ns;
+    struct fleet_sample *ring;
+    volatile unsigned short used;
+};
+
+/* collector socket thread */
+struct fleet_rx {
+    char name[16];
+    volatile unsigned long long datagrams, foreign, overflow;
+};
+
+/* fleet aggregates over online hosts, made by exporter every interval */
+struct fleet_totals {
+    unsigned long int time;
+    unsigned int hosts, online, offline, cpu_hosts;
+    unsigned long long rx, tx, datagrams, foreign, overflow;
+    /* host CPU % percentiles (x100), hosts per 10% of CPU ; mean 1 min load (x100) */
+    unsigned int cpu_p50, cpu_p90, cpu_p99, cpu_max, load;
+    unsigned int cpu_hist[FLEET_CPU_BUCKETS];
+};
+
+/*
+ * Fleet collector (-G): table of 'slots' (power of 2, at least twice
+ * 'hosts_max'), hosts in order of arrival, samples arena; new hosts are
+ * added under 'lock'. Aggregates are written to 'path' every 'every'
+ * seconds: snapshot with all hosts (JSON or CSV, replaced by rename)
+ * or stream (aggregates appended).
+ */
+struct fleet {
+    int port;
+    unsigned int slots, hosts_max, history, every;
+    unsigned short csv, stream;
+    char path[LOCK_FILE_NAME_LEN];
+    struct fleet_host *hosts, **list;
+    struct fleet_sample *arena;
+    volatile unsigned int hosts_nr;
+    pthread_mutex_t lock;
+    struct fleet_rx *rx;
+    int rx_nr;
+    /* exporter: CPU of online hosts for percentiles, last aggregates */
+    unsigned int *cpu;
+    struct fleet_totals last;
+};
+
+/* timer of wheel, expiry in ticks; embedded in its owner */
+struct wheel_timer {
+    unsigned long long expires;
+    struct wheel_timer *next;
+    unsigned short kind;
+};
+
+/*
+ * Hierarchical timer wheel (one per thread, no locking): timer is put
+ * into level by distance to expiry, upper level slots come down one
+ * level when the level below wraps around. 'used' bits let empty
+ * slots be skipped, so idle time costs nothing.
+ */
+struct wheel {
+    /* next tick to be run */
+    unsigned long long now;
+    struct wheel_timer *slot[WHEEL_LEVELS][WHEEL_SIZE];
+    unsigned long long used[WHEEL_LEVELS][WHEEL_SIZE / 64];
+};
+
+enum sched_timer {
+    SCHED_DEST, SCHED_PHASE, SCHED_HEARTBEAT
+};
+
+/* destination of scheduler worker: its own bucket, flow and sequence */
+struct sched_dest {
+    struct wheel_timer timer;
+    struct sockaddr_storage sa;
+    socklen_t sa_len;
+    struct pacer pacer;
+    unsigned long long seq;
+    unsigned int flow_id;
+};
+
+/* datagrams queued by due destinations, sent by one sendmmsg() */
+struct sched_send {
+    int sock;
+    unsigned int n;
+    struct mmsghdr msgs[SCHED_SEND_MAX];
+    /* probe header and body of every datagram */
+    struct iovec iov[2 * SCHED_SEND_MAX];
+    char stamps[SCHED_SEND_MAX * PROBE_SIZE];
+    struct sched_dest *owner[SCHED_SEND_MAX];
+};
+
+/*
+ * Scheduler worker (-j): every 'stride'-th host from 'offset' is its
+ * destination, paced by own bucket (rate and size as of -N, -s, -d,
+ * per destination) on the worker's timer wheel. Datagrams of all
+ * destinations due go out by one sendmmsg() of one socket. Phases
+ * and heartbeats of worker 0 ('hb') are timers of the wheel as well.
+ */
+struct sched_info {
+    char **hosts;
+    unsigned int hosts_nr, offset, stride, port;
+    unsigned int msg_size, delay, batch;
+    unsigned long int rate, burst;
+    int node;
+    struct gen_stats *stats;
+    struct schedule phases;
+    struct udp_ping_info *hb;
 };
 #endif
 
 
+enum payload_kind {
+    PAYLOAD_DUMMY, PAYLOAD_RANDOM, PAYLOAD_RATIO, PAYLOAD_PATTERN, PAYLOAD_FILE
+};
+
+/* content of load datagrams (and disk writes), -f */
+struct payload_spec {
+    enum payload_kind kind;
+    /* % of every block that compresses away */
+    unsigned int ratio;
+    /* pattern or file contents ; next offset in the file */
+    char *data;
+    unsigned long int len, pos;
+    /* pre-generated bodies per sender */
+    unsigned int pool;
+};
+
+enum profile_shape {
+    SHAPE_CONST, SHAPE_RAMP, SHAPE_STEP, SHAPE_SINE, SHAPE_WALK, SHAPE_NR
+};
+char *profile_shapes[] = {"const", "ramp", "step", "sine", "walk", 0};
+
+/* levels a profile drives; 0 pauses the load class (except size) */
+enum profile_key {
+    PROF_CPU, PROF_THREADS, PROF_NET, PROF_SIZE, PROF_MEM, PROF_DISK, PROF_KEYS
+};
+char *profile_keys[] = {"cpu", "threads", "net", "size", "mem", "disk", 0};
+
+/*
+ * Segment of load profile: for 'duration' seconds of profile time every
+ * level given goes by 'shape' (a, b): const a ; ramp a..b ; step a..b in
+ * 'steps' stairs ; sine a~b (mean~amplitude, 'period') ; walk a~b (start,
+ * at most b per second either way). Levels not given stay as they are.
+ */
+struct profile_segment {
+    double duration, period;
+    enum profile_shape shape;
+    unsigned int steps;
+    unsigned short set[PROF_KEYS];
+    double a[PROF_KEYS], b[PROF_KEYS];
+};
+
+struct profile {
+    char *path;
+    struct profile_segment *seg;
+    int nr, cur;
+    /* profile seconds per real second ; start over at the end */
+    double speed, total, at;
+    unsigned short loop;
+    /* last pushed levels (-1 => none) ; random walk position */
+    double pushed[PROF_KEYS], walk[PROF_KEYS];
+};
+
+enum bench_path {
+    BENCH_SENDTO, BENCH_MMSG, BENCH_GSO, BENCH_RAW, BENCH_RING, BENCH_PATHS
+};
+
+/*
+ * Self benchmark: every path (bit of 'paths') runs for every message
+ * size and thread count against 'host' (raw paths: out of 'if_index').
+ */
+struct bench {
+    unsigned int paths, msec, batch, port;
+    unsigned int sizes[BENCH_LIST_MAX], threads[BENCH_LIST_MAX];
+    int sizes_nr, threads_nr, if_index;
+    char *host;
+};
+
+/* addresses of host name (of preferred family), taken round-robin */
+struct resolve_entry {
+    char *name;
+    struct sockaddr_storage *addrs;
+    unsigned int addrs_nr;
+    volatile unsigned int next;
+    /* getaddrinfo() error ; set once lookup is over */
+    int err;
+    unsigned short done;
+};
+
+/*
+ * Name cache: every distinct host name is resolved once at start by
+ * a pool of threads (getaddrinfo() is reentrant), generators take
+ * addresses without locking. Open addressing on FNV hash of name.
+ */
+struct resolver {
+    struct resolve_entry *entries, **list;
+    unsigned int slots, nr;
+    unsigned int threads, timeout;
+    /* IPv6 addresses preferred to IPv4 ones */
+    unsigned short inet6;
+    volatile unsigned int taken;
+    unsigned int done_nr;
+    pthread_mutex_t lock;
+    pthread_cond_t finished;
+};
+
+/*
+ * Fleet aligned phases (-J): cycles of 'period' start on CLOCK_REALTIME
+ * at start + offset + k * period and load runs the first 'active' of
+ * each. Hosts with synced clocks and the same start and period switch
+ * together, offset (index * step) staggers them: 'shift' as given,
+ * 'offset' is it within the period. Error of a switch is the time load
+ * threads were told minus the boundary, on local clock. Cycle changed
+ * at run time is written and read under control.lock.
+ */
+struct phase_sync {
+    unsigned long long start, period, active, offset, shift;
+    /* -I: net load runs while the others sleep */
+    unsigned short alternate, on;
+    unsigned long long switches, error_last, error_sum, error_max;
+};
+
 /* GLOBALS */
 pthread_mutex_t mutex_ini = PTHREAD_MUTEX_INITIALIZER;
-pthread_mutex_t mutex_send = PTHREAD_MUTEX_INITIALIZER;
 int lock_file;
+char lock_file_name[LOCK_FILE_NAME_LEN] = LOCK_FILE_NAME;
+char stats_file_name[LOCK_FILE_NAME_LEN] = STATS_FILE_NAME;
 char* stub_msg = "NOT IMPLEMENTED";
+struct payload_spec content = {PAYLOAD_DUMMY, 0, 0, 0, 0, 1};
+struct profile profile;
+struct phase_sync phase_sync;
+struct resolver resolver = {0, 0, 0, 0, RESOLVE_THREADS_DEFAULT, RESOLVE_TIMEOUT_DEFAULT, 0, 0, 0,
+    PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER};
 #define STUB_MSG_SIZE 15
 /* bytes transmitted per second */
 unsigned long int tx_speed; 
+/* cpu and memory load threads, for heartbeat */
+struct cpu_load_info *cpu_loaders = 0;
+int cpu_loaders_nr = 0;
+struct mem_load_info *mem_loaders = 0;
+int mem_loaders_nr = 0;
+char *mem_mode_names[] = {"hold", "read", "write", "copy", "chase", 0};
+/* memory load results land here, so that loops are not optimized away */
+volatile unsigned long long mem_sink;
+struct disk_load_info *disk_loaders = 0;
+int disk_loaders_nr = 0;
+/* counters of cpu and sender threads (heartbeat excluded):
+ * CPU_THREADS_MAX slots of CPU threads, then 'gen_net_nr' senders */
+struct gen_stats *gen_stats = 0;
+int gen_net_nr = 0;
+/* order matches enum bench_path */
+char *bench_path_names[] = {"sendto", "mmsg", "gso", "raw", "ring", 0};
+char *send_error_names[] = {"eagain", "enobufs", "econnrefused", "emsgsize", "other", 0};
+/* senders, for control channel (heartbeat excluded) */
+struct udp_ping_info *udp_senders = 0;
+int udp_senders_nr = 0;
+#if defined(__linux__)
+struct raw_ping_info *raw_senders = 0;
+int raw_senders_nr = 0;
+/* capture replay (-r) */
+struct pcap_replay replay;
+/* TCP load (-q) and sink (-L tcp) threads */
+struct tcp_load_info *tcp_loaders = 0;
+int tcp_loaders_nr = 0;
+struct tcp_sink_info *tcp_sinks = 0;
+int tcp_sinks_nr = 0;
+/* scheduler workers (-j) */
+struct sched_info *sched_workers = 0;
+int sched_workers_nr = 0;
+/* fleet collector (-G) */
+struct fleet fleet = {0, 0, 0, 0, 0, 0, 0, FLEET_FILE_NAME};
+/* request/response load (-Q) */
+struct rpc_info *rpc_loaders = 0;
+int rpc_loaders_nr = 0;
+/* receiver threads (-L) */
+struct rx_info *rx_receivers = 0;
+int rx_receivers_nr = 0;
+#endif
+
+char *load_class_names[] = {"cpu", "net", "mem", "disk", 0};
+
+/*
+ * Runtime control: commands change thread parameters in place and
+ * bump 'gen' of the load classes they changed. Every load thread
+ * compares 'gen' of its class with the value it has seen (also while
+ * sleeping, at least every CTL_POLL_NS), leaves the current phase and
+ * starts over with new parameters; other classes go on undisturbed.
+ */
+struct control {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    volatile unsigned int gen[LOAD_CLASSES];
+    volatile unsigned short paused[LOAD_CLASSES];
+    /* sleep phase of -J */
+    volatile unsigned short held[LOAD_CLASSES];
+    /* parameters of CPU threads started at run time */
+    double util[CPU_UTIL_TARGETS_MAX];
+    int util_nr;
+    struct cpu_kernel *kernel[CPU_UTIL_TARGETS_MAX];
+    int kernel_nr;
+    unsigned int period;
+    struct schedule phases;
+    /* local socket ; UDP socket (-1 => none) and the only peer allowed */
+    int unix_sock, udp_sock;
+    struct sockaddr_storage master;
+    char path[CTL_PATH_LEN];
+} control = {PTHREAD_MUTEX_INITIALIZER};
+
+#if defined(__linux__)
+enum target_kind {
+    TARGET_NONE, TARGET_CPU, TARGET_TX, TARGET_LOSS
+};
+char *target_names[] = {"none", "cpu", "tx", "loss", 0};
+
+/*
+ * Closed loop (-T): every 'period' msec measured value is compared with
+ * the goal and incremental PID output 'out' (share of 'max') is applied
+ * by control commands: CPU threads and duty cycle (max in threads), or
+ * net rate (max in bytes/sec), with UDP message size doubled (up to the
+ * path MTU payload) while the senders can not reach the rate, and
+ * halved back towards the size at start once demand has fallen.
+ */
+struct target {
+    enum target_kind kind;
+    double goal, max, kp, ki, kd;
+    unsigned int period;
+    char iface[IF_NAMESIZE];
+    double out, measured, sent_rate, err[2];
+    /* tx: samples short of / meeting the rate in a row ; message size
+     * at start and per sender rate when it was last doubled */
+    unsigned int short_nr, met_nr, size_min;
+    double size_rate;
+    /* counters at previous measurement */
+    unsigned long long busy, total, tx_bytes, tx_dropped, packets, errors, sent;
+    int stat_fd, net_dev_fd;
+} target;
+#endif
+/* "<thread> <cpus> <policy>" of every load thread, for heartbeat */
+char (*placed)[PLACE_DESCR_LEN] = 0;
+int placed_nr = 0;
+
+#if defined(__linux__)
+enum place_mode {
+    PLACE_NONE, PLACE_LIST, PLACE_CORE, PLACE_NODE
+};
+
+/*
+ * Thread placement: every load thread takes next CPU set round-robin
+ * (one CPU per set for list/core, whole node for node mode).
+ * Senders on node mode stay on the node of the NIC, if known.
+ */
+struct placement {
+    enum place_mode mode;
+    cpu_set_t sets[PLACE_SETS_MAX];
+    int set_node[PLACE_SETS_MAX];
+    int nr, next;
+    /* -1 => inherited */
+    int policy, prio;
+    /* node of the NIC (-1 => unknown) */
+    int net_node;
+} place;
+#endif
 
 /* 2 fictive D-Link MACs for source and destination */
 #if defined(__linux__)
@@ -190,11 +1280,18 @@ long int str2long (char* str) {
     return value;
 }
 
+/* "00:17:9a:22:22:22" => 6 bytes; returns 0 on success */
 short int str2mac (char *str, char *mac) {
-    /* TODO */
+    unsigned int octet[6];
+    int i;
+    if (!str || 6 != sscanf(str, "%2x:%2x:%2x:%2x:%2x:%2x",
+            octet, octet + 1, octet + 2, octet + 3, octet + 4, octet + 5)) {
+        return -1;
+    }
     if (mac) {
-        mac[0] = 0x00; mac[1] = 0x17; mac[2] = 0x9A;
-        mac[3] = 0x88; mac[4] = 0x88; mac[5] = 0x88;
+        for (i = 0; i < 6; i++) {
+            mac[i] = (char)octet[i];
+        }
     }
     return 0;
 }
@@ -233,338 +1330,6244 @@ int get_first_suitable_if() {
 }
 #endif
 
-/* Two procedures below implement my own
- * "home-brewed" service stop/start mechanism:
- * Create "lock-file" ; write PID in it ; acquire lock on it
- * Next instance of daemon will try to acquire lock on this file
- * Kill process with PID and rewrite file.
- * Reasons for not using standard scripts are:
- * 1) Possibility of starting by non-root
- * 2) More cross-platform
- */
-void kill_previous_instance () {
-    int lock_file;
-    char pid_str[10];
-    int pid, i;
-    errno = 0;
-    lock_file = open(LOCK_FILE_NAME, O_RDONLY);
-    if (0 < lock_file) {
-        /* lock file exists */
-        if (0 != lockf(lock_file, F_TEST, 0)) {
-            /* lock file exists + locked */
-            /* read PID of locking process */
-            memset(pid_str, 0, sizeof(pid_str));
-            i = read(lock_file, pid_str, sizeof(pid_str));
-            if (0 < i) {
-                pid = atoi(pid_str);
-                if (pid) {
-                    (void)kill(pid, SIGTERM);
-                    /* waiting 7 seconds for previous instance ended */
-                    i = 7;    
-                    while (0 < i) {
-                        if (0 == lockf(lock_file, F_TEST, 0)) {
-                            close(lock_file);
-                            return;
-                        }
-                        sleep(1);
-                        i -= 1;
-                    }
-                    close(lock_file);
-                    printf ("Error killing previous instance %d\nPossibly started by other user\n", pid);
-                    exit(1);
-                }
-            }
-            /* garbage in file */
-            close(lock_file);
-            printf ("Error reading lock file %s\nTerminating\n", LOCK_FILE_NAME);
-            exit(1);
-    }
-    else {
-            /* lock file exists + NOT locked */
+#if defined(__linux__)
+/* MULTI-FLOW HEADER HELPERS */
+/* "a" or "a-b" where a,b are MAC, IPv4 or decimal; returns 0 on success */
+int str2range(char *str, enum flow_field f, struct flow_range *r) {
+    char *dash, *end, mac[ETH_ALEN];
+    unsigned long long v[2];
+    struct in_addr ip;
+    int i, n;
+    if (!str)
+        return -1;
+    dash = strchr(str, '-');
+    if (dash)
+        *dash = '\0';
+    n = dash ? 2 : 1;
+    for (i = 0; i < n; i++, str = dash + 1) {
+        switch (f) {
+        case FLOW_SMAC:
+        case FLOW_DMAC:
+            if (str2mac(str, mac))
+                return -1;
+            v[i] = ((unsigned long long)(unsigned char)mac[0] << 40) |
+                   ((unsigned long long)(unsigned char)mac[1] << 32) |
+                   ((unsigned long long)(unsigned char)mac[2] << 24) |
+                   ((unsigned long long)(unsigned char)mac[3] << 16) |
+                   ((unsigned long long)(unsigned char)mac[4] << 8) |
+                   (unsigned long long)(unsigned char)mac[5];
+            break;
+        case FLOW_SIP:
+        case FLOW_DIP:
+            if (!inet_aton(str, &ip))
+                return -1;
+            v[i] = ntohl(ip.s_addr);
+            break;
+        default:
+            /* number and nothing else */
+            v[i] = strtoull(str, &end, 10);
+            if (end == str || *end || (FLOW_VLAN == f && v[i] > 4095) || v[i] > 65535)
+                return -1;
+            break;
         }
     }
+    if (1 == n)
+        v[1] = v[0];
+    if (v[1] < v[0])
+        return -1;
+    r->base = v[0];
+    r->count = (unsigned long int)(v[1] - v[0] + 1);
+    return 0;
 }
 
-int create_pid_file() {
-    char pid_str[10];
-    int lock_file;
-    lock_file = open(LOCK_FILE_NAME, O_RDWR|O_CREAT|O_TRUNC, S_IRUSR|S_IWUSR|S_IROTH|S_IWOTH|S_IRGRP|S_IWGRP);
-    if (0 == lockf(lock_file, F_TLOCK, 0)) {
-        memset(pid_str, 0, sizeof(pid_str));
-        sprintf(pid_str, "%d", (int)getpid());
+static inline unsigned int get16(unsigned char *p) {
+    return (p[0] << 8) | p[1];
+}
+
+static inline unsigned long int get32(unsigned char *p) {
+    return ((unsigned long int)get16(p) << 16) | get16(p + 2);
+}
+
+static inline unsigned long long get64(unsigned char *p) {
+    return ((unsigned long long)get32(p) << 32) | get32(p + 4);
+}
+
+static inline void put16(unsigned char *p, unsigned int v) {
+    p[0] = (unsigned char)(v >> 8);
+    p[1] = (unsigned char)v;
+}
+
+/* one's complement sum of big-endian 16-bit words */
+unsigned long int csum_add(unsigned long int sum, unsigned char *p, unsigned int len) {
+    while (len > 1) {
+        sum += get16(p);
+        p += 2;
+        len -= 2;
+    }
+    if (len)
+        sum += p[0] << 8;
+    return sum;
+}
+
+static inline unsigned int csum_fold(unsigned long int sum) {
+    while (sum >> 16)
+        sum = (sum & 0xffff) + (sum >> 16);
+    return (unsigned int)sum;
+}
+
+/* RFC 1624: HC' = ~(~HC + ~m + m') for 'words' 16-bit words at p */
+void csum_replace(unsigned char *csum, unsigned char *p, unsigned char *new_val, unsigned int words) {
+    unsigned long int sum = (~get16(csum)) & 0xffff;
+    unsigned int i;
+    for (i = 0; i < words; i++) {
+        sum += (~get16(p + 2*i)) & 0xffff;
+        sum += get16(new_val + 2*i);
+    }
+    put16(csum, (~csum_fold(sum)) & 0xffff);
+}
+
+/* write value of field 'f' into template; patch checksums */
+void flow_set(struct flow_gen *g, enum flow_field f, unsigned long long v) {
+    unsigned char buf[ETH_ALEN], *field, *udp_csum;
+    unsigned int i, len;
+    udp_csum = g->hdr + g->udp_off + 6;
+    switch (f) {
+    case FLOW_SMAC:
+    case FLOW_DMAC:
+        for (i = 0; i < ETH_ALEN; i++)
+            buf[i] = (unsigned char)(v >> (8 * (ETH_ALEN - 1 - i)));
+        memcpy(g->hdr + (FLOW_DMAC == f ? 0 : ETH_ALEN), buf, ETH_ALEN);
+        return;
+    case FLOW_VLAN:
+        if (g->ip_off > ETH_HLEN)
+            put16(g->hdr + ETH_HLEN, (get16(g->hdr + ETH_HLEN) & 0xf000) | (unsigned int)v);
+        return;
+    case FLOW_SIP:
+    case FLOW_DIP:
+        len = 4;
+        field = g->hdr + g->ip_off + (FLOW_SIP == f ? 12 : 16);
+        put16(buf, (unsigned int)(v >> 16));
+        put16(buf + 2, (unsigned int)v);
+        csum_replace(g->hdr + g->ip_off + 10, field, buf, 2);
+        break;
+    default:
+        len = 2;
+        field = g->hdr + g->udp_off + (FLOW_SPORT == f ? 0 : 2);
+        put16(buf, (unsigned int)v);
+        break;
+    }
+    /* addresses and ports are both covered by UDP checksum */
+    csum_replace(udp_csum, field, buf, len / 2);
+    if (0 == get16(udp_csum))
+        put16(udp_csum, 0xffff);
+    memcpy(field, buf, len);
+}
+
+/* build IPv4/UDP header template for first flow of this thread */
+void flow_init(struct flow_gen *g, struct flow_spec *spec, unsigned int offset,
+                unsigned int stride, char *payload, unsigned int payload_len) {
+    unsigned char *ip, *udp;
+    unsigned long int sum;
+    int f;
+    memset(g, 0, sizeof(struct flow_gen));
+    g->spec = spec;
+    g->stride = stride ? stride : 1;
+    g->ip_off = ETH_HLEN;
+    if (spec->range[FLOW_VLAN].base || 1 < spec->range[FLOW_VLAN].count) {
+        put16(g->hdr + 12, ETH_P_8021Q);
+        put16(g->hdr + ETH_HLEN + 2, ETH_P_IP);
+        g->ip_off += 4;
+    }
+    else {
+        put16(g->hdr + 12, ETH_P_IP);
+    }
+    g->udp_off = g->ip_off + 20;
+    g->hdr_len = g->udp_off + 8;
+    for (f = 0; f < FLOW_FIELDS; f++)
+        g->cur[f] = offset % spec->range[f].count;
+    ip = g->hdr + g->ip_off;
+    udp = g->hdr + g->udp_off;
+    ip[0] = 0x45;
+    put16(ip + 2, 28 + payload_len);
+    ip[6] = 0x40; /* DF */
+    ip[8] = 64;
+    ip[9] = IPPROTO_UDP;
+    put16(udp + 4, 8 + payload_len);
+    /* place first values with zero checksums, then compute them in full */
+    for (f = 0; f < FLOW_FIELDS; f++)
+        flow_set(g, f, spec->range[f].base + g->cur[f]);
+    put16(ip + 10, 0);
+    put16(ip + 10, (~csum_fold(csum_add(0, ip, 20))) & 0xffff);
+    /* pseudo header: addresses, protocol, UDP length */
+    sum = csum_add(0, ip + 12, 8) + IPPROTO_UDP + 8 + payload_len;
+    put16(udp + 6, 0);
+    sum = csum_add(sum, udp, 8);
+    sum = csum_add(sum, (unsigned char*)payload, payload_len);
+    put16(udp + 6, (~csum_fold(sum)) & 0xffff);
+    if (0 == get16(udp + 6))
+        put16(udp + 6, 0xffff);
+}
+
+/* step to the next flow of this thread and copy its header to 'frame' */
+void flow_next(struct flow_gen *g, char *frame) {
+    struct flow_range *r;
+    int f;
+    for (f = 0; f < FLOW_FIELDS; f++) {
+        r = g->spec->range + f;
+        if (1 < r->count) {
+            g->cur[f] = (g->cur[f] + g->stride) % r->count;
+            flow_set(g, f, r->base + g->cur[f]);
+        }
+    }
+    memcpy(frame, g->hdr, g->hdr_len);
+}
+/* PACKET_MMAP TX RING HELPERS */
+int raw_ring_init(struct raw_ring *r, int sock, int if_index) {
+    struct tpacket_req req;
+    struct sockaddr_ll ll;
+    int version = TPACKET_V2;
+    r->sock = sock;
+    r->head = 0;
+    r->map = MAP_FAILED;
+    if (0 > setsockopt(sock, SOL_PACKET, PACKET_VERSION, &version, sizeof(version))) {
+        log("PACKET_VERSION Error #%d: %s", errno, strerror(errno));
+        return -1;
+    }
+    memset(&req, 0, sizeof(req));
+    req.tp_block_size = RAW_RING_BLOCK_SIZE;
+    req.tp_block_nr = RAW_RING_BLOCK_NR;
+    req.tp_frame_size = RAW_RING_FRAME_SIZE;
+    req.tp_frame_nr = (RAW_RING_BLOCK_SIZE / RAW_RING_FRAME_SIZE) * RAW_RING_BLOCK_NR;
+    if (0 > setsockopt(sock, SOL_PACKET, PACKET_TX_RING, &req, sizeof(req))) {
+        log("PACKET_TX_RING Error #%d: %s", errno, strerror(errno));
+        return -1;
+    }
+    r->frame_nr = req.tp_frame_nr;
+    r->map_size = (size_t)req.tp_block_size * req.tp_block_nr;
+    r->map = (char*)mmap(0, r->map_size, PROT_READ|PROT_WRITE, MAP_SHARED, sock, 0);
+    if (MAP_FAILED == r->map) {
+        log("mmap() Error #%d: %s", errno, strerror(errno));
+        return -1;
+    }
+    /* ring sends to bound interface: send() has no address */
+    memset(&ll, 0, sizeof(ll));
+    ll.sll_family = PF_PACKET;
+    ll.sll_protocol = htons(ETH_P_ALL);
+    ll.sll_ifindex = if_index;
+    if (0 > bind(sock, (struct sockaddr*)&ll, sizeof(ll))) {
+        log("bind() Error #%d: %s", errno, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+static inline struct tpacket2_hdr* raw_ring_frame(struct raw_ring *r, unsigned int i) {
+    return (struct tpacket2_hdr*)(r->map + (size_t)i * RAW_RING_FRAME_SIZE);
+}
+
+/*
+ * Copy frame template (and its length) into every slot of the ring.
+ * Slot still queued to kernel may be on the wire: it is waited for a
+ * while, then left with its previous frame, complete one of its own
+ * length.
+ */
+void raw_ring_fill(struct raw_ring *r, char *packet, unsigned int len) {
+    volatile struct tpacket2_hdr *hdr;
+    struct pollfd pfd;
+    unsigned int i, waits = RAW_RING_FILL_WAIT_MS;
+    pfd.fd = r->sock;
+    pfd.events = POLLOUT;
+    for (i = 0; i < r->frame_nr; i++) {
+        hdr = raw_ring_frame(r, i);
+        while ((hdr->tp_status & (TP_STATUS_SEND_REQUEST|TP_STATUS_SENDING)) && waits) {
+            (void)send(r->sock, 0, 0, 0);
+            (void)poll(&pfd, 1, 1);
+            waits--;
+        }
+        if (hdr->tp_status & (TP_STATUS_SEND_REQUEST|TP_STATUS_SENDING))
+            continue;
+        __sync_synchronize();
+        memcpy((char*)hdr + TPACKET_ALIGN(sizeof(struct tpacket2_hdr)), packet, len);
+        hdr->tp_len = len;
+    }
+}
+
+/* queue 'count' pre-built frames (of their own lengths) and flush;
+ * returns frames queued. With 'flow' each frame gets header of the next flow */
+int raw_ring_send(struct raw_ring *r, unsigned int count, struct flow_gen *flow) {
+    volatile struct tpacket2_hdr *hdr;
+    struct pollfd pfd;
+    unsigned int queued = 0;
+    while (queued < count) {
+        hdr = raw_ring_frame(r, r->head);
+        if (hdr->tp_status & (TP_STATUS_SEND_REQUEST|TP_STATUS_SENDING)) {
+            /* ring is full: let kernel drain it */
+            (void)send(r->sock, 0, 0, 0);
+            pfd.fd = r->sock;
+            pfd.events = POLLOUT;
+            (void)poll(&pfd, 1, 1);
+            if (hdr->tp_status & (TP_STATUS_SEND_REQUEST|TP_STATUS_SENDING)) {
+                errno = EAGAIN;
+                break;
+            }
+        }
+        if (flow)
+            flow_next(flow, (char*)hdr + TPACKET_ALIGN(sizeof(struct tpacket2_hdr)));
+        __sync_synchronize();
+        hdr->tp_status = TP_STATUS_SEND_REQUEST;
+        r->head = (r->head + 1) % r->frame_nr;
+        queued++;
+    }
+    if (0 > send(r->sock, 0, 0, 0)) {
+        return 0;
+    }
+    return queued;
+}
+
+void raw_ring_free(struct raw_ring *r) {
+    if (MAP_FAILED != r->map) {
+        munmap(r->map, r->map_size);
+    }
+}
+#endif
+
+/* Two procedures below implement my own
+ * "home-brewed" service stop/start mechanism:
+ * Create "lock-file" ; write PID in it ; acquire lock on it
+ * Next instance of daemon will try to acquire lock on this file
+ * Kill process with PID and rewrite file.
+ * Reasons for not using standard scripts are:
+ * 1) Possibility of starting by non-root
+ * 2) More cross-platform
+ */
+void kill_previous_instance () {
+    int lock_file;
+    char pid_str[10];
+    int pid, i;
+    errno = 0;
+    lock_file = open(lock_file_name, O_RDONLY);
+    if (0 < lock_file) {
+        /* lock file exists */
+        if (0 != lockf(lock_file, F_TEST, 0)) {
+            /* lock file exists + locked */
+            /* read PID of locking process */
+            memset(pid_str, 0, sizeof(pid_str));
+            i = read(lock_file, pid_str, sizeof(pid_str));
+            if (0 < i) {
+                pid = atoi(pid_str);
+                if (pid) {
+                    (void)kill(pid, SIGTERM);
+                    /* waiting 7 seconds for previous instance ended */
+                    i = 7;    
+                    while (0 < i) {
+                        if (0 == lockf(lock_file, F_TEST, 0)) {
+                            close(lock_file);
+                            return;
+                        }
+                        sleep(1);
+                        i -= 1;
+                    }
+                    close(lock_file);
+                    printf ("Error killing previous instance %d\nPossibly started by other user\n", pid);
+                    exit(1);
+                }
+            }
+            /* garbage in file */
+            close(lock_file);
+            printf ("Error reading lock file %s\nTerminating\n", lock_file_name);
+            exit(1);
+    }
+    else {
+            /* lock file exists + NOT locked */
+        }
+    }
+}
+
+int create_pid_file() {
+    char pid_str[10];
+    int lock_file;
+    lock_file = open(lock_file_name, O_RDWR|O_CREAT|O_TRUNC, S_IRUSR|S_IWUSR|S_IROTH|S_IWOTH|S_IRGRP|S_IWGRP);
+    if (0 == lockf(lock_file, F_TLOCK, 0)) {
+        memset(pid_str, 0, sizeof(pid_str));
+        sprintf(pid_str, "%d", (int)getpid());
         if (0 < write(lock_file, pid_str, strlen(pid_str)))
             return lock_file;
     }
-    close(lock_file);
+    close(lock_file);
+    return 0;
+}
+
+/* MONOTONIC TIME IN NANOSECONDS */
+unsigned long long clock_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * NANOSEC_PER_SEC + ts.tv_nsec;
+}
+
+unsigned long long realtime_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (unsigned long long)ts.tv_sec * NANOSEC_PER_SEC + ts.tv_nsec;
+}
+
+/* PACING HELPERS */
+void pacer_init(struct pacer *p, enum load_class c, unsigned long int rate,
+                unsigned long int burst, unsigned int delay) {
+    p->cls = c;
+    p->rate = rate;
+    p->interval_ns = (unsigned long long)delay * 1000;
+    p->burst_ns = rate ? (unsigned long long)burst * NANOSEC_PER_SEC / rate : 0;
+    p->remainder = 0;
+    p->next_ns = clock_ns();
+}
+
+/* sleep till absolute CLOCK_MONOTONIC deadline */
+void sleep_until_ns(unsigned long long deadline) {
+    struct timespec ts;
+    ts.tv_sec = deadline / NANOSEC_PER_SEC;
+    ts.tv_nsec = deadline % NANOSEC_PER_SEC;
+    while (EINTR == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, 0))
+        ;
+}
+
+/* sleep most of the interval, spin the rest: wake-up latency hidden */
+void pacer_sleep_until(enum load_class c, unsigned long long deadline) {
+    unsigned int gen = control.gen[c];
+    /* long sleeps are cut into pieces: control command ends them */
+    while (deadline > clock_ns() + PACER_SPIN_NS + CTL_POLL_NS) {
+        sleep_until_ns(clock_ns() + CTL_POLL_NS);
+        if (gen != control.gen[c])
+            return;
+    }
+    if (deadline > clock_ns() + PACER_SPIN_NS) {
+        sleep_until_ns(deadline - PACER_SPIN_NS);
+    }
+    while (clock_ns() < deadline)
+        ;
+}
+
+/* bucket is full: do not accumulate more credit than burst */
+void pacer_clamp(struct pacer *p, unsigned long long now) {
+    if (p->next_ns + p->burst_ns < now) {
+        p->next_ns = now - p->burst_ns;
+        p->remainder = 0;
+    }
+}
+
+/* 'bytes' (or 'packets' in interval mode) are sent: next deadline */
+void pacer_charge(struct pacer *p, unsigned long int bytes, unsigned int packets) {
+    unsigned long long cost;
+    if (p->rate) {
+        /* exact integer division with carry: no drift at any size */
+        cost = bytes * NANOSEC_PER_SEC + p->remainder;
+        p->next_ns += cost / p->rate;
+        p->remainder = cost % p->rate;
+    }
+    else {
+        p->next_ns += p->interval_ns * packets;
+    }
+}
+
+/* block until 'bytes' (or 'packets' in interval mode) may be sent;
+ * returns how late (ns) it is against the schedule */
+unsigned long long pacer_wait(struct pacer *p, unsigned long int bytes, unsigned int packets) {
+    unsigned long long now, scheduled;
+    now = clock_ns();
+    pacer_clamp(p, now);
+    scheduled = p->next_ns;
+    if (scheduled > now) {
+        pacer_sleep_until(p->cls, scheduled);
+        now = clock_ns();
+        /* cut short by control command */
+        if (now < scheduled)
+            return 0;
+    }
+    pacer_charge(p, bytes, packets);
+    return now - scheduled;
+}
+
+/* printf at buf + used, never beyond 'room' bytes; returns new used */
+int stats_append(char *buf, int used, int room, const char *fmt, ...) {
+    va_list ap;
+    int n;
+    if (used >= room - 1)
+        return used;
+    va_start(ap, fmt);
+    n = vsnprintf(buf + used, room - used, fmt, ap);
+    va_end(ap);
+    if (n < 0)
+        return used;
+    /* truncated: keep what fits */
+    return (used + n >= room) ? room - 1 : used + n;
+}
+
+/* GENERATOR COUNTERS */
+unsigned int jitter_bucket(unsigned long long v) {
+    int shift;
+    if (v < (1ULL << JITTER_SUB_BITS))
+        return (unsigned int)v;
+    shift = 63 - __builtin_clzll(v) - JITTER_SUB_BITS;
+    return ((shift + 1) << JITTER_SUB_BITS) + (unsigned int)((v >> shift) & ((1 << JITTER_SUB_BITS) - 1));
+}
+
+/* highest value of bucket */
+unsigned long long jitter_value(unsigned int bucket) {
+    int shift;
+    if (bucket < (1U << JITTER_SUB_BITS))
+        return bucket;
+    shift = (bucket >> JITTER_SUB_BITS) - 1;
+    return ((((1ULL << JITTER_SUB_BITS) + (bucket & ((1 << JITTER_SUB_BITS) - 1))) + 1) << shift) - 1;
+}
+
+/* 'permille' percentile of histogram of JITTER_BUCKETS, ns */
+unsigned long long hist_percentile(unsigned long long *hist, unsigned int permille) {
+    unsigned long long total = 0, seen = 0;
+    unsigned int i;
+    for (i = 0; i < JITTER_BUCKETS; i++)
+        total += hist[i];
+    if (!total)
+        return 0;
+    for (i = 0; i < JITTER_BUCKETS; i++) {
+        seen += hist[i];
+        if (seen * 1000 >= total * permille)
+            return jitter_value(i);
+    }
+    return jitter_value(JITTER_BUCKETS - 1);
+}
+
+unsigned long long jitter_percentile(struct gen_stats *st, unsigned int permille) {
+    return hist_percentile(st->jitter, permille);
+}
+
+void gen_stats_late(struct gen_stats *st, unsigned long long late) {
+    st->late_sum += late;
+    if (late > st->late_max)
+        st->late_max = late;
+    if (st->late_nr++)
+        st->jitter[jitter_bucket(late > st->late_prev ?
+            late - st->late_prev : st->late_prev - late)]++;
+    st->late_prev = late;
+}
+
+/* 'count' messages were not sent because of 'err' */
+void gen_stats_error(struct gen_stats *st, int err, unsigned long int count) {
+    enum send_error e;
+    switch (err) {
+    case EAGAIN:
+#if defined(EWOULDBLOCK) && EWOULDBLOCK != EAGAIN
+    case EWOULDBLOCK:
+#endif
+        e = SEND_EAGAIN;
+        break;
+    case ENOBUFS:
+        e = SEND_ENOBUFS;
+        break;
+    case ECONNREFUSED:
+        e = SEND_ECONNREFUSED;
+        break;
+    case EMSGSIZE:
+        e = SEND_EMSGSIZE;
+        break;
+    default:
+        e = SEND_EOTHER;
+    }
+    st->errors[e] += count;
+}
+
+/* one line per thread: "<name> packets bytes iterations late_avg late_max
+ * jitter p50 p99 p99.9 max ; errors by errno" */
+int gen_stats_line(struct gen_stats *st, char *buf, int room) {
+    int used, e;
+    used = stats_append(buf, 0, room, "%s %llu %llu %llu %llu %llu %llu %llu %llu %llu",
+        st->name, st->packets, st->bytes, st->iterations,
+        st->late_nr ? st->late_sum / st->late_nr : 0, st->late_max,
+        jitter_percentile(st, 500), jitter_percentile(st, 990),
+        jitter_percentile(st, 999), jitter_percentile(st, 1000));
+    for (e = 0; e < SEND_ERRORS; e++)
+        if (st->errors[e])
+            used = stats_append(buf, used, room, " %s=%llu", send_error_names[e], st->errors[e]);
+    return used;
+}
+
+/* active CPU threads are always 0 .. cpu_loaders_nr - 1 */
+int gen_stats_count() {
+    return gen_stats ? cpu_loaders_nr + gen_net_nr : 0;
+}
+
+struct gen_stats* gen_stats_at(int i) {
+    return (i < cpu_loaders_nr) ? gen_stats + i : gen_stats + CPU_THREADS_MAX + i - cpu_loaders_nr;
+}
+
+/* SIGUSR1: counters of all threads to syslog and stats file */
+#if defined(__linux__)
+/* RECEIVED FLOWS */
+/* flow of probe, new one if not seen yet; 0 if table is full */
+struct rx_flow* rx_flow_find(struct rx_info *info, unsigned char *addr,
+                             unsigned int port, unsigned int id) {
+    unsigned int h, i;
+    struct rx_flow *f;
+    h = (get32(addr) ^ get32(addr + 4) ^ get32(addr + 8) ^ get32(addr + 12) ^ (port << 16) ^ id)
+        * 2654435761U;
+    for (i = 0; i < RX_FLOWS_MAX; i++) {
+        f = info->flows + (h + i) % RX_FLOWS_MAX;
+        if (!f->used) {
+            memset(f, 0, sizeof(*f));
+            memcpy(f->addr, addr, sizeof(f->addr));
+            f->port = port;
+            f->id = id;
+            f->used = 1;
+            return f;
+        }
+        if (!memcmp(f->addr, addr, sizeof(f->addr)) && f->port == port && f->id == id)
+            return f;
+    }
+    return 0;
+}
+
+/* IPv4 address of flow source, 0 for IPv6 one */
+unsigned long int rx_flow_ipv4(struct rx_flow *f) {
+    static const unsigned char mapped[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff};
+    return memcmp(f->addr, mapped, sizeof(mapped)) ? 0 : get32(f->addr + 12);
+}
+
+/* one received datagram of 'len' bytes; 'now' is its receive time */
+void rx_account(struct rx_info *info, struct sockaddr_storage *from,
+                unsigned char *buf, unsigned int len, unsigned long long now) {
+    struct rx_flow *f;
+    unsigned long long seq, sent;
+    unsigned char addr[16];
+    unsigned int port;
+    if (len < PROBE_SIZE || memcmp(buf, PROBE_MAGIC, 4) || PROBE_VERSION != buf[4]) {
+        info->foreign++;
+        return;
+    }
+    /* IPv4 socket (IPv6 is off): address mapped as IPv6 socket does */
+    if (AF_INET6 == from->ss_family) {
+        memcpy(addr, &((struct sockaddr_in6*)from)->sin6_addr, sizeof(addr));
+        port = ntohs(((struct sockaddr_in6*)from)->sin6_port);
+    }
+    else {
+        memset(addr, 0, sizeof(addr));
+        addr[10] = addr[11] = 0xff;
+        memcpy(addr + 12, &((struct sockaddr_in*)from)->sin_addr, 4);
+        port = ntohs(((struct sockaddr_in*)from)->sin_port);
+    }
+    f = rx_flow_find(info, addr, port, get32(buf + 8));
+    if (!f) {
+        info->overflow++;
+        return;
+    }
+    seq = get64(buf + 12);
+    sent = get64(buf + 20);
+    if (!f->packets) {
+        f->first_seq = seq;
+        f->next_seq = seq + 1;
+        f->win_ns = now;
+    }
+    else if (seq < f->next_seq) {
+        f->reordered++;
+    }
+    else {
+        f->next_seq = seq + 1;
+    }
+    f->packets++;
+    f->bytes += len;
+    if (now >= sent)
+        f->latency[jitter_bucket(now - sent)]++;
+    else
+        f->negative++;
+    f->win_bytes += len;
+    if (now - f->win_ns >= NANOSEC_PER_SEC) {
+        f->rate = f->win_bytes * NANOSEC_PER_SEC / (now - f->win_ns);
+        f->win_ns = now;
+        f->win_bytes = 0;
+    }
+}
+
+/* expected - received, never negative (duplicates, reordered first packet) */
+unsigned long long rx_flow_lost(struct rx_flow *f) {
+    unsigned long long expected = f->next_seq - f->first_seq;
+    return expected > f->packets ? expected - f->packets : 0;
+}
+
+/* bytes/sec of last second, 0 when flow has stopped */
+unsigned long long rx_flow_rate(struct rx_flow *f) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    if ((unsigned long long)ts.tv_sec * NANOSEC_PER_SEC + ts.tv_nsec > f->win_ns + 2 * NANOSEC_PER_SEC)
+        return 0;
+    return f->rate;
+}
+
+/* i-th slot of all receivers' tables, 0 if unused */
+struct rx_flow* rx_flow_at(int i) {
+    struct rx_flow *f = rx_receivers[i / RX_FLOWS_MAX].flows + i % RX_FLOWS_MAX;
+    return f->used ? f : 0;
+}
+
+/* "source:port/id packets bytes bytes/sec lost loss% reordered latency p50 p99 p99.9 max ns [negative]" */
+int rx_flow_line(struct rx_flow *f, char *buf, int room) {
+    char source[INET6_ADDRSTRLEN + 2];
+    unsigned long long lost = rx_flow_lost(f);
+    int used;
+    /* IPv6 source in brackets: its colons are not the port one */
+    if (rx_flow_ipv4(f)) {
+        inet_ntop(AF_INET, f->addr + 12, source, sizeof(source));
+    }
+    else {
+        source[0] = '[';
+        inet_ntop(AF_INET6, f->addr, source + 1, sizeof(source) - 2);
+        strcat(source, "]");
+    }
+    used = stats_append(buf, 0, room, "%s:%u/%u %llu %llu %llu %llu %.3f%% %llu %llu %llu %llu %llu",
+        source, f->port, f->id, f->packets, f->bytes, rx_flow_rate(f), lost,
+        (lost + f->packets) ? 100.0 * lost / (lost + f->packets) : 0.0, f->reordered,
+        hist_percentile(f->latency, 500), hist_percentile(f->latency, 990),
+        hist_percentile(f->latency, 999), hist_percentile(f->latency, 1000));
+    /* sender clock is ahead: latencies are not meaningful */
+    if (f->negative)
+        used = stats_append(buf, used, room, " negative=%llu", f->negative);
+    return used;
+}
+
+
+/* "<name> sent answered timeouts latency_p50 p99 p999 max" of requester */
+int rpc_stats_line(struct rpc_info *r, char *buf, int room) {
+    return stats_append(buf, 0, room, "%s %llu %llu %llu %llu %llu %llu %llu",
+        r->stats->name, r->stats->packets, r->answered, r->timeouts,
+        hist_percentile(r->latency, 500), hist_percentile(r->latency, 990),
+        hist_percentile(r->latency, 999), hist_percentile(r->latency, 1000));
+}
+
+/* TCP connections of load thread 'i', then of sinks: "<name> open connects failed|bytes" */
+int tcp_stats_line(int i, char *buf, int room) {
+    if (i < tcp_loaders_nr)
+        return stats_append(buf, 0, room, "%s %lu %llu %llu", tcp_loaders[i].stats->name,
+            tcp_loaders[i].open, tcp_loaders[i].connects, tcp_loaders[i].failures);
+    i -= tcp_loaders_nr;
+    return stats_append(buf, 0, room, "%s %lu %llu %llu", tcp_sinks[i].name,
+        tcp_sinks[i].open, tcp_sinks[i].accepts, tcp_sinks[i].bytes);
+}
+#endif
+
+void gen_stats_dump() {
+    char line[512];
+    FILE *f = fopen(stats_file_name, "w");
+    int i;
+    if (f)
+        fprintf(f, "# thread packets bytes iterations late_avg_ns late_max_ns"
+            " jitter_p50_ns jitter_p99_ns jitter_p999_ns jitter_max_ns [errors]\n");
+    for (i = 0; i < gen_stats_count(); i++) {
+        gen_stats_line(gen_stats_at(i), line, sizeof(line));
+        log("Counters %s", line);
+        if (f)
+            fprintf(f, "%s\n", line);
+    }
+#if defined(__linux__)
+    if (f && rx_receivers_nr)
+        fprintf(f, "# flow packets bytes bytes_per_sec lost loss reordered"
+            " latency_p50_ns latency_p99_ns latency_p999_ns latency_max_ns [negative]\n");
+    for (i = 0; i < rx_receivers_nr * RX_FLOWS_MAX; i++) {
+        if (!rx_flow_at(i))
+            continue;
+        rx_flow_line(rx_flow_at(i), line, sizeof(line));
+        log("Flow %s", line);
+        if (f)
+            fprintf(f, "%s\n", line);
+    }
+    if (f && rpc_loaders_nr)
+        fprintf(f, "# rpc thread sent answered timeouts"
+            " latency_p50_ns latency_p99_ns latency_p999_ns latency_max_ns\n");
+    for (i = 0; i < rpc_loaders_nr; i++) {
+        rpc_stats_line(rpc_loaders + i, line, sizeof(line));
+        log("RPC %s", line);
+        if (f)
+            fprintf(f, "rpc %s\n", line);
+    }
+    if (f && tcp_loaders_nr + tcp_sinks_nr)
+        fprintf(f, "# tcp thread open connects failed ; sink open accepted bytes\n");
+    for (i = 0; i < tcp_loaders_nr + tcp_sinks_nr; i++) {
+        tcp_stats_line(i, line, sizeof(line));
+        log("TCP %s", line);
+        if (f)
+            fprintf(f, "tcp %s\n", line);
+    }
+#endif
+    if (f)
+        fclose(f);
+}
+
+/* SIGUSR1 is blocked in all threads but this one */
+void* gen_stats_signal(void *thread_arg) {
+    sigset_t *set = (sigset_t*)thread_arg;
+    int sig;
+    while (1) {
+        if (0 == sigwait(set, &sig) && SIGUSR1 == sig)
+            gen_stats_dump();
+    }
+    return 0;
+}
+
+/* RUNTIME CONTROL HELPERS */
+void ctl_changed(enum load_class c) {
+    pthread_mutex_lock(&control.lock);
+    control.gen[c]++;
+    pthread_cond_broadcast(&control.changed);
+    pthread_mutex_unlock(&control.lock);
+}
+
+/* sleep phase: over after 'seconds' or on control change of class 'c' */
+void ctl_sleep(enum load_class c, unsigned int seconds) {
+    struct timespec ts;
+    unsigned int gen;
+    pthread_mutex_lock(&control.lock);
+    gen = control.gen[c];
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    ts.tv_sec += seconds;
+    while (gen == control.gen[c] &&
+        ETIMEDOUT != pthread_cond_timedwait(&control.changed, &control.lock, &ts))
+        ;
+    pthread_mutex_unlock(&control.lock);
+}
+
+/* load class is paused or in -J sleep phase */
+int ctl_stopped(enum load_class c) {
+    return control.paused[c] || control.held[c];
+}
+
+/* block while load class is paused */
+void ctl_hold(enum load_class c) {
+    pthread_mutex_lock(&control.lock);
+    while (ctl_stopped(c))
+        pthread_cond_wait(&control.changed, &control.lock);
+    pthread_mutex_unlock(&control.lock);
+}
+
+/* FLEET ALIGNED PHASES */
+/* active at wall time 'now'? '*next' is the following boundary */
+unsigned short sync_position(struct phase_sync *ps, unsigned long long now, unsigned long long *next) {
+    unsigned long long base = ps->start + ps->offset, pos;
+    /* before the first cycle: sleeping */
+    if (now < base) {
+        *next = base;
+        return 0;
+    }
+    pos = (now - base) % ps->period;
+    *next = now - pos + ((pos < ps->active) ? ps->active : ps->period);
+    return pos < ps->active;
+}
+
+/* cycle of 'ps' as one consistent copy: control command may change it */
+void sync_cycle(struct phase_sync *ps, struct phase_sync *cyc) {
+    pthread_mutex_lock(&control.lock);
+    cyc->start = ps->start;
+    cyc->period = ps->period;
+    cyc->active = ps->active;
+    cyc->offset = ps->offset;
+    pthread_mutex_unlock(&control.lock);
+}
+
+/* load threads told about phase at once, as by control command */
+void sync_apply(struct phase_sync *ps, unsigned short on) {
+    unsigned short held;
+    int c;
+    pthread_mutex_lock(&control.lock);
+    for (c = 0; c < LOAD_CLASSES; c++) {
+        held = (ps->alternate && LOAD_NET == c) ? on : !on;
+        if (held != control.held[c])
+            control.gen[c]++;
+        control.held[c] = held;
+    }
+    ps->on = on;
+    pthread_cond_broadcast(&control.changed);
+    pthread_mutex_unlock(&control.lock);
+}
+
+/* "sync <period ns> <offset ns> on|off <switches> <error last ns> <mean> <max>" */
+int sync_stats_line(struct phase_sync *ps, char *buf, int room) {
+    return stats_append(buf, 0, room, "sync %llu %llu %s %llu %llu %llu %llu", ps->period, ps->offset,
+        ps->on ? "on" : "off", ps->switches, ps->error_last,
+        ps->switches ? ps->error_sum / ps->switches : 0, ps->error_max);
+}
+
+/*
+ * THREAD PROCEDURE OF -J: sleeps till the next boundary on CLOCK_REALTIME
+ * (in pieces, so that clock steps and new period are noticed), spins the
+ * last PACER_SPIN_NS and switches the phase. Boundaries missed by a
+ * period or more (clock stepped forward) are taken anew, not counted.
+ */
+void* sync_runner(void *thread_arg) {
+    struct phase_sync *ps = (struct phase_sync*)thread_arg, cyc;
+    unsigned long long now, next, expected, wake;
+    unsigned short on, phase;
+    struct timespec ts;
+    sync_cycle(ps, &cyc);
+    on = sync_position(&cyc, realtime_ns(), &next);
+    sync_apply(ps, on);
+    while (1) {
+        sync_cycle(ps, &cyc);
+        now = realtime_ns();
+        if (now < next) {
+            /* clock stepped back or cycle changed */
+            if ((phase = sync_position(&cyc, now, &expected)) != on || expected != next) {
+                on = phase;
+                next = expected;
+                sync_apply(ps, on);
+                continue;
+            }
+            if (next - now > PACER_SPIN_NS) {
+                wake = min(next - PACER_SPIN_NS, now + NANOSEC_PER_SEC);
+                ts.tv_sec = wake / NANOSEC_PER_SEC;
+                ts.tv_nsec = wake % NANOSEC_PER_SEC;
+                while (EINTR == clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, &ts, 0))
+                    ;
+                continue;
+            }
+            while ((now = realtime_ns()) < next)
+                ;
+        }
+        /* clock stepped forward */
+        if (now - next >= cyc.period) {
+            on = sync_position(&cyc, now, &next);
+            sync_apply(ps, on);
+            continue;
+        }
+        on = sync_position(&cyc, next, &expected);
+        sync_apply(ps, on);
+        ps->error_last = realtime_ns() - next;
+        ps->error_sum += ps->error_last;
+        if (ps->error_last > ps->error_max)
+            ps->error_max = ps->error_last;
+        ps->switches++;
+        next = expected;
+    }
+    return 0;
+}
+
+/* big endian stores: heartbeat records and probe headers */
+void hb_put16(char *p, unsigned int v) {
+    p[0] = (char)(v >> 8);
+    p[1] = (char)v;
+}
+
+void hb_put32(char *p, unsigned long int v) {
+    hb_put16(p, (v >> 16) & 0xffff);
+    hb_put16(p + 2, v & 0xffff);
+}
+
+void hb_put64(char *p, unsigned long long v) {
+    hb_put32(p, (unsigned long int)(v >> 32));
+    hb_put32(p + 4, (unsigned long int)(v & 0xffffffffUL));
+}
+
+/* NAME RESOLUTION */
+/* table for up to 'nr' names */
+int resolve_init(struct resolver *r, unsigned int nr) {
+    for (r->slots = 16; r->slots < 2 * nr; r->slots *= 2)
+        ;
+    r->entries = (struct resolve_entry*)calloc(r->slots, sizeof(struct resolve_entry));
+    r->list = (struct resolve_entry**)calloc(nr + 1, sizeof(struct resolve_entry*));
+    if (!r->entries || !r->list) {
+        r->slots = 0;
+        return -1;
+    }
+    return 0;
+}
+
+/* entry of 'name' ('add': new one, name must outlive it); 0 if missing */
+struct resolve_entry* resolve_find(struct resolver *r, const char *name, unsigned short add) {
+    unsigned int h = 2166136261U, i, mask = r->slots - 1;
+    struct resolve_entry *e;
+    const char *c;
+    for (c = name; *c; c++)
+        h = (h ^ (unsigned char)*c) * 16777619U;
+    for (i = 0; r->slots && i <= mask; i++) {
+        e = r->entries + ((h + i) & mask);
+        if (!e->name) {
+            if (!add)
+                return 0;
+            e->name = (char*)name;
+            r->list[r->nr++] = e;
+            return e;
+        }
+        if (!strcmp(e->name, name))
+            return e;
+    }
+    return 0;
+}
+
+/* THREAD PROCEDURE OF RESOLVER: takes names in turn */
+void* resolve_worker(void *thread_arg) {
+    struct resolver *r = (struct resolver*)thread_arg;
+    struct resolve_entry *e;
+    struct addrinfo hints, *res, *ai;
+    unsigned int i, n;
+    int family;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    while ((i = __sync_fetch_and_add(&r->taken, 1)) < r->nr) {
+        e = r->list[i];
+        if (!(e->err = getaddrinfo(e->name, 0, &hints, &res))) {
+            /* preferred family only, unless name has none of it */
+            family = r->inet6 ? AF_INET6 : AF_INET;
+            for (ai = res; ai && family != ai->ai_family; ai = ai->ai_next)
+                ;
+            if (!ai)
+                family = r->inet6 ? AF_INET : AF_INET6;
+            for (n = 0, ai = res; ai; ai = ai->ai_next)
+                n += (family == ai->ai_family);
+            n = min(n, RESOLVE_ADDRS_MAX);
+            if (n && (e->addrs = (struct sockaddr_storage*)calloc(n, sizeof(struct sockaddr_storage)))) {
+                for (ai = res; ai && e->addrs_nr < n; ai = ai->ai_next) {
+                    if (family == ai->ai_family)
+                        memcpy(e->addrs + e->addrs_nr++, ai->ai_addr, ai->ai_addrlen);
+                }
+            }
+            if (!e->addrs_nr)
+                e->err = n ? EAI_MEMORY : EAI_FAMILY;
+            freeaddrinfo(res);
+        }
+        pthread_mutex_lock(&r->lock);
+        e->done = 1;
+        r->done_nr++;
+        pthread_cond_signal(&r->finished);
+        pthread_mutex_unlock(&r->lock);
+    }
+    return 0;
+}
+
+/* all names resolved in parallel within timeout; returns number of failed ones */
+int resolve_run(struct resolver *r) {
+    struct resolve_entry *e;
+    struct timespec ts;
+    pthread_t thread;
+    unsigned int i, started = 0;
+    int failed = 0;
+    for (i = 0; i < min(r->threads, r->nr); i++) {
+        if (0 == pthread_create(&thread, 0, resolve_worker, (void*)r)) {
+            pthread_detach(thread);
+            started++;
+        }
+    }
+    if (!started)
+        resolve_worker((void*)r);
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += r->timeout / 1000;
+    ts.tv_nsec += (long)(r->timeout % 1000) * 1000000;
+    if (ts.tv_nsec >= NANOSEC_PER_SEC) {
+        ts.tv_sec++;
+        ts.tv_nsec -= NANOSEC_PER_SEC;
+    }
+    pthread_mutex_lock(&r->lock);
+    while (r->done_nr < r->nr &&
+        ETIMEDOUT != pthread_cond_timedwait(&r->finished, &r->lock, &ts))
+        ;
+    for (i = 0; i < r->nr; i++) {
+        e = r->list[i];
+        if (!e->done)
+            printf("Error: Host %s not resolved in %u msec\n", e->name, r->timeout);
+        else if (e->err)
+            printf("Error: Invalid host %s: %s\n", e->name, gai_strerror(e->err));
+        failed += !e->done || e->err;
+    }
+    pthread_mutex_unlock(&r->lock);
+    return failed;
+}
+
+/* length of IPv4 or IPv6 socket address */
+socklen_t addr_len(const struct sockaddr_storage *ss) {
+    return (AF_INET6 == ss->ss_family) ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
+}
+
+#if defined(__linux__)
+/* largest UDP payload not fragmented on the way to 'ss': MTU of the
+ * route (connected socket) less IP and UDP headers; 0 if unknown */
+unsigned int udp_path_payload(const struct sockaddr_storage *ss) {
+    const int set_on = 1;
+    int sock, mtu = 0;
+    socklen_t len = sizeof(mtu);
+    if (0 > (sock = socket(ss->ss_family, SOCK_DGRAM, 0)))
+        return 0;
+    setsockopt(sock, SOL_SOCKET, SO_BROADCAST, &set_on, sizeof(set_on));
+    if (0 == connect(sock, (const struct sockaddr*)ss, addr_len(ss))) {
+        if (AF_INET6 == ss->ss_family)
+            (void)getsockopt(sock, IPPROTO_IPV6, IPV6_MTU, &mtu, &len);
+        else
+            (void)getsockopt(sock, IPPROTO_IP, IP_MTU, &mtu, &len);
+    }
+    close(sock);
+    mtu -= (AF_INET6 == ss->ss_family) ? 40 + 8 : 20 + 8;
+    return (mtu > 0) ? (unsigned int)mtu : 0;
+}
+
+/*
+ * Socket of 'type' bound to 'port' of any address: IPv6 one takes IPv4
+ * peers too (as mapped addresses), IPv4 only where IPv6 is off.
+ * SO_REUSEPORT: kernel spreads peers over sockets of the port. -1 on error.
+ */
+int bind_any(int type, int port) {
+    const int set_on = 1, set_off = 0;
+    struct sockaddr_storage ss;
+    socklen_t len = sizeof(struct sockaddr_in6);
+    int sock, err;
+    memset(&ss, 0, sizeof(ss));
+    if (0 <= (sock = socket(AF_INET6, type, 0))) {
+        setsockopt(sock, IPPROTO_IPV6, IPV6_V6ONLY, &set_off, sizeof(set_off));
+        ss.ss_family = AF_INET6;
+        ((struct sockaddr_in6*)&ss)->sin6_port = htons(port);
+    }
+    else if (0 <= (sock = socket(AF_INET, type, 0))) {
+        ss.ss_family = AF_INET;
+        ((struct sockaddr_in*)&ss)->sin_port = htons(port);
+        len = sizeof(struct sockaddr_in);
+    }
+    else {
+        return -1;
+    }
+    if (SOCK_STREAM == (type & ~(SOCK_NONBLOCK | SOCK_CLOEXEC)))
+        setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &set_on, sizeof(set_on));
+    setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &set_on, sizeof(set_on));
+    if (0 > bind(sock, (struct sockaddr*)&ss, len)) {
+        err = errno;
+        close(sock);
+        errno = err;
+        return -1;
+    }
+    return sock;
+}
+#endif
+
+/*
+ * Next address of 'host' (round-robin among its addresses) with 'port';
+ * a name not resolved at start is looked up now. Length, 0 on error.
+ */
+socklen_t resolve_addr(const char *host, unsigned int port, struct sockaddr_storage *ss) {
+    struct resolve_entry *e = resolve_find(&resolver, host, 0);
+    struct addrinfo hints, *res;
+    memset(ss, 0, sizeof(struct sockaddr_storage));
+    if (e && e->done && e->addrs_nr) {
+        memcpy(ss, e->addrs + __sync_fetch_and_add(&e->next, 1) % e->addrs_nr, sizeof(struct sockaddr_storage));
+    }
+    else {
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_DGRAM;
+        if (getaddrinfo(host, 0, &hints, &res))
+            return 0;
+        memcpy(ss, res->ai_addr, res->ai_addrlen);
+        freeaddrinfo(res);
+    }
+    if (AF_INET6 == ss->ss_family)
+        ((struct sockaddr_in6*)ss)->sin6_port = htons(port);
+    else
+        ((struct sockaddr_in*)ss)->sin_port = htons(port);
+    return addr_len(ss);
+}
+
+/* SEND BATCH HELPERS */
+void batch_free(struct send_batch *b) {
+    free(b->msgs);
+    free(b->iov);
+    free(b->stamps);
+    free(b->zc_first);
+    b->msgs = 0;
+    b->iov = 0;
+    b->stamps = 0;
+    b->zc_first = 0;
+}
+
+/* stride == 0: all messages share 'buf'; otherwise message i is at buf + i*stride */
+int batch_init(struct send_batch *b, int sock, void *addr, socklen_t addr_len,
+                char *buf, unsigned int len, unsigned int stride, unsigned int depth) {
+    unsigned int i;
+    b->sock = sock;
+    b->flags = 0;
+    b->depth = depth ? depth : 1;
+    b->stamps = 0;
+    b->segs = 1;
+    b->sets = 1;
+    b->set = 0;
+    b->zc_next = 0;
+    b->zc_first = 0;
+    b->iov = (struct iovec*)calloc(b->depth, sizeof(struct iovec));
+#if defined(__linux__)
+    b->msgs = (struct mmsghdr*)calloc(b->depth, sizeof(struct mmsghdr));
+#else
+    b->msgs = (struct msghdr*)calloc(b->depth, sizeof(struct msghdr));
+#endif
+    if (!b->iov || !b->msgs) {
+        batch_free(b);
+        return -1;
+    }
+    for (i = 0; i < b->depth; i++) {
+        b->iov[i].iov_base = buf + i * stride;
+        b->iov[i].iov_len = len;
+        BATCH_MSG(b, i).msg_name = addr;
+        BATCH_MSG(b, i).msg_namelen = addr_len;
+        BATCH_MSG(b, i).msg_iov = b->iov + i;
+        BATCH_MSG(b, i).msg_iovlen = 1;
+    }
+    return 0;
+}
+
+void batch_set_len(struct send_batch *b, unsigned int len) {
+    unsigned int i;
+    for (i = 0; i < b->depth; i++) {
+        b->iov[i].iov_len = len;
+    }
+}
+
+/*
+ * Stamped batch: message is 'segs' datagrams (GSO cuts it at
+ * PROBE_SIZE + len boundaries), each one its own probe header
+ * followed by one of 'nr' bodies of 'pool'.
+ * 'sets' copies of headers: more than one with MSG_ZEROCOPY only.
+ */
+int batch_stamp_init(struct send_batch *b, unsigned int flow_id, char *pool,
+                     unsigned int len, unsigned int nr, unsigned int segs,
+                     unsigned int sets) {
+    unsigned int i, j;
+    char *p;
+    free(b->stamps);
+    free(b->iov);
+    free(b->zc_first);
+    b->segs = segs;
+    b->pool = pool;
+    b->pool_len = len;
+    b->pool_nr = nr;
+    b->pool_next = 0;
+    b->sets = sets ? sets : 1;
+    b->set = 0;
+    b->stamps = (char*)calloc(b->sets * b->depth * segs, PROBE_SIZE);
+    b->iov = (struct iovec*)calloc(b->depth * segs * 2, sizeof(struct iovec));
+    b->zc_first = (unsigned int*)calloc(3 * b->sets, sizeof(unsigned int));
+    if (!b->stamps || !b->iov || !b->zc_first)
+        return -1;
+    b->zc_nr = b->zc_first + b->sets;
+    b->zc_left = b->zc_nr + b->sets;
+    for (j = 0; j < b->sets * b->depth * segs; j++) {
+        p = b->stamps + j * PROBE_SIZE;
+        memcpy(p, PROBE_MAGIC, 4);
+        p[4] = PROBE_VERSION;
+        hb_put32(p + 8, flow_id);
+    }
+    for (j = 0; j < b->depth * segs; j++) {
+        b->iov[2 * j].iov_base = b->stamps + j * PROBE_SIZE;
+        b->iov[2 * j].iov_len = PROBE_SIZE;
+        b->iov[2 * j + 1].iov_base = pool + (j % nr) * len;
+        b->iov[2 * j + 1].iov_len = len;
+    }
+    for (i = 0; i < b->depth; i++) {
+        BATCH_MSG(b, i).msg_iov = b->iov + 2 * segs * i;
+        BATCH_MSG(b, i).msg_iovlen = 2 * segs;
+    }
+    return 0;
+}
+
+/* sequence numbers from '*seq' on and send time, right before sending;
+ * next bodies of the pool: content varies without refilling.
+ * Current set of headers must be free (batch_set_busy() == 0) */
+void batch_stamp(struct send_batch *b, unsigned long long *seq) {
+    struct timespec ts;
+    unsigned long long now;
+    unsigned int j;
+    char *p;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    now = (unsigned long long)ts.tv_sec * NANOSEC_PER_SEC + ts.tv_nsec;
+    for (j = 0; j < b->depth * b->segs; j++) {
+        p = b->stamps + (b->set * b->depth * b->segs + j) * PROBE_SIZE;
+        b->iov[2 * j].iov_base = p;
+        hb_put64(p + 12, (*seq)++);
+        hb_put64(p + 20, now);
+        if (b->pool_nr > 1) {
+            b->iov[2 * j + 1].iov_base = b->pool + b->pool_next * b->pool_len;
+            if (++b->pool_next == b->pool_nr)
+                b->pool_next = 0;
+        }
+    }
+}
+
+/* sends still using the current set of headers */
+static inline unsigned int batch_set_busy(struct send_batch *b) {
+    return b->sets > 1 ? b->zc_left[b->set] : 0;
+}
+
+/* 'sent' zerocopy sends took the next numbers: they hold the current
+ * set of headers until completed, next send stamps the next set */
+void batch_set_sent(struct send_batch *b, unsigned int sent) {
+    if (b->sets < 2)
+        return;
+    b->zc_first[b->set] = b->zc_next;
+    b->zc_nr[b->set] = sent;
+    b->zc_left[b->set] = sent;
+    b->zc_next += sent;
+    if (++b->set == b->sets)
+        b->set = 0;
+}
+
+/* zerocopy sends [lo..hi] completed: release sets of headers they held
+ * (numbers are 32-bit and wrap, ranges may come out of order) */
+void batch_set_done(struct send_batch *b, unsigned int lo, unsigned int hi) {
+    unsigned int k, off, part, len = hi - lo + 1;
+    for (k = 0; k < b->sets && b->sets > 1; k++) {
+        if (!b->zc_left[k])
+            continue;
+        off = lo - b->zc_first[k];
+        if (off < b->zc_nr[k])
+            part = min(b->zc_nr[k] - off, len);
+        else if ((off = b->zc_first[k] - lo) < len)
+            part = min(len - off, b->zc_nr[k]);
+        else
+            part = 0;
+        b->zc_left[k] -= min(part, b->zc_left[k]);
+    }
+}
+
+/* returns number of datagrams accepted by kernel */
+int batch_send(struct send_batch *b) {
+    unsigned int sent = 0;
+    int rc;
+    while (sent < b->depth) {
+#if defined(__linux__)
+        rc = sendmmsg(b->sock, b->msgs + sent, b->depth - sent, b->flags);
+#else
+        rc = (0 > sendmsg(b->sock, b->msgs + sent, b->flags)) ? -1 : 1;
+#endif
+        if (0 >= rc) {
+            /* EAGAIN/ENOBUFS etc: drop the rest of batch */
+            break;
+        }
+        sent += rc;
+    }
+    return sent;
+}
+
+#if defined(__linux__)
+/* MSG_ZEROCOPY COMPLETIONS */
+/*
+ * Kernel reports finished zerocopy sends on socket error queue
+ * as ranges [ee_info..ee_data] of send call numbers.
+ * Completions release kernel memory (optmem) and the sets of probe
+ * headers of the batch; payload is only rewritten once all are in.
+ * Returns number of completed sends.
+ */
+unsigned long int zerocopy_reap(struct send_batch *b, int wait_ms) {
+    int sock = b->sock;
+    char control[128];
+    struct msghdr msg;
+    struct cmsghdr *cm;
+    struct sock_extended_err *serr;
+    struct pollfd pfd;
+    unsigned long int done = 0;
+    if (wait_ms) {
+        pfd.fd = sock;
+        pfd.events = 0; /* POLLERR is always reported */
+        (void)poll(&pfd, 1, wait_ms);
+    }
+    while (1) {
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (0 > recvmsg(sock, &msg, MSG_ERRQUEUE|MSG_DONTWAIT))
+            break;
+        for (cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+            serr = (struct sock_extended_err*)CMSG_DATA(cm);
+            if (SO_EE_ORIGIN_ZEROCOPY != serr->ee_origin || serr->ee_errno)
+                continue;
+            done += serr->ee_data - serr->ee_info + 1;
+            batch_set_done(b, serr->ee_info, serr->ee_data);
+        }
+    }
+    return done;
+}
+
+/* before payload or headers are rewritten or freed: waits (up to a
+ * second) for 'pending' sends, returns number still not completed */
+unsigned long int zerocopy_drain(struct send_batch *b, unsigned long int pending) {
+    unsigned long int done;
+    unsigned int i;
+    for (i = 0; pending && i < 1000; i++) {
+        done = zerocopy_reap(b, 1);
+        pending -= min(pending, done);
+    }
+    return pending;
+}
+#endif
+
+/* CPU LOAD KERNELS */
+int kernel_always() {
+    return 1;
+}
+
+/* the original "short-circuit": xor/multiply/or in L1 */
+unsigned long int kernel_xor(struct cpu_kernel_state *st) {
+    unsigned int n, i1, i2, i = (unsigned int)st->pos;
+    for (n = 0; n < CPU_CLOCK_CHECK_EVERY; n++, i++) {
+        i1 = i % VECTOR_SIZE;
+        i2 = (i + 1) % VECTOR_SIZE;
+        st->vector[i1] ^= st->vector[i2];
+        st->vector[i1] *= 17;
+        st->vector[i1] |= st->vector[i2];
+    }
+    st->pos = i;
+    return 3 * CPU_CLOCK_CHECK_EVERY;
+}
+
+/* independent integer chains: keeps all ALU ports busy */
+unsigned long int kernel_int(struct cpu_kernel_state *st) {
+    unsigned long long a = st->rnd, b = a ^ 0x9e3779b97f4a7c15ULL, c = a + 1, d = a * 3;
+    unsigned int n;
+    for (n = 0; n < CPU_CLOCK_CHECK_EVERY; n++) {
+        a = a * 6364136223846793005ULL + 1442695040888963407ULL;
+        b ^= b >> 12;
+        b ^= b << 25;
+        c += (c << 7) | (c >> 57);
+        d = (d ^ a) + (b & c);
+    }
+    st->rnd = a;
+    st->sink = b ^ c ^ d;
+    return 11 * CPU_CLOCK_CHECK_EVERY;
+}
+
+/* random 8-way switch: front-end and branch predictor stress */
+unsigned long int kernel_branch(struct cpu_kernel_state *st) {
+    unsigned long long x = st->rnd, a = 0, b = 0;
+    unsigned int n;
+    for (n = 0; n < CPU_CLOCK_CHECK_EVERY; n++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        switch ((x >> 29) & 7) {
+        case 0: a += x; break;
+        case 1: b ^= x; break;
+        case 2: a -= b; break;
+        case 3: b += a >> 3; break;
+        case 4: a ^= b << 1; break;
+        case 5: b -= x >> 11; break;
+        case 6: a = (a << 5) | (a >> 59); break;
+        default: b = ~b; break;
+        }
+    }
+    st->rnd = x;
+    st->sink = a ^ b;
+    return CPU_CLOCK_CHECK_EVERY;
+}
+
+/* scalar multiply-add: FMA fallback for any CPU */
+unsigned long int kernel_fma_scalar(struct cpu_kernel_state *st) {
+    double acc[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+    const double m = 0.999999, c = 1e-6;
+    unsigned int n, k;
+    for (n = 0; n < CPU_CLOCK_CHECK_EVERY; n++) {
+        for (k = 0; k < 8; k++)
+            acc[k] = acc[k] * m + c;
+    }
+    st->sink = (unsigned long long)(acc[0] + acc[7]);
+    return 2 * 8 * CPU_CLOCK_CHECK_EVERY;
+}
+
+#if defined(CPU_KERNELS_X86)
+int kernel_avx2_supported() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+}
+
+int kernel_avx512_supported() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx512f");
+}
+
+/* 8 independent FMA chains of 8 floats: saturates both FMA ports */
+__attribute__((target("avx2,fma")))
+unsigned long int kernel_avx2(struct cpu_kernel_state *st) {
+    __m256 acc[8], m = _mm256_set1_ps(0.999999f), c = _mm256_set1_ps(1e-6f);
+    unsigned int n, k;
+    float out[8];
+    for (k = 0; k < 8; k++)
+        acc[k] = _mm256_set1_ps((float)k);
+    for (n = 0; n < CPU_CLOCK_CHECK_EVERY; n++) {
+        for (k = 0; k < 8; k++)
+            acc[k] = _mm256_fmadd_ps(acc[k], m, c);
+    }
+    for (k = 1; k < 8; k++)
+        acc[0] = _mm256_add_ps(acc[0], acc[k]);
+    _mm256_storeu_ps(out, acc[0]);
+    st->sink = (unsigned long long)out[0];
+    return 2 * 8 * 8 * CPU_CLOCK_CHECK_EVERY;
+}
+
+/* same with 16 floats per register: triggers AVX-512 frequency licence */
+__attribute__((target("avx512f")))
+unsigned long int kernel_avx512(struct cpu_kernel_state *st) {
+    __m512 acc[8], m = _mm512_set1_ps(0.999999f), c = _mm512_set1_ps(1e-6f);
+    unsigned int n, k;
+    for (k = 0; k < 8; k++)
+        acc[k] = _mm512_set1_ps((float)k);
+    for (n = 0; n < CPU_CLOCK_CHECK_EVERY; n++) {
+        for (k = 0; k < 8; k++)
+            acc[k] = _mm512_fmadd_ps(acc[k], m, c);
+    }
+    for (k = 1; k < 8; k++)
+        acc[0] = _mm512_add_ps(acc[0], acc[k]);
+    st->sink = (unsigned long long)_mm512_reduce_add_ps(acc[0]);
+    return 2 * 16 * 8 * CPU_CLOCK_CHECK_EVERY;
+}
+#endif
+
+/* read-modify-write one byte per cache line over the working set */
+unsigned long int kernel_sweep(struct cpu_kernel_state *st) {
+    unsigned int n;
+    size_t pos = st->pos;
+    for (n = 0; n < CPU_CLOCK_CHECK_EVERY; n++) {
+        st->buf[pos]++;
+        pos += CACHE_LINE;
+        if (pos >= st->size)
+            pos = 0;
+    }
+    st->pos = pos;
+    return CPU_CLOCK_CHECK_EVERY;
+}
+
+/* dependent loads through random cycle of lines: prefetcher can not
+ * guess the next one, every load waits for the tier's latency */
+unsigned long int kernel_chase(struct cpu_kernel_state *st) {
+    void **p = (void**)(st->buf + st->pos);
+    unsigned int n;
+    for (n = 0; n < CPU_CLOCK_CHECK_EVERY; n++)
+        p = (void**)*p;
+    st->pos = (char*)p - st->buf;
+    return CPU_CLOCK_CHECK_EVERY;
+}
+
+struct cpu_kernel cpu_kernels[] = {
+    {"xor", 0, kernel_always, kernel_xor},
+    {"int", 0, kernel_always, kernel_int},
+    {"branch", 0, kernel_always, kernel_branch},
+#if defined(CPU_KERNELS_X86)
+    {"avx512", 0, kernel_avx512_supported, kernel_avx512},
+    {"avx2", 0, kernel_avx2_supported, kernel_avx2},
+#endif
+    {"fma-scalar", 0, kernel_always, kernel_fma_scalar},
+    {"l1", 1, kernel_always, kernel_sweep},
+    {"l2", 2, kernel_always, kernel_chase},
+    {"l3", 3, kernel_always, kernel_chase},
+    {"dram", 4, kernel_always, kernel_chase},
+    {0, 0, 0, 0}
+};
+
+/* by name; "fma" => widest FMA this CPU supports (CPUID dispatch) */
+struct cpu_kernel* cpu_kernel_find(char *name) {
+    struct cpu_kernel *k;
+    unsigned short fma = (0 == strcmp(name, "fma"));
+    for (k = cpu_kernels; k->name; k++) {
+        if (fma ? (0 == strcmp(k->name, "fma-scalar") || 0 == strncmp(k->name, "avx", 3))
+                : (0 == strcmp(k->name, name))) {
+            if ((k->supported)())
+                return k;
+            if (!fma)
+                return 0;
+        }
+    }
+    return 0;
+}
+
+/* Sattolo's shuffle: 'buf' becomes one cycle over all of its 'lines',
+ * each line points to the next one; 0 on success */
+int chase_init(char *buf, unsigned long int lines, unsigned int *seed) {
+    unsigned long int i, j, tmp, *idx;
+    idx = (unsigned long int*)malloc(lines * sizeof(unsigned long int));
+    if (!idx)
+        return -1;
+    for (i = 0; i < lines; i++)
+        idx[i] = i;
+    for (i = lines - 1; i > 0; i--) {
+        j = (((unsigned long int)rand_r(seed) << 31) ^ rand_r(seed)) % i;
+        tmp = idx[i]; idx[i] = idx[j]; idx[j] = tmp;
+    }
+    for (i = 0; i < lines; i++)
+        *(void**)(buf + idx[i] * CACHE_LINE) = buf + idx[(i + 1) % lines] * CACHE_LINE;
+    free(idx);
+    return 0;
+}
+
+/* working set for tier kernels: half of the cache level, so it fits
+ * there but not in the level above */
+size_t cpu_kernel_working_set(int tier) {
+    long l1 = 0, l2 = 0, l3 = 0;
+#if defined(_SC_LEVEL1_DCACHE_SIZE)
+    l1 = sysconf(_SC_LEVEL1_DCACHE_SIZE);
+    l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    l3 = sysconf(_SC_LEVEL3_CACHE_SIZE);
+#endif
+    if (l1 <= 0)
+        l1 = CACHE_L1_DEFAULT;
+    if (l2 <= 0)
+        l2 = CACHE_L2_DEFAULT;
+    if (l3 <= 0)
+        l3 = CACHE_L3_DEFAULT;
+    switch (tier) {
+    case 1:
+        return l1 / 2;
+    case 2:
+        return l2 / 2;
+    case 3:
+        return l3 / 2;
+    case 4:
+        return max(4 * (size_t)l3, (size_t)DRAM_WORKING_SET_MIN);
+    default:
+        return 0;
+    }
+}
+
+/* FILL BUFFER WITH JUNK */
+unsigned int fill_dummy(char* buf, unsigned int buf_size) {
+    if (!buf || buf_size < 4) {
+        return 0;
+    }
+    buf[0] = 'B';
+    buf[1] = '\0';
+    memset(buf + 2, 'D', buf_size - 3);
+    buf[buf_size - 1] = '\0';
+    return buf_size;
+}
+
+/* PAYLOAD GENERATORS */
+unsigned long long splitmix64(unsigned long long *x) {
+    unsigned long long z = (*x += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/* 4 independent xorshift128+ lanes: 32 bytes per step, vectorizable */
+void prng_fill_c(char *buf, unsigned int size, unsigned long long seed) {
+    unsigned long long a[4], b[4], x[4], y, r[4];
+    unsigned int k, off;
+    for (k = 0; k < 4; k++) {
+        a[k] = splitmix64(&seed);
+        b[k] = splitmix64(&seed);
+    }
+    for (off = 0; off < size; off += sizeof(r)) {
+        for (k = 0; k < 4; k++) {
+            x[k] = a[k];
+            y = b[k];
+            r[k] = x[k] + y;
+            a[k] = y;
+            x[k] ^= x[k] << 23;
+            b[k] = x[k] ^ y ^ (x[k] >> 17) ^ (y >> 26);
+        }
+        memcpy(buf + off, r, min(sizeof(r), size - off));
+    }
+}
+
+#if defined(CPU_KERNELS_X86)
+/* the same lanes in one AVX2 register */
+__attribute__((target("avx2")))
+void prng_fill_avx2(char *buf, unsigned int size, unsigned long long seed) {
+    unsigned long long s[8], r[4];
+    __m256i a, b, x, y;
+    unsigned int k, off;
+    for (k = 0; k < 4; k++) {
+        s[k] = splitmix64(&seed);
+        s[k + 4] = splitmix64(&seed);
+    }
+    a = _mm256_loadu_si256((__m256i*)s);
+    b = _mm256_loadu_si256((__m256i*)(s + 4));
+    for (off = 0; off + sizeof(r) <= size; off += sizeof(r)) {
+        x = a;
+        y = b;
+        _mm256_storeu_si256((__m256i*)(buf + off), _mm256_add_epi64(x, y));
+        a = y;
+        x = _mm256_xor_si256(x, _mm256_slli_epi64(x, 23));
+        b = _mm256_xor_si256(_mm256_xor_si256(x, y),
+            _mm256_xor_si256(_mm256_srli_epi64(x, 17), _mm256_srli_epi64(y, 26)));
+    }
+    if (off < size) {
+        _mm256_storeu_si256((__m256i*)r, _mm256_add_epi64(a, b));
+        memcpy(buf + off, r, size - off);
+    }
+}
+#endif
+
+/* picked at start by CPUID */
+void (*prng_fill)(char*, unsigned int, unsigned long long) = prng_fill_c;
+
+/* incompressible: every call (every pool body) gets its own seed */
+unsigned int fill_random(char* buf, unsigned int buf_size) {
+    prng_fill(buf, buf_size, clock_ns() ^ (unsigned long long)(unsigned long)buf);
+    return buf_size;
+}
+
+/* random head of every block, zero tail: content.ratio % compresses away */
+unsigned int fill_ratio(char* buf, unsigned int buf_size) {
+    unsigned int off, block, zeros;
+    fill_random(buf, buf_size);
+    for (off = 0; off < buf_size; off += PAYLOAD_RATIO_BLOCK) {
+        block = min(PAYLOAD_RATIO_BLOCK, buf_size - off);
+        zeros = block * content.ratio / 100;
+        memset(buf + off + block - zeros, 0, zeros);
+    }
+    return buf_size;
+}
+
+/* pattern repeated; file contents from where previous call stopped */
+unsigned int fill_data(char* buf, unsigned int buf_size) {
+    unsigned long int pos = 0, n;
+    unsigned int off;
+    if (PAYLOAD_FILE == content.kind)
+        pos = __sync_fetch_and_add(&content.pos, buf_size) % content.len;
+    for (off = 0; off < buf_size; off += n) {
+        n = min(content.len - pos, buf_size - off);
+        memcpy(buf + off, content.data + pos, n);
+        pos = 0;
+    }
+    return buf_size;
+}
+
+/* content generator of load, -f */
+unsigned int (*payload_fill)(char*, unsigned int) = fill_dummy;
+
+/* "text" or "0x<hex>" => content.data; 0 on success */
+int payload_pattern(char *str) {
+    unsigned int i, n;
+    if (!str || !*str)
+        return -1;
+    if (strncmp(str, "0x", 2)) {
+        content.data = strdup(str);
+        content.len = strlen(str);
+        return 0;
+    }
+    str += 2;
+    n = strlen(str) / 2;
+    if (!n || strlen(str) % 2 || !(content.data = (char*)malloc(n)))
+        return -1;
+    for (i = 0; i < n; i++) {
+        if (!isxdigit(str[2 * i]) || !isxdigit(str[2 * i + 1]))
+            return -1;
+        sscanf(str + 2 * i, "%2hhx", (unsigned char*)content.data + i);
+    }
+    content.len = n;
+    return 0;
+}
+
+/* file contents (up to PAYLOAD_FILE_MAX) => content.data; 0 on success */
+int payload_file(char *path) {
+    struct stat st;
+    ssize_t n;
+    unsigned long int got = 0;
+    int fd = open(path, O_RDONLY);
+    if (0 > fd || 0 > fstat(fd, &st) || !st.st_size) {
+        if (0 <= fd)
+            close(fd);
+        return -1;
+    }
+    content.len = min((unsigned long int)st.st_size, PAYLOAD_FILE_MAX);
+    content.data = (char*)malloc(content.len);
+    while (content.data && got < content.len &&
+            0 < (n = read(fd, content.data + got, content.len - got)))
+        got += n;
+    close(fd);
+    if (!content.data || !got)
+        return -1;
+    content.len = got;
+    return 0;
+}
+
+/* FILL BUFFER WITH HOST PERFORMANCE STATISTICS */
+/*
+ * Host statistic in the format:
+ * {
+ * char CODE - ('S' - os name; 'C' - cpu stats; 'N' - network stats)
+ * char '\0'
+ * char DATA[]
+ * char '\0'
+ * }
+ */
+unsigned int fill_stats(char *buf, unsigned int buf_size) {
+    int fd, cpu_stat_size, net_stat_size, kernel_stat_size, mem_stat_size, disk_stat_size;
+    int place_stat_size, gen_stat_size, i;
+    /* TODO include timestamp: time_t t = time(0); */
+    /* TODO: put each stats in its own procedure */
+    /* code */
+    buf[0] = 'C';
+    buf[1] = '\0';
+    buf += 2;
+    fd = -1;
+#ifdef __linux__
+    /* cpu stats */
+    fd = open ("/proc/loadavg", O_RDONLY);
+    if (-1 == fd) {
+        return -2;
+    }
+    cpu_stat_size = read (fd, buf, buf_size - 2);
+    (void) close (fd);
+    if (cpu_stat_size <= 0 ) {
+        return -4;
+    }
+#endif
+#ifdef __FreeBSD__
+    int mib[2];
+    size_t len;
+    struct loadavg lavg;
+    mib[0] = CTL_VM; mib[1] = VM_LOADAVG;
+    len = sizeof(struct loadavg);
+    sysctl(mib, 2, &lavg, &len, 0, 0);
+    cpu_stat_size = sprintf(buf, "%.2f %.2f %.2f ", 
+                    ((float)lavg.ldavg[0]) / ((float)lavg.fscale),
+                    ((float)lavg.ldavg[1]) / ((float)lavg.fscale),
+                    ((float)lavg.ldavg[2]) / ((float)lavg.fscale ));
+    if (0 >= cpu_stat_size) {
+        return -1;
+    }
+#endif
+#if !defined(__linux__) && !defined(__FreeBSD__)
+    strncpy(buf, stub_msg, STUB_MSG_SIZE);
+    cpu_stat_size = STUB_MSG_SIZE;
+#endif
+    buf[cpu_stat_size] = '\0';
+    buf += cpu_stat_size + 1;
+    /* cpu load kernels throughput: "<kernel> <ops/sec>" per thread */
+    buf[0] = 'K';
+    buf[1] = '\0';
+    buf += 2;
+    kernel_stat_size = 0;
+    for (i = 0; i < cpu_loaders_nr; i++) {
+        kernel_stat_size = stats_append(buf, kernel_stat_size, buf_size / 4,
+            "%s %lu\n", cpu_loaders[i].kernel->name, cpu_loaders[i].ops_per_sec);
+    }
+    buf[kernel_stat_size] = '\0';
+    buf += kernel_stat_size + 1;
+    /* memory load: "<mode> <bytes/sec>" per thread,
+     * chase: "chase <loads/sec> <ns/load>" */
+    buf[0] = 'W';
+    buf[1] = '\0';
+    buf += 2;
+    mem_stat_size = 0;
+    for (i = 0; i < mem_loaders_nr; i++) {
+        mem_stat_size = stats_append(buf, mem_stat_size, buf_size / 8,
+            (MEM_CHASE == mem_loaders[i].mode) ? "%s %lu %.1f\n" : "%s %lu\n",
+            mem_mode_names[mem_loaders[i].mode], mem_loaders[i].per_sec,
+            mem_loaders[i].latency_ns);
+    }
+    buf[mem_stat_size] = '\0';
+    buf += mem_stat_size + 1;
+    /* disk load: "<path> <iops> <read B/s> <write B/s> <errors>" */
+    buf[0] = 'D';
+    buf[1] = '\0';
+    buf += 2;
+    disk_stat_size = 0;
+    for (i = 0; i < disk_loaders_nr; i++) {
+        disk_stat_size = stats_append(buf, disk_stat_size, buf_size / 8,
+            "%s %lu %lu %lu %lu\n", disk_loaders[i].path, disk_loaders[i].iops,
+            disk_loaders[i].read_per_sec, disk_loaders[i].write_per_sec,
+            disk_loaders[i].errors);
+    }
+    buf[disk_stat_size] = '\0';
+    buf += disk_stat_size + 1;
+    /* placement: "<thread> <cpus> <policy>" per load thread */
+    buf[0] = 'P';
+    buf[1] = '\0';
+    buf += 2;
+    place_stat_size = 0;
+    for (i = 0; i < placed_nr; i++) {
+        place_stat_size = stats_append(buf, place_stat_size, buf_size / 8,
+            "%s\n", placed[i]);
+    }
+    buf[place_stat_size] = '\0';
+    buf += place_stat_size + 1;
+    /* generators: see gen_stats_line() */
+    buf[0] = 'G';
+    buf[1] = '\0';
+    buf += 2;
+    gen_stat_size = 0;
+    for (i = 0; i < gen_stats_count() && gen_stat_size < (int)buf_size / 4 - 1; i++) {
+        gen_stat_size += gen_stats_line(gen_stats_at(i), buf + gen_stat_size,
+            buf_size / 4 - gen_stat_size);
+        gen_stat_size = stats_append(buf, gen_stat_size, buf_size / 4, "\n");
+    }
+    buf[gen_stat_size] = '\0';
+    buf += gen_stat_size + 1;
+    /* network stats */
+    buf[0] = 'N';
+    buf[1] = '\0';
+    buf += 2;
+#ifdef __linux__
+    fd = open ("/proc/net/dev", O_RDONLY);
+    if (-1 == fd) {
+        return -5;
+    }
+    /* room for all headers and os name */
+    net_stat_size = read (fd, buf,
+        buf_size - cpu_stat_size - kernel_stat_size - mem_stat_size - disk_stat_size
+        - place_stat_size - gen_stat_size - 8*3 - OS_NAME_LEN);
+    (void) close (fd);
+    if (net_stat_size <= 0 ) {
+        return -7;
+    }
+#else
+    strncpy(buf, stub_msg, STUB_MSG_SIZE);
+    net_stat_size = STUB_MSG_SIZE;
+#endif
+    buf[net_stat_size] = '\0';
+    buf += net_stat_size + 1;
+    /* os name */
+    buf[0] = 'S';
+    buf[1] = '\0';
+    buf += 2;
+    strncpy(buf, os_name, OS_NAME_LEN);
+    buf[OS_NAME_LEN] = '\0';
+    return cpu_stat_size + kernel_stat_size + mem_stat_size + disk_stat_size
+        + place_stat_size + gen_stat_size + net_stat_size + OS_NAME_LEN + 8*3;
+}
+
+/* CPU TIME CONSUMED BY CALLING THREAD IN NANOSECONDS */
+unsigned long long thread_cpu_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (unsigned long long)ts.tv_sec * NANOSEC_PER_SEC + ts.tv_nsec;
+}
+
+/* THREAD PROCEDURE FOR CPU LOAD */
+/*
+ * PWM mode: every period the thread spins until it has got 'util' % of
+ * the period as its own CPU time (CLOCK_THREAD_CPUTIME_ID, so time
+ * stolen by hypervisor or co-tenants is not counted), then sleeps till
+ * the period end. What could not be consumed within the period (or was
+ * overconsumed) is carried over to the next budget, so the average
+ * converges to the target.
+ */
+void* cpuloader(void *thread_arg) {
+    unsigned short i;
+    struct cpu_kernel_state st;
+    unsigned long int its_time = 0, ops = 0;
+    unsigned long long period_ns, period_end, cpu_start, cpu_prev = 0, budget, used;
+    unsigned long long rate_start;
+    long long debt = 0, target;
+    unsigned int seen, seed;
+    struct cpu_load_info *info = (struct cpu_load_info *)thread_arg;
+    struct schedule *sch = &(info->phases);
+    unsigned long int (*run)(struct cpu_kernel_state*) = info->kernel->run;
+    memset(&st, 0, sizeof(st));
+    pthread_mutex_lock( &mutex_ini );
+    srand(time(0));
+    for (i = 0; i < VECTOR_SIZE; i++) {
+        st.vector[i] = rand();
+    }
+    st.rnd = ((unsigned long long)rand() << 32) | rand() | 1;
+    seed = (unsigned int)st.rnd;
+    pthread_mutex_unlock( &mutex_ini );
+    if (info->kernel->tier) {
+        st.size = cpu_kernel_working_set(info->kernel->tier);
+        st.buf = (char*)malloc(st.size);
+        if (!st.buf) {
+            log("ERROR: %s kernel: can not allocate %lu bytes", info->kernel->name,
+                (unsigned long)st.size);
+            return 0;
+        }
+        memset(st.buf, 0, st.size);
+        if (kernel_chase == run && 0 > chase_init(st.buf, st.size / CACHE_LINE, &seed)) {
+            log("ERROR: %s kernel: can not allocate chase index", info->kernel->name);
+            free(st.buf);
+            return 0;
+        }
+    }
+    rate_start = clock_ns();
+    /* eternal loop */
+    while (1) {
+        ctl_hold(LOAD_CPU);
+        /* removed by control command */
+        pthread_mutex_lock(&control.lock);
+        while (info->quit && info->stay)
+            pthread_cond_wait(&control.changed, &control.lock);
+        if (info->quit) {
+            info->running = 0;
+            pthread_mutex_unlock(&control.lock);
+            break;
+        }
+        pthread_mutex_unlock(&control.lock);
+        /* (new) parameters */
+        seen = control.gen[LOAD_CPU];
+        period_ns = (unsigned long long)info->period * 1000;
+        target = (long long)(info->util / 100 * period_ns);
+        if (sch->sleep) {
+            its_time = time(0) + sch->active;
+        }
+        period_end = clock_ns();
+        cpu_prev = 0;
+        debt = 0;
+        /* active phase */
+        while (sch->sleep ? (time(0) < its_time) : 1) {
+            if (seen != control.gen[LOAD_CPU])
+                break;
+            /* ops/sec over about a second of wall time */
+            if (clock_ns() - rate_start >= NANOSEC_PER_SEC) {
+                info->ops_per_sec = (unsigned long int)((double)ops * NANOSEC_PER_SEC /
+                    (clock_ns() - rate_start));
+                ops = 0;
+                rate_start = clock_ns();
+            }
+            if (info->util >= 100) {
+                ops += run(&st);
+                info->stats->iterations += CPU_CLOCK_CHECK_EVERY;
+                continue;
+            }
+            /* one PWM period; CPU used by the previous one (busy loop,
+             * wake-ups, clock readings) is settled first */
+            cpu_start = thread_cpu_ns();
+            if (cpu_prev) {
+                used = cpu_start - cpu_prev;
+                debt += target - (long long)used;
+                /* carry over at most one period either way */
+                if (debt > (long long)period_ns)
+                    debt = period_ns;
+                if (debt < -(long long)period_ns)
+                    debt = -(long long)period_ns;
+                info->achieved = 100.0 * used / period_ns;
+            }
+            cpu_prev = cpu_start;
+            period_end += period_ns;
+            budget = (target + debt > 0) ? (unsigned long long)(target + debt) : 0;
+            if (budget > period_ns)
+                budget = period_ns;
+            used = 0;
+            while (used < budget && clock_ns() < period_end) {
+                ops += run(&st);
+                info->stats->iterations += CPU_CLOCK_CHECK_EVERY;
+                used = thread_cpu_ns() - cpu_start;
+            }
+            if (clock_ns() < period_end) {
+                sleep_until_ns(period_end);
+                /* wake-up overshoot */
+                gen_stats_late(info->stats, clock_ns() - period_end);
+            }
+            else if (clock_ns() > period_end + period_ns) {
+                /* far behind (descheduled): do not try to catch up */
+                period_end = clock_ns();
+            }
+        }
+        /* sleep phase */
+        if (seen == control.gen[LOAD_CPU] && sch->sleep) {
+            ctl_sleep(LOAD_CPU, sch->sleep);
+        }
+    }
+    info->ops_per_sec = 0;
+    info->achieved = 0;
+    free(st.buf);
+    return 0;
+}
+
+/* BINARY HEARTBEAT */
+struct hb_iface {
+    char name[HB_NAME_LEN];
+    unsigned long long rx_bytes, tx_bytes, rx_packets, tx_packets;
+};
+
+/*
+ * Heartbeat thread state: /proc files are opened once and re-read
+ * with pread(); counters of previous heartbeat give per second rates.
+ */
+struct hb_state {
+    int loadavg_fd, net_dev_fd, stat_fd;
+    unsigned long long cpu_busy, cpu_total;
+    char *proc_buf;
+    struct hb_iface prev[HB_IFACES_MAX], cur[HB_IFACES_MAX];
+    int prev_nr, cur_nr;
+    unsigned long long prev_ns;
+    unsigned int seq;
+    char host[256];
+    unsigned int host_len;
+    unsigned long int ip;
+    /* datagrams of one heartbeat */
+    char *dgram[HB_PARTS_MAX];
+    unsigned int dgram_len[HB_PARTS_MAX], records[HB_PARTS_MAX], parts;
+};
+
+/* zero padded copy; keeps the tail of too long strings (paths) */
+void hb_put_name(char *p, const char *name, unsigned int len) {
+    unsigned int n = strlen(name);
+    memset(p, 0, len);
+    if (n > len)
+        name += n - len, n = len;
+    memcpy(p, name, n);
+}
+
+/* header of current (last) datagram */
+void hb_part_start(struct hb_state *st) {
+    char *p = st->dgram[st->parts];
+    memcpy(p, HB_MAGIC, 4);
+    p[4] = HB_VERSION;
+    p[5] = (char)st->parts;
+    p[7] = (char)st->host_len;
+    memset(p + HB_HEADER_SIZE, 0, (st->host_len + 3) & ~3U);
+    memcpy(p + HB_HEADER_SIZE, st->host, st->host_len);
+    st->dgram_len[st->parts] = HB_HEADER_SIZE + ((st->host_len + 3) & ~3U);
+    st->records[st->parts] = 0;
+    st->parts++;
+}
+
+/* room for record of 'len' data bytes, 0 if heartbeat is full */
+char* hb_record(struct hb_state *st, enum hb_record type, unsigned int len) {
+    char *p;
+    unsigned int i = st->parts - 1;
+    len += 4;
+    if (st->dgram_len[i] + len > HB_DGRAM_MAX) {
+        if (HB_PARTS_MAX == st->parts)
+            return 0;
+        hb_part_start(st);
+        i++;
+    }
+    p = st->dgram[i] + st->dgram_len[i];
+    memset(p, 0, len);
+    p[0] = (char)type;
+    hb_put16(p + 2, len);
+    st->dgram_len[i] += len;
+    st->records[i]++;
+    return p + 4;
+}
+
+#if defined(__linux__)
+/* /proc/stat "cpu" line: busy and total jiffies of the host */
+int proc_read_cpu(int fd, unsigned long long *busy, unsigned long long *total) {
+    char text[256];
+    unsigned long long v[8];
+    int n;
+    if (0 >= (n = pread(fd, text, sizeof(text) - 1, 0)))
+        return -1;
+    text[n] = '\0';
+    memset(v, 0, sizeof(v));
+    /* user nice system idle iowait irq softirq steal */
+    if (4 > sscanf(text, "cpu %llu %llu %llu %llu %llu %llu %llu %llu",
+            v, v + 1, v + 2, v + 3, v + 4, v + 5, v + 6, v + 7))
+        return -1;
+    *busy = v[0] + v[1] + v[2] + v[5] + v[6] + v[7];
+    *total = *busy + v[3] + v[4];
+    return 0;
+}
+
+/* /proc/net/dev counters into st->cur */
+void hb_read_net_dev(struct hb_state *st) {
+    char *line, *colon, *name;
+    int n;
+    st->cur_nr = 0;
+    if (0 > st->net_dev_fd ||
+        0 >= (n = pread(st->net_dev_fd, st->proc_buf, HB_PROC_BUF_SIZE - 1, 0)))
+        return;
+    st->proc_buf[n] = '\0';
+    /* two header lines, then "name: rx bytes packets ... tx bytes packets" */
+    line = strchr(st->proc_buf, '\n');
+    line = line ? strchr(line + 1, '\n') : 0;
+    while (line && st->cur_nr < HB_IFACES_MAX) {
+        line++;
+        if (!(colon = strchr(line, ':')))
+            break;
+        *colon = '\0';
+        for (name = line; ' ' == *name; name++)
+            ;
+        hb_put_name(st->cur[st->cur_nr].name, name, HB_NAME_LEN - 1);
+        if (4 == sscanf(colon + 1, "%llu %llu %*u %*u %*u %*u %*u %*u %llu %llu",
+                &st->cur[st->cur_nr].rx_bytes, &st->cur[st->cur_nr].rx_packets,
+                &st->cur[st->cur_nr].tx_bytes, &st->cur[st->cur_nr].tx_packets))
+            st->cur_nr++;
+        line = strchr(colon + 1, '\n');
+    }
+}
+#endif
+
+/* per second rate of counter, 0 for new interface or wrapped counter */
+unsigned long long hb_rate(unsigned long long cur, unsigned long long prev,
+                           int known, unsigned long long ns) {
+    if (!known || cur < prev || !ns)
+        return 0;
+    return (cur - prev) * NANOSEC_PER_SEC / ns;
+}
+
+/* build one heartbeat, returns number of datagrams */
+unsigned int hb_build(struct hb_state *st) {
+    struct timespec ts;
+    unsigned long long now = clock_ns(), ns = st->prev_ns ? now - st->prev_ns : 0;
+    unsigned int i;
+    int j, k;
+    double load[3] = {0, 0, 0};
+    struct gen_stats *gs;
+    unsigned long int running = 0, total = 0;
+    char *r;
+#if defined(__linux__)
+    char text[128];
+    int n, known;
+    struct rx_flow *fl;
+    unsigned long long busy, cpu_total;
+#endif
+    st->parts = 0;
+    st->seq++;
+    hb_part_start(st);
+    if ((r = hb_record(st, HB_REC_OS, 8)))
+        hb_put_name(r, os_name, 8);
+#if defined(__linux__)
+    if (0 <= st->loadavg_fd && 0 < (n = pread(st->loadavg_fd, text, sizeof(text) - 1, 0))) {
+        text[n] = '\0';
+        sscanf(text, "%lf %lf %lf %lu/%lu", load, load + 1, load + 2, &running, &total);
+    }
+#else
+    if (3 != getloadavg(load, 3))
+        load[0] = load[1] = load[2] = 0;
+#endif
+    if ((r = hb_record(st, HB_REC_LOAD, 20))) {
+        for (j = 0; j < 3; j++)
+            hb_put32(r + 4 * j, (unsigned long int)(load[j] * 100 + 0.5));
+        hb_put32(r + 12, running);
+        hb_put32(r + 16, total);
+    }
+#if defined(__linux__)
+    /* host CPU since previous heartbeat: first one has nothing to compare */
+    if (0 <= st->stat_fd && 0 == proc_read_cpu(st->stat_fd, &busy, &cpu_total)) {
+        if (st->cpu_total && cpu_total > st->cpu_total && (r = hb_record(st, HB_REC_HOST, 8))) {
+            hb_put32(r, (unsigned long int)((busy - st->cpu_busy) * 10000 / (cpu_total - st->cpu_total)));
+            hb_put32(r + 4, (unsigned long int)sysconf(_SC_NPROCESSORS_ONLN));
+        }
+        st->cpu_busy = busy;
+        st->cpu_total = cpu_total;
+    }
+    hb_read_net_dev(st);
+    for (j = 0; j < st->cur_nr; j++) {
+        /* interfaces rarely come and go: look at the same index first */
+        k = j;
+        if (k >= st->prev_nr || strcmp(st->prev[k].name, st->cur[j].name))
+            for (k = 0; k < st->prev_nr && strcmp(st->prev[k].name, st->cur[j].name); k++)
+                ;
+        known = k < st->prev_nr;
+        if (!(r = hb_record(st, HB_REC_IFACE, HB_NAME_LEN + 48)))
+            break;
+        memcpy(r, st->cur[j].name, HB_NAME_LEN);
+        r += HB_NAME_LEN;
+        hb_put64(r, hb_rate(st->cur[j].rx_bytes, known ? st->prev[k].rx_bytes : 0, known, ns));
+        hb_put64(r + 8, hb_rate(st->cur[j].tx_bytes, known ? st->prev[k].tx_bytes : 0, known, ns));
+        hb_put64(r + 16, hb_rate(st->cur[j].rx_packets, known ? st->prev[k].rx_packets : 0, known, ns));
+        hb_put64(r + 24, hb_rate(st->cur[j].tx_packets, known ? st->prev[k].tx_packets : 0, known, ns));
+        hb_put64(r + 32, st->cur[j].rx_bytes);
+        hb_put64(r + 40, st->cur[j].tx_bytes);
+    }
+    memcpy(st->prev, st->cur, st->cur_nr * sizeof(struct hb_iface));
+    st->prev_nr = st->cur_nr;
+#endif
+    for (j = 0; j < cpu_loaders_nr && (r = hb_record(st, HB_REC_CPU, 24)); j++) {
+        hb_put_name(r, cpu_loaders[j].kernel->name, 12);
+        hb_put64(r + 12, cpu_loaders[j].ops_per_sec);
+        hb_put32(r + 20, (unsigned long int)(cpu_loaders[j].achieved * 100 + 0.5));
+    }
+    for (j = 0; j < mem_loaders_nr && (r = hb_record(st, HB_REC_MEM, 20)); j++) {
+        hb_put_name(r, mem_mode_names[mem_loaders[j].mode], 8);
+        hb_put64(r + 8, mem_loaders[j].per_sec);
+        hb_put32(r + 16, (unsigned long int)(mem_loaders[j].latency_ns * 10 + 0.5));
+    }
+    for (j = 0; j < disk_loaders_nr && (r = hb_record(st, HB_REC_DISK, 64)); j++) {
+        hb_put_name(r, disk_loaders[j].path, 32);
+        hb_put64(r + 32, disk_loaders[j].iops);
+        hb_put64(r + 40, disk_loaders[j].read_per_sec);
+        hb_put64(r + 48, disk_loaders[j].write_per_sec);
+        hb_put64(r + 56, disk_loaders[j].errors);
+    }
+    for (j = 0; j < placed_nr && (r = hb_record(st, HB_REC_PLACE, PLACE_DESCR_LEN)); j++)
+        hb_put_name(r, placed[j], PLACE_DESCR_LEN - 1);
+    for (j = 0; j < gen_stats_count() && (r = hb_record(st, HB_REC_GEN, 12 + 8 * (9 + SEND_ERRORS))); j++) {
+        gs = gen_stats_at(j);
+        hb_put_name(r, gs->name, 12);
+        hb_put64(r + 12, gs->packets);
+        hb_put64(r + 20, gs->bytes);
+        hb_put64(r + 28, gs->iterations);
+        hb_put64(r + 36, gs->late_nr ? gs->late_sum / gs->late_nr : 0);
+        hb_put64(r + 44, gs->late_max);
+        hb_put64(r + 52, jitter_percentile(gs, 500));
+        hb_put64(r + 60, jitter_percentile(gs, 990));
+        hb_put64(r + 68, jitter_percentile(gs, 999));
+        hb_put64(r + 76, jitter_percentile(gs, 1000));
+        for (k = 0; k < SEND_ERRORS; k++)
+            hb_put64(r + 84 + 8 * k, gs->errors[k]);
+    }
+#if defined(__linux__)
+    for (j = 0; j < rx_receivers_nr * RX_FLOWS_MAX; j++) {
+        if (!(fl = rx_flow_at(j)))
+            continue;
+        if (!(r = hb_record(st, HB_REC_FLOW, 84)))
+            break;
+        hb_put32(r, rx_flow_ipv4(fl));
+        hb_put16(r + 4, fl->port);
+        hb_put32(r + 8, fl->id);
+        hb_put64(r + 12, fl->packets);
+        hb_put64(r + 20, fl->bytes);
+        hb_put64(r + 28, rx_flow_rate(fl));
+        hb_put64(r + 36, rx_flow_lost(fl));
+        hb_put64(r + 44, fl->reordered);
+        hb_put64(r + 52, hist_percentile(fl->latency, 500));
+        hb_put64(r + 60, hist_percentile(fl->latency, 990));
+        hb_put64(r + 68, hist_percentile(fl->latency, 999));
+        hb_put64(r + 76, hist_percentile(fl->latency, 1000));
+    }
+    for (j = 0; j < rpc_loaders_nr && (r = hb_record(st, HB_REC_RPC, 68)); j++) {
+        hb_put_name(r, rpc_loaders[j].stats->name, 12);
+        hb_put64(r + 12, rpc_loaders[j].stats->packets);
+        hb_put64(r + 20, rpc_loaders[j].answered);
+        hb_put64(r + 28, rpc_loaders[j].timeouts);
+        hb_put64(r + 36, hist_percentile(rpc_loaders[j].latency, 500));
+        hb_put64(r + 44, hist_percentile(rpc_loaders[j].latency, 990));
+        hb_put64(r + 52, hist_percentile(rpc_loaders[j].latency, 999));
+        hb_put64(r + 60, hist_percentile(rpc_loaders[j].latency, 1000));
+    }
+#endif
+    if (phase_sync.period && (r = hb_record(st, HB_REC_SYNC, 48))) {
+        hb_put64(r, phase_sync.period);
+        hb_put64(r + 8, phase_sync.offset);
+        hb_put64(r + 16, phase_sync.switches);
+        hb_put64(r + 24, phase_sync.error_last);
+        hb_put64(r + 32, phase_sync.switches ? phase_sync.error_sum / phase_sync.switches : 0);
+        hb_put64(r + 40, phase_sync.error_max);
+    }
+    /* now all parts are known: fill the rest of headers */
+    clock_gettime(CLOCK_REALTIME, &ts);
+    for (i = 0; i < st->parts; i++) {
+        st->dgram[i][6] = (char)st->parts;
+        hb_put32(st->dgram[i] + 8, st->seq);
+        hb_put32(st->dgram[i] + 12, (unsigned long int)(ns / 1000000));
+        hb_put64(st->dgram[i] + 16, (unsigned long long)ts.tv_sec * NANOSEC_PER_SEC + ts.tv_nsec);
+        hb_put32(st->dgram[i] + 24, st->ip);
+        hb_put16(st->dgram[i] + 28, st->records[i]);
+    }
+    st->prev_ns = now;
+    return st->parts;
+}
+
+/* heartbeat state and socket connected to master host (or broadcast); 0 on error */
+struct hb_state* hb_open(struct udp_ping_info *info, int *sock_ret) {
+    const int set_on = 1;
+    struct hb_state *st;
+    struct sockaddr_storage sa;
+    socklen_t sa_len;
+    unsigned int i;
+    int sock;
+    if (!(st = (struct hb_state*)calloc(1, sizeof(struct hb_state))))
+        return 0;
+    if (0 == info->host) {
+        memset(&sa, 0, sizeof(sa));
+        sa.ss_family = AF_INET;
+        ((struct sockaddr_in*)&sa)->sin_port = htons(info->port);
+        ((struct sockaddr_in*)&sa)->sin_addr.s_addr = INADDR_BROADCAST;
+        sa_len = sizeof(struct sockaddr_in);
+    }
+    else if (!(sa_len = resolve_addr(info->host, info->port, &sa))) {
+        log("ERROR: Invalid host %s\n", info->host);
+        free(st);
+        return 0;
+    }
+    if (0 > (sock = socket(sa.ss_family, SOCK_DGRAM, 0))) {
+        log("ERROR: create socket");
+        free(st);
+        return 0;
+    }
+    if (0 == info->host)
+        setsockopt(sock, SOL_SOCKET, SO_BROADCAST, &set_on, sizeof(set_on));
+    /* connected socket: kernel picks source address once, we report it
+     * (records carry IPv4 only) */
+    if (0 > connect(sock, (struct sockaddr*)&sa, sa_len))
+        log("heartbeat connect() Error #%d: %s", errno, strerror(errno));
+    memset(&sa, 0, sizeof(sa));
+    sa_len = sizeof(sa);
+    if (0 == getsockname(sock, (struct sockaddr*)&sa, &sa_len) && AF_INET == sa.ss_family)
+        st->ip = ntohl(((struct sockaddr_in*)&sa)->sin_addr.s_addr);
+    if (gethostname(st->host, sizeof(st->host) - 1))
+        strcpy(st->host, "?");
+    st->host_len = strlen(st->host);
+    if (st->host_len > 255)
+        st->host_len = 255;
+    st->proc_buf = (char*)malloc(HB_PROC_BUF_SIZE);
+    st->dgram[0] = (char*)malloc(HB_PARTS_MAX * HB_DGRAM_MAX);
+    for (i = 1; i < HB_PARTS_MAX; i++)
+        st->dgram[i] = st->dgram[0] + i * HB_DGRAM_MAX;
+#if defined(__linux__)
+    st->loadavg_fd = open("/proc/loadavg", O_RDONLY);
+    st->net_dev_fd = open("/proc/net/dev", O_RDONLY);
+    st->stat_fd = open("/proc/stat", O_RDONLY);
+#endif
+    *sock_ret = sock;
+    return st;
+}
+
+/* build and send one heartbeat */
+void hb_send(struct hb_state *st, int sock) {
+    unsigned int i, parts;
+    parts = hb_build(st);
+    for (i = 0; i < parts; i++) {
+        if (0 > send(sock, st->dgram[i], st->dgram_len[i], 0))
+            log("heartbeat send() Error #%d: %s", errno, strerror(errno));
+    }
+}
+
+/* THREAD PROCEDURE FOR BINARY HEARTBEATS */
+void* hb_sender(void *thread_arg) {
+    struct udp_ping_info *info = (struct udp_ping_info*)thread_arg;
+    struct hb_state *st;
+    unsigned long long deadline;
+    int sock;
+    if (!(st = hb_open(info, &sock)))
+        return 0;
+    deadline = clock_ns();
+    while (1) {
+        hb_send(st, sock);
+        deadline += (unsigned long long)info->delay * 1000;
+        sleep_until_ns(deadline);
+    }
+    return 0;
+}
+
+/* MEMORY ARENA: pre-faulted, optionally on hugepages and NUMA node */
+char* arena_alloc(unsigned long int size, unsigned short huge, int node, unsigned short lock) {
+    char *arena = MAP_FAILED;
+    long page = sysconf(_SC_PAGESIZE);
+    unsigned long int i;
+#if defined(__linux__)
+    unsigned long int nodemask[4];
+    if (huge) {
+        /* explicit hugepages first (needs vm.nr_hugepages) */
+        arena = (char*)mmap(0, size, PROT_READ|PROT_WRITE,
+            MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+    }
+#endif
+    if (MAP_FAILED == arena) {
+        arena = (char*)mmap(0, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+        if (MAP_FAILED == arena)
+            return 0;
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+        /* otherwise transparent hugepages */
+        if (huge)
+            (void)madvise(arena, size, MADV_HUGEPAGE);
+#endif
+    }
+#if defined(__linux__)
+    /* bind before first touch: pages are allocated on fault */
+    if (0 <= node && node < (int)(8 * sizeof(nodemask))) {
+        memset(nodemask, 0, sizeof(nodemask));
+        nodemask[node / (8 * sizeof(unsigned long int))] |= 1UL << (node % (8 * sizeof(unsigned long int)));
+        if (0 > syscall(SYS_mbind, arena, size, MPOL_BIND, nodemask, 8 * sizeof(nodemask), 0))
+            log("mbind() node %d Error #%d: %s", node, errno, strerror(errno));
+    }
+#endif
+    if (page <= 0)
+        page = PAGE_SIZE_DEFAULT;
+    for (i = 0; i < size; i += page)
+        arena[i] = 1;
+    if (lock && 0 > mlock(arena, size))
+        log("mlock() Error #%d: %s", errno, strerror(errno));
+    return arena;
+}
+
+/* THREAD PROCEDURE FOR MEMORY LOAD */
+
+#if defined(__linux__)
+/* "0-3,6" (':' is accepted as well, for getsubopt) => set; returns CPU count */
+int str2cpuset(char *str, cpu_set_t *set) {
+    char *end;
+    long first, last;
+    CPU_ZERO(set);
+    while (*str) {
+        first = last = strtol(str, &end, 10);
+        if (end == str || first < 0)
+            return -1;
+        if ('-' == *end) {
+            str = end + 1;
+            last = strtol(str, &end, 10);
+            if (end == str || last < first)
+                return -1;
+        }
+        if (last >= CPU_SETSIZE)
+            return -1;
+        for (; first <= last; first++)
+            CPU_SET(first, set);
+        if (*end && ',' != *end && ':' != *end)
+            return -1;
+        str = *end ? end + 1 : end;
+    }
+    return CPU_COUNT(set);
+}
+
+/* set => "0-3,6" */
+void cpuset2str(cpu_set_t *set, char *str, int len) {
+    int cpu, last, used = 0;
+    str[0] = '\0';
+    for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, set))
+            continue;
+        for (last = cpu; last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, set); last++)
+            ;
+        used = stats_append(str, used, len, (last > cpu) ? "%s%d-%d" : "%s%d",
+            used ? "," : "", cpu, last);
+        cpu = last;
+    }
+}
+
+/* first number in sysfs file, -1 if there is no such file */
+int sysfs_read_int(const char *path) {
+    char value[32];
+    int fd, n;
+    if (0 > (fd = open(path, O_RDONLY)))
+        return -1;
+    n = read(fd, value, sizeof(value) - 1);
+    close(fd);
+    if (n <= 0)
+        return -1;
+    value[n] = '\0';
+    return atoi(value);
+}
+
+/* NUMA node the interface (its PCI device) is attached to, -1 if unknown */
+int if_numa_node(const char *if_name) {
+    char path[128];
+    snprintf(path, sizeof(path), "/sys/class/net/%s/device/numa_node", if_name);
+    return sysfs_read_int(path);
+}
+
+/* core_id, physical_package_id of CPU */
+int cpu_topology(int cpu, const char *what) {
+    char path[128];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/%s", cpu, what);
+    return sysfs_read_int(path);
+}
+
+int place_add(struct placement *pl, cpu_set_t *set, int node) {
+    if (PLACE_SETS_MAX == pl->nr || !CPU_COUNT(set))
+        return 0;
+    memcpy(pl->sets + pl->nr, set, sizeof(cpu_set_t));
+    pl->set_node[pl->nr++] = node;
+    return 1;
+}
+
+/* build CPU sets for 'mode' out of 'allowed' CPUs (from topology in sysfs) */
+void place_setup(struct placement *pl, cpu_set_t *allowed) {
+    cpu_set_t one, seen;
+    char path[128], list[1024];
+    int cpu, core, pkg, node, fd, n, other;
+    pl->nr = pl->next = 0;
+    if (PLACE_NODE == pl->mode) {
+        for (node = 0; node < PLACE_NODES_MAX; node++) {
+            snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+            if (0 > (fd = open(path, O_RDONLY)))
+                continue;
+            n = read(fd, list, sizeof(list) - 1);
+            close(fd);
+            list[n > 0 ? n : 0] = '\0';
+            if (n > 0 && '\n' == list[n - 1])
+                list[n - 1] = '\0';
+            if (0 >= str2cpuset(list, &one))
+                continue;
+            CPU_AND(&one, &one, allowed);
+            place_add(pl, &one, node);
+        }
+    }
+    if (PLACE_CORE == pl->mode) {
+        /* first hardware thread of every physical core */
+        CPU_ZERO(&seen);
+        for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (!CPU_ISSET(cpu, allowed) || CPU_ISSET(cpu, &seen))
+                continue;
+            core = cpu_topology(cpu, "core_id");
+            pkg = cpu_topology(cpu, "physical_package_id");
+            for (other = cpu; other < CPU_SETSIZE; other++) {
+                if (CPU_ISSET(other, allowed) && core == cpu_topology(other, "core_id") &&
+                        pkg == cpu_topology(other, "physical_package_id"))
+                    CPU_SET(other, &seen);
+            }
+            CPU_ZERO(&one);
+            CPU_SET(cpu, &one);
+            place_add(pl, &one, -1);
+        }
+    }
+    /* explicit list, or topology is not available */
+    if (!pl->nr) {
+        for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (!CPU_ISSET(cpu, allowed))
+                continue;
+            CPU_ZERO(&one);
+            CPU_SET(cpu, &one);
+            place_add(pl, &one, -1);
+        }
+    }
+}
+
+/* allocations of calling thread preferably come from 'node' */
+void numa_prefer(int node) {
+    unsigned long int nodemask[4];
+    if (0 > node || node >= (int)(8 * sizeof(nodemask)))
+        return;
+    memset(nodemask, 0, sizeof(nodemask));
+    nodemask[node / (8 * sizeof(unsigned long int))] |= 1UL << (node % (8 * sizeof(unsigned long int)));
+    if (0 > syscall(SYS_set_mempolicy, MPOL_PREFERRED, nodemask, 8 * sizeof(nodemask)))
+        log("set_mempolicy() node %d Error #%d: %s", node, errno, strerror(errno));
+}
+#endif
+
+/*
+ * Start load thread 'name' placed as -P says: CPU set taken round-robin
+ * (senders keep to NIC node), scheduling policy. Placement is logged
+ * and kept for heartbeat. Policy not permitted => inherited one.
+ */
+int place_create(pthread_t *thread, void* (*proc)(void*), void *arg, const char *name, int net) {
+    char cpus[PLACE_DESCR_LEN / 2] = "any", *policy = "inherit";
+    int rc;
+#if defined(__linux__)
+    pthread_attr_t attr;
+    struct sched_param param;
+    cpu_set_t *set = 0;
+    int i;
+    pthread_attr_init(&attr);
+    if (PLACE_NONE != place.mode && place.nr) {
+        if (net && PLACE_NODE == place.mode && 0 <= place.net_node) {
+            for (i = 0; i < place.nr && !set; i++)
+                if (place.set_node[i] == place.net_node)
+                    set = place.sets + i;
+        }
+        if (!set)
+            set = place.sets + place.next++ % place.nr;
+        pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), set);
+        cpuset2str(set, cpus, sizeof(cpus));
+    }
+    rc = pthread_create(thread, &attr, proc, arg);
+    pthread_attr_destroy(&attr);
+    /* attributes know nothing of batch/idle: set policy on running thread */
+    if (!rc && 0 <= place.policy) {
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = place.prio;
+        policy = (SCHED_FIFO == place.policy) ? "fifo" : (SCHED_RR == place.policy) ? "rr"
+            : (SCHED_BATCH == place.policy) ? "batch" : (SCHED_IDLE == place.policy) ? "idle" : "other";
+        if (pthread_setschedparam(*thread, place.policy, &param)) {
+            log("%s: policy %s not permitted, using inherited", name, policy);
+            policy = "inherit";
+        }
+    }
+#else
+    rc = pthread_create(thread, 0, proc, arg);
+#endif
+    log("Placement %s: cpus %s policy %s", name, cpus, policy);
+    if (placed)
+        snprintf(placed[placed_nr++], PLACE_DESCR_LEN, "%s %s %s", name, cpus, policy);
+    return rc;
+}
+
+/*
+ * hold:  keep the arena resident, nothing else
+ * read, write, copy: STREAM-like sweeps, paced to the target rate
+ *        (copy counts both read and written bytes, as STREAM does)
+ * chase: dependent loads through random cyclic list of cache lines,
+ *        i.e. pure latency load
+ */
+void* memloader(void *thread_arg) {
+    struct mem_load_info *info = (struct mem_load_info *)thread_arg;
+    struct schedule *sch = &(info->phases);
+    struct pacer pacer;
+    unsigned long int its_time = 0, pos = 0, half, lines, i;
+    unsigned long long sum = 0, moved = 0, rate_start, now;
+    unsigned int seen, seed = (unsigned int)time(0) ^ (unsigned int)(unsigned long)&pos;
+    void **p;
+    char *arena;
+    arena = arena_alloc(info->size, info->huge, info->node, info->lock);
+    if (!arena) {
+        log("ERROR: can not allocate %lu bytes of memory", info->size);
+        return 0;
+    }
+    log("Memory arena %lu bytes, mode %s", info->size, mem_mode_names[info->mode]);
+    half = info->size / 2;
+    lines = info->size / CACHE_LINE;
+    p = (void**)arena;
+    if (MEM_CHASE == info->mode && 0 > chase_init(arena, lines, &seed)) {
+        log("ERROR: can not allocate chase index");
+        munmap(arena, info->size);
+        return 0;
+    }
+    pacer_init(&pacer, LOAD_MEM, info->rate, MEM_CHUNK, 0);
+    rate_start = clock_ns();
+    /* eternal loop */
+    while (1) {
+        ctl_hold(LOAD_MEM);
+        seen = control.gen[LOAD_MEM];
+        if (sch->sleep) {
+            its_time = time(0) + sch->active;
+        }
+        pacer_init(&pacer, LOAD_MEM, info->rate, MEM_CHUNK, 0);
+        /* active phase */
+        while (sch->sleep ? (time(0) < its_time) : 1) {
+            if (seen != control.gen[LOAD_MEM])
+                break;
+            if (MEM_HOLD == info->mode) {
+                ctl_sleep(LOAD_MEM, sch->sleep ? 1 : 60);
+                continue;
+            }
+            if (info->rate && MEM_CHASE != info->mode)
+                pacer_wait(&pacer, MEM_CHUNK, 1);
+            switch (info->mode) {
+            case MEM_READ:
+                for (i = 0; i < MEM_CHUNK / sizeof(unsigned long long); i++)
+                    sum += ((unsigned long long*)(arena + pos))[i];
+                moved += MEM_CHUNK;
+                pos = (pos + MEM_CHUNK) % (info->size - info->size % MEM_CHUNK);
+                break;
+            case MEM_WRITE:
+                for (i = 0; i < MEM_CHUNK / sizeof(unsigned long long); i++)
+                    ((unsigned long long*)(arena + pos))[i] = i;
+                moved += MEM_CHUNK;
+                pos = (pos + MEM_CHUNK) % (info->size - info->size % MEM_CHUNK);
+                break;
+            case MEM_COPY:
+                memcpy(arena + half + pos, arena + pos, MEM_CHUNK / 2);
+                moved += MEM_CHUNK;
+                pos = (pos + MEM_CHUNK / 2) % (half - half % (MEM_CHUNK / 2));
+                break;
+            default:
+                for (i = 0; i < MEM_CHUNK / CACHE_LINE; i++)
+                    p = (void**)*p;
+                moved += MEM_CHUNK / CACHE_LINE;
+                break;
+            }
+            /* results must stay observable or loops are optimized away */
+            mem_sink = sum + (unsigned long long)p;
+            now = clock_ns();
+            if (now - rate_start >= NANOSEC_PER_SEC) {
+                info->per_sec = (unsigned long int)((double)moved * NANOSEC_PER_SEC / (now - rate_start));
+                if (MEM_CHASE == info->mode && moved)
+                    info->latency_ns = (double)(now - rate_start) / moved;
+                moved = 0;
+                rate_start = now;
+            }
+        }
+        /* sleep phase */
+        if (seen == control.gen[LOAD_MEM] && sch->sleep) {
+            ctl_sleep(LOAD_MEM, sch->sleep);
+        }
+        rate_start = clock_ns();
+        moved = 0;
+    }
+    munmap(arena, info->size);
+}
+
+#if defined(DISK_IO_URING)
+/* IO_URING: just enough of liburing to keep a queue full */
+struct uring {
+    int fd;
+    unsigned int *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned int *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    char *sq_ptr, *cq_ptr;
+    size_t sq_size, cq_size, sqes_size;
+};
+
+int uring_init(struct uring *r, unsigned int entries) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    memset(r, 0, sizeof(struct uring));
+    r->sq_ptr = r->cq_ptr = MAP_FAILED;
+    r->sqes = MAP_FAILED;
+    r->fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+    if (0 > r->fd)
+        return -1;
+    r->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+    r->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+        r->sq_size = r->cq_size = max(r->sq_size, r->cq_size);
+    r->sq_ptr = (char*)mmap(0, r->sq_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+        r->fd, IORING_OFF_SQ_RING);
+    if (MAP_FAILED == r->sq_ptr)
+        return -1;
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        r->cq_ptr = r->sq_ptr;
+    }
+    else {
+        r->cq_ptr = (char*)mmap(0, r->cq_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+            r->fd, IORING_OFF_CQ_RING);
+        if (MAP_FAILED == r->cq_ptr)
+            return -1;
+    }
+    r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = (struct io_uring_sqe*)mmap(0, r->sqes_size, PROT_READ|PROT_WRITE,
+        MAP_SHARED|MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (MAP_FAILED == r->sqes)
+        return -1;
+    r->sq_head = (unsigned int*)(r->sq_ptr + p.sq_off.head);
+    r->sq_tail = (unsigned int*)(r->sq_ptr + p.sq_off.tail);
+    r->sq_mask = (unsigned int*)(r->sq_ptr + p.sq_off.ring_mask);
+    r->sq_array = (unsigned int*)(r->sq_ptr + p.sq_off.array);
+    r->cq_head = (unsigned int*)(r->cq_ptr + p.cq_off.head);
+    r->cq_tail = (unsigned int*)(r->cq_ptr + p.cq_off.tail);
+    r->cq_mask = (unsigned int*)(r->cq_ptr + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe*)(r->cq_ptr + p.cq_off.cqes);
+    return 0;
+}
+
+void uring_free(struct uring *r) {
+    if (MAP_FAILED != r->sqes)
+        munmap(r->sqes, r->sqes_size);
+    if (MAP_FAILED != r->cq_ptr && r->cq_ptr != r->sq_ptr)
+        munmap(r->cq_ptr, r->cq_size);
+    if (MAP_FAILED != r->sq_ptr)
+        munmap(r->sq_ptr, r->sq_size);
+    if (0 <= r->fd)
+        close(r->fd);
+}
+
+/* queue fixed-buffer read or write; kernel sees it on uring_enter() */
+void uring_queue(struct uring *r, int fd, unsigned short write, char *buf,
+                unsigned int len, unsigned long int offset, unsigned int buf_index) {
+    unsigned int tail = *r->sq_tail, idx = tail & *r->sq_mask;
+    struct io_uring_sqe *sqe = r->sqes + idx;
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    sqe->opcode = write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+    sqe->fd = fd;
+    sqe->addr = (unsigned long)buf;
+    sqe->len = len;
+    sqe->off = offset;
+    sqe->buf_index = buf_index;
+    sqe->user_data = buf_index;
+    r->sq_array[idx] = idx;
+    __atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+int uring_enter(struct uring *r, unsigned int submit, unsigned int wait) {
+    return (int)syscall(__NR_io_uring_enter, r->fd, submit, wait,
+        wait ? IORING_ENTER_GETEVENTS : 0, 0, 0);
+}
+
+/* pop one completion; returns 0 if none */
+int uring_reap(struct uring *r, unsigned long long *user_data, int *res) {
+    unsigned int head = *r->cq_head;
+    struct io_uring_cqe *cqe;
+    if (head == __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE))
+        return 0;
+    cqe = r->cqes + (head & *r->cq_mask);
+    *user_data = cqe->user_data;
+    *res = cqe->res;
+    __atomic_store_n(r->cq_head, head + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+#endif
+
+/* DISK LOAD HELPERS */
+/* open target, find out region size, lay out regular file if short */
+int disk_open(struct disk_load_info *info, char *block) {
+    struct stat st;
+    unsigned long long dev_size = 0;
+    unsigned long int pos;
+    int fd, flags;
+    flags = (100 == info->read_pct) ? O_RDONLY : O_RDWR;
+    if (0 == stat(info->path, &st) && S_ISBLK(st.st_mode)) {
+        if (100 != info->read_pct && !info->force) {
+            log("ERROR: refusing to write to block device %s without force", info->path);
+            return -1;
+        }
+    }
+    else if (100 != info->read_pct) {
+        /* regular file is laid out first; reads only: must exist */
+        flags = O_RDWR|O_CREAT;
+    }
+#if defined(O_DIRECT)
+    if (info->direct)
+        flags |= O_DIRECT;
+#endif
+    fd = open(info->path, flags, S_IRUSR|S_IWUSR);
+    if (0 > fd) {
+        log("ERROR: open %s #%d: %s", info->path, errno, strerror(errno));
+        return -1;
+    }
+    if (0 > fstat(fd, &st)) {
+        close(fd);
+        return -1;
+    }
+    if (S_ISBLK(st.st_mode)) {
+#if defined(BLKGETSIZE64)
+        (void)ioctl(fd, BLKGETSIZE64, &dev_size);
+#endif
+        if (!info->size || info->size > dev_size)
+            info->size = (unsigned long int)dev_size;
+    }
+    else {
+        if (!info->size)
+            info->size = (unsigned long int)st.st_size;
+        /* file opened read only is not laid out: its own size only */
+        if (100 == info->read_pct && info->size > (unsigned long int)st.st_size) {
+            log("Disk load %s: reads only, size cut to file size %lu",
+                info->path, (unsigned long int)st.st_size);
+            info->size = (unsigned long int)st.st_size;
+        }
+        /* read only target is never written: whole blocks of it only */
+        if (100 == info->read_pct)
+            info->size -= info->size % info->block;
+        /* reads of holes never reach the disk: write real data first */
+        for (pos = (unsigned long int)st.st_size - st.st_size % info->block;
+                100 != info->read_pct && pos < info->size; pos += info->block) {
+            if ((ssize_t)info->block != pwrite(fd, block, info->block, pos)) {
+                log("ERROR: laying out %s #%d: %s", info->path, errno, strerror(errno));
+                close(fd);
+                return -1;
+            }
+        }
+        if (100 != info->read_pct)
+            (void)fsync(fd);
+    }
+    info->size -= info->size % info->block;
+    if (info->size < info->block) {
+        log("ERROR: %s is smaller than one block", info->path);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* next offset and direction of I/O */
+unsigned long int disk_next(struct disk_load_info *info, unsigned long int *pos,
+                            unsigned int *seed, unsigned short *write) {
+    unsigned long int offset;
+    if (info->random) {
+        offset = ((((unsigned long int)rand_r(seed) << 31) ^ rand_r(seed))
+                    % (info->size / info->block)) * info->block;
+    }
+    else {
+        offset = *pos;
+        *pos = (*pos + info->block) % info->size;
+    }
+    *write = (unsigned short)((unsigned int)(rand_r(seed) % 100) >= info->read_pct);
+    return offset;
+}
+
+/* THREAD PROCEDURE FOR DISK LOAD */
+/*
+ * Keeps 'queue' I/Os in flight through io_uring with registered
+ * buffers; if io_uring is not available, falls back to synchronous
+ * pread()/pwrite() (queue depth 1). Paced by the same token bucket
+ * as network senders; obeys active/sleep phases.
+ */
+void* diskloader(void *thread_arg) {
+    struct disk_load_info *info = (struct disk_load_info *)thread_arg;
+    struct schedule *sch = &(info->phases);
+    struct pacer pacer;
+    unsigned long int its_time = 0, pos = 0, offset, ios = 0, rd = 0, wr = 0;
+    unsigned long long now, rate_start;
+    unsigned int i, seen, inflight = 0, queued = 0, seed = (unsigned int)time(0) ^ (unsigned int)(unsigned long)&pos;
+    unsigned short write;
+    char *bufs = 0;
+    int fd, res;
+#if defined(DISK_IO_URING)
+    struct uring ring;
+    struct iovec *iov;
+    unsigned long long slot;
+    unsigned short *slot_write, ring_set = 0;
+#endif
+    if (posix_memalign((void**)&bufs, DISK_ALIGN, (size_t)info->block * info->queue)) {
+        log("ERROR: can not allocate disk buffers");
+        return 0;
+    }
+    /* compressing/deduplicating devices see -f content too */
+    (void)payload_fill(bufs, (unsigned int)info->block * info->queue);
+    fd = disk_open(info, bufs);
+    if (0 > fd) {
+        free(bufs);
+        return 0;
+    }
+    log("Disk load %s: %lu bytes, block %lu, queue %u, %u%% reads, %s",
+        info->path, info->size, info->block, info->queue, info->read_pct,
+        info->random ? "random" : "sequential");
+    info->engine_uring = 0;
+#if defined(DISK_IO_URING)
+    iov = (struct iovec*)calloc(info->queue, sizeof(struct iovec));
+    slot_write = (unsigned short*)calloc(info->queue, sizeof(unsigned short));
+    if (iov && slot_write) {
+        /* uring_init() leaves even a failed ring safe to free */
+        ring_set = 1;
+        if (0 == uring_init(&ring, info->queue)) {
+            for (i = 0; i < info->queue; i++) {
+                iov[i].iov_base = bufs + (size_t)i * info->block;
+                iov[i].iov_len = info->block;
+            }
+            /* registered buffers: no page pinning per I/O */
+            if (0 == syscall(__NR_io_uring_register, ring.fd, IORING_REGISTER_BUFFERS,
+                    iov, info->queue))
+                info->engine_uring = 1;
+        }
+    }
+    if (!info->engine_uring) {
+        log("io_uring not available #%d: %s; using pread/pwrite", errno, strerror(errno));
+        if (ring_set)
+            uring_free(&ring);
+    }
+#endif
+    pacer_init(&pacer, LOAD_DISK, info->rate, info->block * info->queue, 0);
+    rate_start = clock_ns();
+    /* eternal loop */
+    while (1) {
+        ctl_hold(LOAD_DISK);
+        seen = control.gen[LOAD_DISK];
+        if (sch->sleep) {
+            its_time = time(0) + sch->active;
+        }
+        pacer_init(&pacer, LOAD_DISK, info->rate, info->block * info->queue, 0);
+        /* active phase */
+        while (sch->sleep ? (time(0) < its_time) : 1) {
+            if (seen != control.gen[LOAD_DISK])
+                break;
+#if defined(DISK_IO_URING)
+            if (info->engine_uring) {
+                /* top the queue up (at start and after sleep phase):
+                 * completed slots are requeued at once, so the busy
+                 * ones are always 0..inflight-1 */
+                for (i = inflight; i < info->queue; i++) {
+                    if (info->rate)
+                        pacer_wait(&pacer, info->block, 1);
+                    offset = disk_next(info, &pos, &seed, &write);
+                    slot_write[i] = write;
+                    uring_queue(&ring, fd, write, (char*)iov[i].iov_base,
+                        info->block, offset, i);
+                    queued++;
+                    inflight++;
+                }
+                /* submit what is queued, wait for at least one completion */
+                (void)uring_enter(&ring, queued, 1);
+                queued = 0;
+                while (uring_reap(&ring, &slot, &res)) {
+                    if (0 > res) {
+                        if (!info->errors)
+                            log("ERROR: disk I/O #%d: %s", -res, strerror(-res));
+                        info->errors++;
+                    }
+                    else if (slot_write[slot]) {
+                        wr += res;
+                    }
+                    else {
+                        rd += res;
+                    }
+                    ios++;
+                    /* reuse the slot right away: stays in flight */
+                    if (info->rate)
+                        pacer_wait(&pacer, info->block, 1);
+                    offset = disk_next(info, &pos, &seed, &write);
+                    slot_write[slot] = write;
+                    uring_queue(&ring, fd, write, (char*)iov[slot].iov_base,
+                        info->block, offset, (unsigned int)slot);
+                    queued++;
+                }
+            }
+            else
+#endif
+            {
+                if (info->rate)
+                    pacer_wait(&pacer, info->block, 1);
+                offset = disk_next(info, &pos, &seed, &write);
+                res = write ? (int)pwrite(fd, bufs, info->block, offset)
+                            : (int)pread(fd, bufs, info->block, offset);
+                if (0 > res) {
+                    if (!info->errors)
+                        log("ERROR: disk I/O #%d: %s", errno, strerror(errno));
+                    info->errors++;
+                }
+                else if (write) {
+                    wr += res;
+                }
+                else {
+                    rd += res;
+                }
+                ios++;
+            }
+            now = clock_ns();
+            if (now - rate_start >= NANOSEC_PER_SEC) {
+                info->iops = (unsigned long int)((double)ios * NANOSEC_PER_SEC / (now - rate_start));
+                info->read_per_sec = (unsigned long int)((double)rd * NANOSEC_PER_SEC / (now - rate_start));
+                info->write_per_sec = (unsigned long int)((double)wr * NANOSEC_PER_SEC / (now - rate_start));
+                ios = rd = wr = 0;
+                rate_start = now;
+            }
+        }
+        /* sleep phase (or pause, new parameters): nothing stays in flight */
+        if (sch->sleep || seen != control.gen[LOAD_DISK]) {
+#if defined(DISK_IO_URING)
+            /* requeued slots are dropped: never submitted */
+            if (info->engine_uring) {
+                *ring.sq_tail -= queued;
+                inflight -= queued;
+                queued = 0;
+            }
+            while (info->engine_uring && inflight) {
+                (void)uring_enter(&ring, 0, 1);
+                while (uring_reap(&ring, &slot, &res))
+                    inflight--;
+            }
+#endif
+            if (seen == control.gen[LOAD_DISK])
+                ctl_sleep(LOAD_DISK, sch->sleep);
+            ios = rd = wr = 0;
+            rate_start = clock_ns();
+        }
+    }
+#if defined(DISK_IO_URING)
+    if (info->engine_uring)
+        uring_free(&ring);
+    free(iov);
+    free(slot_write);
+#endif
+    close(fd);
+    free(bufs);
+}
+
+#if defined(__linux__)
+/*
+ * Datagrams of 'msg_size' per GSO super-buffer within kernel limits:
+ * segment fits path MTU, 64 segments, 64 KiB; zerocopy pins every
+ * piece (probe header, body pages) as a fragment of one buffer.
+ * Below 2 GSO is of no use, 'why' tells the limit.
+ */
+unsigned int udp_gso_segments(struct udp_ping_info *info, unsigned int msg_size, int zerocopy,
+                              const char **why) {
+    unsigned int segs;
+    *why = "buffer";
+    if (info->path_payload && msg_size > info->path_payload) {
+        *why = "path MTU";
+        return 1;
+    }
+    segs = UDP_GSO_BUFFER_MAX / msg_size;
+    if (segs > UDP_GSO_SEGMENTS_MAX)
+        segs = UDP_GSO_SEGMENTS_MAX;
+    if (zerocopy) {
+        /* header and body per datagram, a page boundary may split each */
+        if (info->stamp)
+            segs = min(segs, ZEROCOPY_FRAGS_MAX / (4 + (msg_size - PROBE_SIZE) / PAGE_SIZE_DEFAULT));
+        /* one payload split only by page boundaries */
+        else
+            segs = min(segs, (ZEROCOPY_FRAGS_MAX - 2) * PAGE_SIZE_DEFAULT / msg_size);
+        if (segs < 2)
+            *why = "zerocopy fragments";
+    }
+    return segs;
+}
+#endif
+
+/* THREAD PROCEDURE FOR SENDING UDP PACKETS */
+void* udp_sender (void *thread_arg) {
+    const int set_on = 1;
+    unsigned long int packet_size = 0, its_time = 0;
+    struct sockaddr_storage sa;
+    socklen_t sa_len;
+    struct send_batch batch;
+    struct pacer pacer;
+    int sock, gso_size;
+    unsigned int i, segs = 1, gso_set = 0;
+    const char *why;
+    unsigned long int pending = 0, done, sent, rate;
+    unsigned long long late, seq = 0;
+    unsigned int seen, msg_size = 0, delay, body, pool_nr;
+    char * payload, *pool = 0;
+    struct udp_ping_info* info = (struct udp_ping_info*)thread_arg;
+    struct gen_stats uncounted, *st = info->stats ? info->stats : &uncounted;
+#if defined(__linux__)
+    /* payload and socket buffers close to NIC */
+    numa_prefer(info->node);
+#endif
+    /* special treat for host name == 0 => SEND BROADCAST */
+    if (0 == info->host) {
+        memset(&sa, 0, sizeof(sa));
+        sa.ss_family = AF_INET;
+        ((struct sockaddr_in*)&sa)->sin_port = htons(info->port);
+        ((struct sockaddr_in*)&sa)->sin_addr.s_addr = INADDR_BROADCAST;
+        sa_len = sizeof(struct sockaddr_in);
+    }
+    /* resolved at start: next of host's addresses */
+    else if (!(sa_len = resolve_addr(info->host, info->port, &sa))) {
+        log("ERROR: Invalid host %s\n", info->host);
+        return 0;
+    }
+    sock = socket(sa.ss_family, SOCK_DGRAM, 0);
+    if (sock < 0) {
+        log("ERROR: create socket");
+        return 0;
+    }
+    if (AF_INET == sa.ss_family && INADDR_BROADCAST == ((struct sockaddr_in*)&sa)->sin_addr.s_addr) {
+        setsockopt(sock, SOL_SOCKET, SO_BROADCAST, &set_on, sizeof(set_on));
+    }
+#if defined(__linux__)
+    info->path_payload = udp_path_payload(&sa);
+#endif
+    memset(&uncounted, 0, sizeof(uncounted));
+    /* room for the largest message (or GSO super-buffer): size may change */
+    payload = (char*)malloc(max(UDP_GSO_BUFFER_MAX, UDP_PING_MSG_SIZE_MAX));
+    if (!payload || 0 > batch_init(&batch, sock, &sa, sa_len,
+                        payload, 0, 0, info->batch)) {
+        log("ERROR: allocate batch of %u", info->batch);
+        close(sock);
+        free(payload);
+        return 0;
+    }
+#if defined(__linux__)
+    if (info->zerocopy) {
+        if (0 > setsockopt(sock, SOL_SOCKET, SO_ZEROCOPY, &set_on, sizeof(set_on))) {
+            log("SO_ZEROCOPY not used #%d: %s", errno, strerror(errno));
+        }
+        else {
+            batch.flags |= MSG_ZEROCOPY;
+        }
+    }
+#endif
+    rate = info->rate;
+    delay = info->delay;
+    pacer_init(&pacer, LOAD_NET, rate, info->burst, delay);
+
+    /* eternal loop (benchmark ends it) */
+    while (!info->quit) {
+        /* heartbeat is never paused */
+        if (info->stats)
+            ctl_hold(LOAD_NET);
+        seen = control.gen[LOAD_NET];
+        /* (new) parameters */
+        if (msg_size != info->msg_size) {
+#if defined(__linux__)
+            /* kernel may still read payload and headers */
+            if (batch.flags & MSG_ZEROCOPY)
+                pending = zerocopy_drain(&batch, pending);
+#endif
+            msg_size = info->msg_size;
+            segs = 1;
+#if defined(__linux__)
+            /* GSO: every message is a super-buffer of 'segs' datagrams,
+             * msg_size each; kernel (or NIC) cuts it on the way out */
+            if (info->gso) {
+                segs = udp_gso_segments(info, msg_size, batch.flags & MSG_ZEROCOPY, &why);
+                gso_size = (segs < 2) ? 0 : msg_size;
+                if (segs < 2)
+                    log("UDP_SEGMENT not used for size %u (%s limit)", msg_size, why);
+                /* earlier size must not stay on the socket */
+                if ((gso_size || gso_set) &&
+                    0 > setsockopt(sock, SOL_UDP, UDP_SEGMENT, &gso_size, sizeof(gso_size))) {
+                    log("UDP_SEGMENT not used #%d: %s", errno, strerror(errno));
+                    gso_size = 0;
+                }
+                gso_set = gso_size;
+                if (!gso_size)
+                    segs = 1;
+            }
+#endif
+            if (info->stamp) {
+                /* bodies behind per datagram probe headers, generated once */
+                body = msg_size - PROBE_SIZE;
+                pool_nr = body ? min(content.pool, max(PAYLOAD_POOL_BYTES_MAX / body, 1)) : 1;
+                free(pool);
+                pool = (char*)malloc(pool_nr * body + 1);
+                for (i = 0; pool && i < pool_nr; i++)
+                    (void)(info->fill_buffer_procedure)(pool + i * body, body);
+                packet_size = msg_size * segs;
+                if (!pool || 0 > batch_stamp_init(&batch, info->flow_id, pool, body, pool_nr, segs,
+                                (batch.flags & MSG_ZEROCOPY) ? ZEROCOPY_PENDING_MAX / batch.depth + 1 : 1)) {
+                    log("ERROR: allocate probe headers and %u payloads", pool_nr);
+                    break;
+                }
+            }
+            else {
+                for (packet_size = 0, i = 0; i < segs; i++) {
+                    packet_size += (info->fill_buffer_procedure)(payload + packet_size, msg_size);
+                }
+                batch_set_len(&batch, packet_size);
+            }
+        }
+        if (info->phases.sleep || rate != info->rate || delay != info->delay) {
+            rate = info->rate;
+            delay = info->delay;
+            pacer_init(&pacer, LOAD_NET, rate, info->burst, delay);
+        }
+        if (info->phases.sleep) {
+            its_time = time(0) + info->phases.active;
+        }
+        while (info->phases.sleep ? (time(0) < its_time) : 1) {
+            late = pacer_wait(&pacer, packet_size * batch.depth, batch.depth * segs);
+            if (seen != control.gen[LOAD_NET])
+                break;
+            gen_stats_late(st, late);
+            /* fresh content (heartbeat stats) right before sending */
+            if (info->update_every_packet) {
+                packet_size = (info->fill_buffer_procedure)(payload, info->msg_size);
+                batch_set_len(&batch, packet_size);
+            }
+#if defined(__linux__)
+            /* headers of this set may still be on their way out */
+            while (batch_set_busy(&batch) && !info->quit) {
+                done = zerocopy_reap(&batch, 1);
+                pending -= min(pending, done);
+            }
+#endif
+            if (batch.stamps)
+                batch_stamp(&batch, &seq);
+            sent = batch_send(&batch);
+            if (sent < batch.depth) {
+                gen_stats_error(st, errno, batch.depth - sent);
+                /* unsent tail is not lost: its numbers are used again */
+                if (batch.stamps)
+                    seq -= (unsigned long long)(batch.depth - sent) * segs;
+            }
+            st->packets += sent * segs;
+            st->bytes += sent * packet_size;
+            pending += sent;
+#if defined(__linux__)
+            if (batch.flags & MSG_ZEROCOPY) {
+                batch_set_sent(&batch, sent);
+                done = zerocopy_reap(&batch, pending > ZEROCOPY_PENDING_MAX ? 1 : 0);
+                pending -= min(pending, done);
+            }
+#endif
+        }
+        if (seen == control.gen[LOAD_NET] && info->phases.sleep) {
+            ctl_sleep(LOAD_NET, info->phases.sleep);
+        }
+    }
+#if defined(__linux__)
+    if (batch.flags & MSG_ZEROCOPY)
+        (void)zerocopy_drain(&batch, pending);
+#endif
+    batch_free(&batch);
+    close(sock);
+    free(payload);
+    free(pool);
+    return 0;
+}
+
+#if defined(__linux__)
+/* TIMER WHEEL */
+void wheel_init(struct wheel *w, unsigned long long now) {
+    memset(w, 0, sizeof(struct wheel));
+    w->now = now;
+}
+
+/* first used slot from 'from' on, WHEEL_SIZE if none */
+unsigned int wheel_scan(unsigned long long *used, unsigned int from) {
+    unsigned long long bits;
+    unsigned int i;
+    for (i = from >> 6; i < WHEEL_SIZE / 64; i++) {
+        bits = used[i];
+        if (i == from >> 6)
+            bits &= ~0ULL << (from & 63);
+        if (bits)
+            return i * 64 + __builtin_ctzll(bits);
+    }
+    return WHEEL_SIZE;
+}
+
+/*
+ * Timer already expired goes off on the next run. One past the horizon
+ * is parked there, 't->expires' keeps the real deadline for the re-add.
+ */
+void wheel_add(struct wheel *w, struct wheel_timer *t) {
+    unsigned long long expires = t->expires, delta;
+    unsigned int l, i;
+    if (expires < w->now)
+        expires = w->now;
+    delta = expires - w->now;
+    if (delta >> (WHEEL_BITS * WHEEL_LEVELS)) {
+        delta = (1ULL << (WHEEL_BITS * WHEEL_LEVELS)) - 1;
+        expires = w->now + delta;
+    }
+    for (l = 0; l < WHEEL_LEVELS - 1 && (delta >> (WHEEL_BITS * (l + 1))); l++)
+        ;
+    i = (expires >> (WHEEL_BITS * l)) & WHEEL_MASK;
+    t->next = w->slot[l][i];
+    w->slot[l][i] = t;
+    w->used[l][i >> 6] |= 1ULL << (i & 63);
+}
+
+/* timers expired by 'tick' (inclusive) are prepended to '*due' */
+void wheel_run(struct wheel *w, unsigned long long tick, struct wheel_timer **due) {
+    struct wheel_timer *t, *list;
+    unsigned long long next;
+    unsigned int l, i;
+    while (w->now <= tick) {
+        /* level below wrapped around: slot of upper level comes down */
+        for (l = 1; l < WHEEL_LEVELS && !(w->now & ((1ULL << (WHEEL_BITS * l)) - 1)); l++) {
+            i = (w->now >> (WHEEL_BITS * l)) & WHEEL_MASK;
+            list = w->slot[l][i];
+            w->slot[l][i] = 0;
+            w->used[l][i >> 6] &= ~(1ULL << (i & 63));
+            while (list) {
+                t = list;
+                list = t->next;
+                wheel_add(w, t);
+            }
+        }
+        i = w->now & WHEEL_MASK;
+        if ((list = w->slot[0][i])) {
+            for (t = list; t->next; t = t->next)
+                ;
+            t->next = *due;
+            *due = list;
+            w->slot[0][i] = 0;
+            w->used[0][i >> 6] &= ~(1ULL << (i & 63));
+        }
+        /* empty slots are skipped up to the next wrap around */
+        next = (w->now & ~(unsigned long long)WHEEL_MASK) + wheel_scan(w->used[0], i + 1);
+        w->now = (next > tick + 1) ? tick + 1 : next;
+    }
+}
+
+/* tick to run the wheel at: next expiry or cascade; ~0 if empty */
+unsigned long long wheel_next(struct wheel *w) {
+    unsigned long long next = ~0ULL, base, at;
+    unsigned int l, i;
+    for (l = 0; l < WHEEL_LEVELS; l++) {
+        base = w->now >> (WHEEL_BITS * l);
+        i = base & WHEEL_MASK;
+        base -= i;
+        /* upper slot of 'now' came down already unless at its boundary */
+        if (l && (w->now & ((1ULL << (WHEEL_BITS * l)) - 1)))
+            i++;
+        if (WHEEL_SIZE == (i = wheel_scan(w->used[l], i))) {
+            if (WHEEL_SIZE == (i = wheel_scan(w->used[l], 0)))
+                continue;
+            base += WHEEL_SIZE;
+        }
+        at = (base + i) << (WHEEL_BITS * l);
+        if (at < next)
+            next = at;
+    }
+    return next;
+}
+
+/* SCHEDULER WORKER HELPERS */
+/* first send of destination 'k' of 'nr' is staggered over one interval */
+void sched_arm(struct wheel *w, struct sched_info *info, struct sched_dest *d,
+               unsigned int k, unsigned int nr, unsigned int msg_size, unsigned long long now) {
+    unsigned long long interval;
+    interval = info->rate ? (unsigned long long)msg_size * info->batch * NANOSEC_PER_SEC / info->rate
+                          : (unsigned long long)info->delay * 1000 * info->batch;
+    pacer_init(&d->pacer, LOAD_NET, info->rate, info->burst, info->delay);
+    d->pacer.next_ns = now + interval / nr * k;
+    d->timer.expires = (d->pacer.next_ns + (1 << WHEEL_TICK_SHIFT) - 1) >> WHEEL_TICK_SHIFT;
+    wheel_add(w, &d->timer);
+}
+
+/*
+ * Send queued datagrams. A datagram refused for its own destination
+ * (unreachable, not permitted) is counted and skipped, the rest go on;
+ * socket out of buffers: unsent tail gives its sequence numbers back.
+ */
+void sched_flush(struct sched_send *q, unsigned int msg_size, struct gen_stats *st) {
+    struct timespec ts;
+    unsigned long long now;
+    unsigned int i, sent = 0, failed = 0;
+    int rc;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    now = (unsigned long long)ts.tv_sec * NANOSEC_PER_SEC + ts.tv_nsec;
+    for (i = 0; i < q->n; i++)
+        hb_put64(q->stamps + i * PROBE_SIZE + 20, now);
+    while (sent < q->n) {
+        if (0 < (rc = sendmmsg(q->sock, q->msgs + sent, q->n - sent, 0))) {
+            sent += rc;
+            continue;
+        }
+        if (!rc || EAGAIN == errno || EWOULDBLOCK == errno || ENOBUFS == errno || ENOMEM == errno)
+            break;
+        gen_stats_error(st, errno, 1);
+        failed++;
+        sent++;
+    }
+    if (sent < q->n) {
+        gen_stats_error(st, errno, q->n - sent);
+        for (i = sent; i < q->n; i++)
+            q->owner[i]->seq--;
+    }
+    st->packets += sent - failed;
+    st->bytes += (unsigned long long)(sent - failed) * msg_size;
+    q->n = 0;
+}
+
+/* destination is due: its batch is queued, bucket charged, timer re-armed */
+void sched_fire(struct wheel *w, struct sched_send *q, struct sched_dest *d, unsigned int batch,
+                char *pool, unsigned int body, unsigned int pool_nr, unsigned int *pool_next,
+                unsigned int msg_size, struct gen_stats *st, unsigned long long now) {
+    unsigned int k;
+    char *p;
+    pacer_clamp(&d->pacer, now);
+    gen_stats_late(st, now > d->pacer.next_ns ? now - d->pacer.next_ns : 0);
+    for (k = 0; k < batch; k++) {
+        if (SCHED_SEND_MAX == q->n)
+            sched_flush(q, msg_size, st);
+        p = q->stamps + q->n * PROBE_SIZE;
+        hb_put32(p + 8, d->flow_id);
+        hb_put64(p + 12, d->seq++);
+        q->iov[2 * q->n + 1].iov_base = pool + *pool_next * body;
+        q->iov[2 * q->n + 1].iov_len = body;
+        if (++(*pool_next) == pool_nr)
+            *pool_next = 0;
+        q->msgs[q->n].msg_hdr.msg_name = &d->sa;
+        q->msgs[q->n].msg_hdr.msg_namelen = d->sa_len;
+        q->owner[q->n++] = d;
+    }
+    pacer_charge(&d->pacer, (unsigned long int)msg_size * batch, batch);
+    d->timer.expires = (d->pacer.next_ns + (1 << WHEEL_TICK_SHIFT) - 1) >> WHEEL_TICK_SHIFT;
+    wheel_add(w, &d->timer);
+}
+
+/* THREAD PROCEDURE OF SCHEDULER WORKER */
+void* sched_worker(void *thread_arg) {
+    struct sched_info *info = (struct sched_info*)thread_arg;
+    struct sched_dest *dest;
+    struct sched_send *q;
+    struct wheel *w;
+    struct wheel_timer phase, beat, *due, *t;
+    struct hb_state *hb = 0;
+    struct sockaddr_in v4;
+    struct sockaddr_in6 *v6;
+    unsigned long long now, next, beat_ns = 0;
+    unsigned int i, nr, seen, msg_size = 0, body = 0, pool_nr = 0, pool_next = 0;
+    unsigned short sleeping = 0, phase_due;
+    int hb_sock = -1, family = AF_INET;
+    char *p, *pool = 0;
+    numa_prefer(info->node);
+    nr = (info->hosts_nr - info->offset + info->stride - 1) / info->stride;
+    dest = (struct sched_dest*)calloc(nr, sizeof(struct sched_dest));
+    q = (struct sched_send*)calloc(1, sizeof(struct sched_send));
+    w = (struct wheel*)malloc(sizeof(struct wheel));
+    for (i = 0; dest && i < nr; i++) {
+        if (!(dest[i].sa_len = resolve_addr(info->hosts[info->offset + i * info->stride], info->port, &dest[i].sa))) {
+            log("ERROR: Invalid host %s\n", info->hosts[info->offset + i * info->stride]);
+            break;
+        }
+        if (AF_INET6 == dest[i].sa.ss_family)
+            family = AF_INET6;
+        dest[i].flow_id = info->offset + i * info->stride;
+        dest[i].timer.kind = SCHED_DEST;
+    }
+    if (!dest || !q || !w || i < nr || 0 > (q->sock = socket(family, SOCK_DGRAM, 0))) {
+        log("ERROR: scheduler of %u destinations", nr);
+        free(dest);
+        free(q);
+        free(w);
+        return 0;
+    }
+    /* one socket for all: IPv4 destinations as IPv4-mapped IPv6 ones */
+    for (i = 0; AF_INET6 == family && i < nr; i++) {
+        if (AF_INET != dest[i].sa.ss_family)
+            continue;
+        memcpy(&v4, &dest[i].sa, sizeof(v4));
+        memset(&dest[i].sa, 0, sizeof(dest[i].sa));
+        v6 = (struct sockaddr_in6*)&dest[i].sa;
+        v6->sin6_family = AF_INET6;
+        v6->sin6_port = v4.sin_port;
+        v6->sin6_addr.s6_addr[10] = v6->sin6_addr.s6_addr[11] = 0xff;
+        memcpy(v6->sin6_addr.s6_addr + 12, &v4.sin_addr, 4);
+        dest[i].sa_len = sizeof(struct sockaddr_in6);
+    }
+    for (i = 0; i < SCHED_SEND_MAX; i++) {
+        p = q->stamps + i * PROBE_SIZE;
+        memcpy(p, PROBE_MAGIC, 4);
+        p[4] = PROBE_VERSION;
+        q->iov[2 * i].iov_base = p;
+        q->iov[2 * i].iov_len = PROBE_SIZE;
+        q->msgs[i].msg_hdr.msg_iov = q->iov + 2 * i;
+        q->msgs[i].msg_hdr.msg_iovlen = 2;
+    }
+    phase.kind = SCHED_PHASE;
+    beat.kind = SCHED_HEARTBEAT;
+    /* heartbeats are timers of this wheel, never paused */
+    if (info->hb && (hb = hb_open(info->hb, &hb_sock)))
+        beat_ns = clock_ns();
+    seen = control.gen[LOAD_NET] - 1;
+
+    /* eternal loop */
+    while (1) {
+        /* (new) parameters: schedule starts over */
+        if (seen != control.gen[LOAD_NET]) {
+            seen = control.gen[LOAD_NET];
+            if (msg_size != info->msg_size) {
+                msg_size = info->msg_size;
+                body = msg_size - PROBE_SIZE;
+                pool_nr = body ? min(content.pool, max(PAYLOAD_POOL_BYTES_MAX / body, 1)) : 1;
+                pool_next = 0;
+                free(pool);
+                if (!(pool = (char*)malloc(pool_nr * body + 1))) {
+                    log("ERROR: allocate %u payloads", pool_nr);
+                    break;
+                }
+                for (i = 0; i < pool_nr; i++)
+                    (void)payload_fill(pool + i * body, body);
+            }
+            now = clock_ns();
+            wheel_init(w, now >> WHEEL_TICK_SHIFT);
+            if (hb) {
+                beat.expires = beat_ns >> WHEEL_TICK_SHIFT;
+                wheel_add(w, &beat);
+            }
+            sleeping = ctl_stopped(LOAD_NET);
+            for (i = 0; !sleeping && i < nr; i++)
+                sched_arm(w, info, dest + i, i, nr, msg_size, now);
+            if (!sleeping && info->phases.sleep) {
+                phase.expires = (now + (unsigned long long)info->phases.active * NANOSEC_PER_SEC) >> WHEEL_TICK_SHIFT;
+                wheel_add(w, &phase);
+            }
+        }
+        now = clock_ns();
+        due = 0;
+        phase_due = 0;
+        wheel_run(w, now >> WHEEL_TICK_SHIFT, &due);
+        while ((t = due)) {
+            due = t->next;
+            /* parked at the horizon and not due yet: back in for the rest */
+            if (t->expires > now >> WHEEL_TICK_SHIFT) {
+                wheel_add(w, t);
+                continue;
+            }
+            if (SCHED_DEST == t->kind) {
+                sched_fire(w, q, (struct sched_dest*)t, info->batch, pool, body, pool_nr, &pool_next,
+                    msg_size, info->stats, now);
+            }
+            else if (SCHED_HEARTBEAT == t->kind) {
+                hb_send(hb, hb_sock);
+                beat_ns += (unsigned long long)info->hb->delay * 1000;
+                beat.expires = beat_ns >> WHEEL_TICK_SHIFT;
+                wheel_add(w, &beat);
+            }
+            else {
+                phase_due = 1;
+            }
+        }
+        if (q->n)
+            sched_flush(q, msg_size, info->stats);
+        /* phase is over: wheel is rebuilt after the rest of due timers */
+        if (phase_due) {
+            sleeping = !sleeping;
+            wheel_init(w, now >> WHEEL_TICK_SHIFT);
+            if (hb)
+                wheel_add(w, &beat);
+            for (i = 0; !sleeping && i < nr; i++)
+                sched_arm(w, info, dest + i, i, nr, msg_size, now);
+            phase.expires = (now + (unsigned long long)(sleeping ? info->phases.sleep : info->phases.active)
+                * NANOSEC_PER_SEC) >> WHEEL_TICK_SHIFT;
+            wheel_add(w, &phase);
+        }
+        next = wheel_next(w);
+        pacer_sleep_until(LOAD_NET, (~0ULL == next) ? ~0ULL : next << WHEEL_TICK_SHIFT);
+    }
+    if (0 <= hb_sock)
+        close(hb_sock);
+    close(q->sock);
+    free(pool);
+    free(dest);
+    free(q);
+    free(w);
+    return 0;
+}
+#endif
+
+/* THREAD PROCEDURE FOR SENDING RAW ETHERNET PACKETS */
+#if defined(__linux__)
+void* raw_sender (void *thread_arg) {
+    struct sockaddr_ll target_addr;
+    struct send_batch batch;
+    struct raw_ring ring;
+    struct flow_gen flow;
+    struct pacer pacer;
+    const int set_on = 1;
+    int raw_sock = 0;
+    unsigned int i, hdr_len, stride, seen, delay;
+    unsigned long int packet_size, its_time = 0, sent, rate;
+    unsigned long long late;
+    char *packet, *payload;
+    struct ethhdr *packet_header;
+
+    struct raw_ping_info *info = (struct raw_ping_info*)thread_arg;
+    /* legacy frames are identical: one buffer for the whole batch;
+     * with flows every message of batch carries its own header */
+    numa_prefer(info->node);
+    hdr_len = info->flows ? FLOW_HDR_MAX : ETH_HLEN;
+    stride = info->flows ? hdr_len + info->msg_size : 0;
+    packet = (char*) malloc(stride ? stride * info->batch : hdr_len + info->msg_size);
+    if (0 > (raw_sock = socket(PF_PACKET, SOCK_RAW, htons(ETH_P_ALL)))) {
+        log("socket() Error #%d: %s\n", errno, strerror(errno));
+        free(packet);
+        return 0;
+    }
+    /* fill address */
+    memset(&target_addr, 0, sizeof (struct sockaddr_ll));
+    target_addr.sll_family = PF_PACKET;
+    target_addr.sll_protocol = htons(ETH_P_IP);
+    target_addr.sll_ifindex = info->if_index;
+    if (info->qdisc_bypass &&
+        0 > setsockopt(raw_sock, SOL_PACKET, PACKET_QDISC_BYPASS, &set_on, sizeof(set_on))) {
+        /* not fatal: kernel older than 3.14 */
+        log("PACKET_QDISC_BYPASS Error #%d: %s", errno, strerror(errno));
+    }
+    // ARP hardware identifier is ethernet
+    target_addr.sll_hatype = ARPHRD_ETHER;
+    // target is another host
+    target_addr.sll_pkttype = PACKET_OTHERHOST;
+    //address length
+    target_addr.sll_halen = ETH_ALEN;
+    memcpy(&(target_addr.sll_addr), info->target_mac, ETH_ALEN);
+
+    if (info->flows) {
+        /* header template goes right before payload */
+        payload = packet + FLOW_HDR_MAX;
+        packet_size = (info->fill_buffer_procedure)(payload, info->msg_size);
+        flow_init(&flow, info->flows, info->flow_offset, info->flow_stride,
+            payload, packet_size);
+        /* frame starts where header of its length ends */
+        hdr_len = flow.hdr_len;
+        packet_size += hdr_len;
+        for (i = 0; i < info->batch; i++) {
+            if (i)
+                memcpy(packet + i * stride + FLOW_HDR_MAX, payload, info->msg_size);
+            memcpy(packet + i * stride + FLOW_HDR_MAX - hdr_len, flow.hdr, hdr_len);
+        }
+        packet += FLOW_HDR_MAX - hdr_len;
+    }
+    else {
+        packet_header = (struct ethhdr *)packet;
+        payload = packet + ETH_HLEN;
+        /* Ethernet Packet Header*/
+        memcpy(packet, info->target_mac, ETH_ALEN);
+        memcpy((packet + ETH_ALEN), info->source_mac, ETH_ALEN);
+
+        /* using non-existing protocol 8200 instead of ETH_P_IP */
+        packet_header->h_proto = htons(0x8200);
+        /* User data */
+        packet_size = (info->fill_buffer_procedure)(payload, info->msg_size);
+        packet_size += ETH_HLEN;
+    }
+    if (0 > batch_init(&batch, raw_sock, &target_addr, sizeof(struct sockaddr_ll),
+                        packet, packet_size, stride, info->batch)) {
+        log("ERROR: allocate batch of %u", info->batch);
+        close(raw_sock);
+        free(packet - (info->flows ? FLOW_HDR_MAX - hdr_len : 0));
+        return 0;
+    }
+    if (info->ring) {
+        if (0 > raw_ring_init(&ring, raw_sock, info->if_index)) {
+            raw_ring_free(&ring);
+            batch_free(&batch);
+            close(raw_sock);
+            free(packet - (info->flows ? FLOW_HDR_MAX - hdr_len : 0));
+            return 0;
+        }
+        /* frames are built once: later only status words
+         * (and flow headers) are touched */
+        raw_ring_fill(&ring, packet, packet_size);
+        log("TX ring: %u frames", ring.frame_nr);
+    }
+
+    rate = info->rate;
+    delay = info->delay;
+    pacer_init(&pacer, LOAD_NET, rate, info->burst, delay);
+
+    /* eternal loop (benchmark ends it) */
+    while (!info->quit) {
+        ctl_hold(LOAD_NET);
+        seen = control.gen[LOAD_NET];
+        /* frames are built once: only rate and schedule may change */
+        if (info->phases.sleep || rate != info->rate || delay != info->delay) {
+            rate = info->rate;
+            delay = info->delay;
+            pacer_init(&pacer, LOAD_NET, rate, info->burst, delay);
+        }
+        if (info->phases.sleep) {
+            its_time = time(0) + info->phases.active;
+        }
+        while (info->phases.sleep ? (time(0) < its_time) : 1) {
+            late = pacer_wait(&pacer, packet_size * batch.depth, batch.depth);
+            if (seen != control.gen[LOAD_NET])
+                break;
+            gen_stats_late(info->stats, late);
+            if (info->ring) {
+                sent = raw_ring_send(&ring, batch.depth, info->flows ? &flow : 0);
+            }
+            else {
+                for (i = 0; info->flows && i < batch.depth; i++)
+                    flow_next(&flow, packet + i * stride);
+                sent = batch_send(&batch);
+            }
+            if (sent < batch.depth)
+                gen_stats_error(info->stats, errno, batch.depth - sent);
+            info->stats->packets += sent;
+            info->stats->bytes += sent * packet_size;
+            /* refill is not supported in flow mode: UDP checksum
+             * is computed over the payload once */
+            if (info->update_every_packet && !info->flows) {
+                packet_size = (info->fill_buffer_procedure)(payload, info->msg_size);
+                packet_size += ETH_HLEN;
+                batch_set_len(&batch, packet_size);
+                /* frames on their way out keep the previous content */
+                if (info->ring)
+                    raw_ring_fill(&ring, packet, packet_size);
+            }
+        }
+        if (seen == control.gen[LOAD_NET] && info->phases.sleep) {
+            ctl_sleep(LOAD_NET, info->phases.sleep);
+        }
+    }
+    if (info->ring)
+        raw_ring_free(&ring);
+    batch_free(&batch);
+    close(raw_sock);
+    free(packet - (info->flows ? FLOW_HDR_MAX - hdr_len : 0));
+    return (0);
+}
+#endif
+
+#if defined(__linux__)
+/* PCAP REPLAY */
+/* 16/32-bit word in byte order of the capture */
+static inline unsigned int pcap16(struct pcap_replay *r, unsigned char *p) {
+    return r->big ? get16(p) : (p[1] << 8) | p[0];
+}
+
+static inline unsigned long int pcap32(struct pcap_replay *r, unsigned char *p) {
+    return r->big ? get32(p) : ((unsigned long int)pcap16(r, p + 2) << 16) | pcap16(r, p);
+}
+
+static inline unsigned long long pcap_ns(unsigned long long ts, unsigned long long units) {
+    return ts / units * NANOSEC_PER_SEC + ts % units * NANOSEC_PER_SEC / units;
+}
+
+/* pcapng if_tsresol option: 10^-n or 2^-n seconds */
+unsigned long long pcapng_units(unsigned char v) {
+    unsigned long long units = 1;
+    unsigned int i;
+    for (i = 0; i < (v & 0x7f) && units < NANOSEC_PER_SEC * 1000; i++)
+        units *= (v & 0x80) ? 2 : 10;
+    return units;
+}
+
+/* start of capture: file header or first section */
+int pcap_rewind(struct pcap_replay *r) {
+    unsigned long int magic;
+    r->pos = 0;
+    r->dropped = 0;
+    r->ifaces = 0;
+    r->ts_ns = 0;
+    if (r->size < 24)
+        return -1;
+    magic = get32(r->map);
+    if (0x0a0d0d0a == magic) {
+        /* byte order comes with every section header block */
+        r->ng = 1;
+        return 0;
+    }
+    r->ng = 0;
+    if (0xa1b2c3d4 == magic || 0xa1b23c4d == magic)
+        r->big = 1;
+    else if (0xd4c3b2a1 == magic || 0x4d3cb2a1 == magic)
+        r->big = 0;
+    else
+        return -1;
+    r->linktype[0] = (unsigned int)pcap32(r, r->map + 20) & 0xffff;
+    r->units[0] = (0xa1b2c3d4 == magic || 0xd4c3b2a1 == magic) ? MICROSEC_PER_SEC : NANOSEC_PER_SEC;
+    r->ifaces = 1;
+    r->pos = 24;
+    return 0;
+}
+
+/* next Ethernet frame of capture: 1 if found, 0 at the end, -1 if broken */
+int pcap_next(struct pcap_replay *r, unsigned char **frame, unsigned int *len) {
+    unsigned char *p, *opt;
+    unsigned long int type, block, iface, caplen;
+    while (r->pos + 16 <= r->size) {
+        p = r->map + r->pos;
+        if (!r->ng) {
+            caplen = pcap32(r, p + 8);
+            if (r->pos + 16 + caplen > r->size)
+                return -1;
+            r->ts_ns = pcap_ns((unsigned long long)pcap32(r, p) * r->units[0] + pcap32(r, p + 4),
+                r->units[0]);
+            r->pos += 16 + caplen;
+            if (PCAP_LINKTYPE_ETHERNET != r->linktype[0])
+                return -1;
+            *frame = p + 16;
+            *len = (unsigned int)caplen;
+            return 1;
+        }
+        if (0x0a0d0d0a == get32(p)) {
+            r->big = (0x1a2b3c4d == get32(p + 8));
+            r->ifaces = 0;
+        }
+        type = pcap32(r, p);
+        block = pcap32(r, p + 4);
+        if (block < 12 || block % 4 || r->pos + block > r->size)
+            return -1;
+        r->pos += block;
+        switch (type) {
+        case 1:
+            /* interface description: link type and time stamp resolution */
+            if (PCAP_IFACES_MAX == r->ifaces)
+                return -1;
+            r->linktype[r->ifaces] = pcap16(r, p + 8);
+            r->units[r->ifaces] = MICROSEC_PER_SEC;
+            for (opt = p + 16; opt + 4 <= p + block - 4 && pcap16(r, opt); ) {
+                if (9 == pcap16(r, opt))
+                    r->units[r->ifaces] = pcapng_units(opt[4]);
+                opt += 4 + ((pcap16(r, opt + 2) + 3) & ~3U);
+            }
+            r->ifaces++;
+            break;
+        case 3:
+            /* simple packet: interface 0, no time stamp */
+            caplen = pcap32(r, p + 8);
+            if (caplen > block - 16)
+                caplen = block - 16;
+            if (!r->ifaces || PCAP_LINKTYPE_ETHERNET != r->linktype[0])
+                break;
+            *frame = p + 12;
+            *len = (unsigned int)caplen;
+            return 1;
+        case 6:
+            /* enhanced packet */
+            iface = pcap32(r, p + 8);
+            caplen = pcap32(r, p + 20);
+            if (iface >= r->ifaces || caplen > block - 32)
+                return -1;
+            if (PCAP_LINKTYPE_ETHERNET != r->linktype[iface])
+                break;
+            r->ts_ns = pcap_ns(((unsigned long long)pcap32(r, p + 12) << 32) | pcap32(r, p + 16),
+                r->units[iface]);
+            *frame = p + 28;
+            *len = (unsigned int)caplen;
+            return 1;
+        default:
+            break;
+        }
+    }
+    return (r->pos == r->size) ? 0 : -1;
+}
+
+/* map capture and check it has Ethernet frames; prints what is wrong */
+int pcap_open(struct pcap_replay *r) {
+    struct stat st;
+    unsigned char *frame;
+    unsigned int len;
+    int fd = open(r->path, O_RDONLY);
+    if (0 > fd || 0 > fstat(fd, &st)) {
+        printf("Error: can not open capture %s\n", r->path);
+        if (0 <= fd)
+            close(fd);
+        return -1;
+    }
+    r->size = (size_t)st.st_size;
+    r->map = (unsigned char*)mmap(0, r->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (MAP_FAILED == r->map) {
+        printf("Error: mmap() of %s #%d: %s\n", r->path, errno, strerror(errno));
+        return -1;
+    }
+    madvise(r->map, r->size, MADV_SEQUENTIAL);
+    if (0 > pcap_rewind(r) || 1 != pcap_next(r, &frame, &len) || 0 > pcap_rewind(r)) {
+        printf("Error: %s is not pcap/pcapng capture of Ethernet frames\n", r->path);
+        munmap(r->map, r->size);
+        return -1;
+    }
+    return 0;
+}
+
+/* IPv4 address at p: net part of 'len' bits replaced, checksums patched */
+void pcap_rewrite_ip(unsigned char *p, unsigned long int net, unsigned int len,
+                     unsigned char *ip_csum, unsigned char *l4_csum) {
+    unsigned char new_ip[4];
+    unsigned long int mask = len ? 0xffffffffUL << (32 - len) : 0;
+    unsigned long int v = (net & mask) | (get32(p) & ~mask & 0xffffffffUL);
+    put16(new_ip, (unsigned int)(v >> 16));
+    put16(new_ip + 2, (unsigned int)v & 0xffff);
+    csum_replace(ip_csum, p, new_ip, 2);
+    /* UDP checksum 0 is "none": stays so */
+    if (l4_csum && (l4_csum[0] || l4_csum[1]))
+        csum_replace(l4_csum, p, new_ip, 2);
+    memcpy(p, new_ip, 4);
+}
+
+/* copy of frame head with MACs and IPv4 addresses rewritten; returns its length */
+unsigned int pcap_rewrite(struct pcap_replay *r, unsigned char *hdr, unsigned char *frame, unsigned int len) {
+    unsigned int n = (len < PCAP_HDR_MAX) ? len : PCAP_HDR_MAX, off = 12, ihl;
+    unsigned char *ip, *l4_csum = 0;
+    memcpy(hdr, frame, n);
+    if (r->set_dmac && n >= ETH_ALEN)
+        memcpy(hdr, r->dmac, ETH_ALEN);
+    if (r->set_smac && n >= 2 * ETH_ALEN)
+        memcpy(hdr + ETH_ALEN, r->smac, ETH_ALEN);
+    if (!r->sip_len && !r->dip_len)
+        return n;
+    /* 802.1Q / 802.1ad tags */
+    while (off + 2 <= n && (0x8100 == get16(hdr + off) || 0x88a8 == get16(hdr + off)))
+        off += 4;
+    if (off + 2 + 20 > n || ETH_P_IP != get16(hdr + off))
+        return n;
+    ip = hdr + off + 2;
+    ihl = (ip[0] & 0x0f) * 4;
+    /* L4 checksum covers addresses (pseudo header): first fragments only */
+    if (!(get16(ip + 6) & 0x1fff)) {
+        if (IPPROTO_TCP == ip[9] && ip + ihl + 18 <= hdr + n)
+            l4_csum = ip + ihl + 16;
+        else if (IPPROTO_UDP == ip[9] && ip + ihl + 8 <= hdr + n)
+            l4_csum = ip + ihl + 6;
+    }
+    if (r->sip_len)
+        pcap_rewrite_ip(ip + 12, r->sip, r->sip_len, ip + 10, l4_csum);
+    if (r->dip_len)
+        pcap_rewrite_ip(ip + 16, r->dip, r->dip_len, ip + 10, l4_csum);
+    return n;
+}
+
+/* frames of batch which kernel did not take are counted by errno, skipped */
+void pcap_flush(struct pcap_replay *r, int sock, struct mmsghdr *msgs, unsigned int nr,
+                unsigned int *lens) {
+    unsigned int done = 0, i;
+    int sent;
+    while (done < nr) {
+        sent = sendmmsg(sock, msgs + done, nr - done, 0);
+        if (0 >= sent) {
+            gen_stats_error(r->stats, errno, 1);
+            done++;
+            continue;
+        }
+        for (i = done; i < done + (unsigned int)sent; i++)
+            r->stats->bytes += lens[i];
+        r->stats->packets += sent;
+        done += sent;
+    }
+}
+
+/* THREAD PROCEDURE FOR REPLAYING CAPTURE THROUGH RAW SOCKET */
+void* pcap_replayer(void *thread_arg) {
+    struct pcap_replay *r = (struct pcap_replay*)thread_arg;
+    struct sockaddr_ll addr;
+    struct mmsghdr *msgs;
+    struct iovec *iov;
+    unsigned char *hdrs, *frame = 0;
+    unsigned int *lens, nr = 0, len = 0, n, seen, rewrite;
+    unsigned long long base, first_ns = 0, count = 0, deadline = 0, now, rounds = 0;
+    int sock, rc, have = 0;
+    rewrite = r->set_smac || r->set_dmac || r->sip_len || r->dip_len;
+    numa_prefer(r->node);
+    msgs = (struct mmsghdr*)calloc(r->batch, sizeof(struct mmsghdr));
+    iov = (struct iovec*)calloc(2 * r->batch, sizeof(struct iovec));
+    lens = (unsigned int*)calloc(r->batch, sizeof(unsigned int));
+    hdrs = (unsigned char*)malloc(r->batch * PCAP_HDR_MAX);
+    /* protocol 0: send only, nothing is queued for receive */
+    if (0 > (sock = socket(PF_PACKET, SOCK_RAW, 0)) || !msgs || !iov || !lens || !hdrs) {
+        log("Replay: socket() Error #%d: %s", errno, strerror(errno));
+        if (0 <= sock)
+            close(sock);
+        free(msgs);
+        free(iov);
+        free(lens);
+        free(hdrs);
+        return 0;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sll_family = PF_PACKET;
+    addr.sll_ifindex = r->if_index;
+    addr.sll_halen = ETH_ALEN;
+    for (n = 0; n < r->batch; n++) {
+        msgs[n].msg_hdr.msg_name = &addr;
+        msgs[n].msg_hdr.msg_namelen = sizeof(addr);
+        msgs[n].msg_hdr.msg_iov = iov + 2 * n;
+    }
+    /* eternal loop (unless the end of capture is the end) */
+    while (1) {
+        ctl_hold(LOAD_NET);
+        seen = control.gen[LOAD_NET];
+        /* timing restarts from the current frame after every change */
+        base = clock_ns();
+        count = have;
+        first_ns = r->ts_ns;
+        deadline = base;
+        while (seen == control.gen[LOAD_NET]) {
+            if (!have) {
+                rc = pcap_next(r, &frame, &len);
+                if (1 != rc) {
+                    if (0 > rc)
+                        log("Replay: %s broken at offset %lu", r->path, (unsigned long int)r->pos);
+                    pcap_flush(r, sock, msgs, nr, lens);
+                    nr = 0;
+                    rounds++;
+                    if (!r->loop)
+                        break;
+                    pcap_rewind(r);
+                    base = clock_ns();
+                    count = 0;
+                    continue;
+                }
+                if (!count)
+                    first_ns = r->ts_ns;
+                if (r->pps)
+                    deadline = base + count * NANOSEC_PER_SEC / r->pps;
+                else if (r->speed > 0 && r->ts_ns > first_ns)
+                    deadline = base + (unsigned long long)((r->ts_ns - first_ns) / r->speed);
+                else
+                    deadline = base;
+                count++;
+                have = 1;
+                /* pages left behind are not needed any more */
+                if (r->pos > r->dropped && r->pos - r->dropped > 2 * PCAP_WINDOW) {
+                    madvise(r->map + r->dropped, r->size - r->dropped < PCAP_WINDOW ?
+                        r->size - r->dropped : PCAP_WINDOW, MADV_DONTNEED);
+                    r->dropped += PCAP_WINDOW;
+                }
+            }
+            now = clock_ns();
+            if (deadline > now) {
+                /* frames due so far go now, then wait for this one */
+                if (nr) {
+                    pcap_flush(r, sock, msgs, nr, lens);
+                    nr = 0;
+                    continue;
+                }
+                pacer_sleep_until(LOAD_NET, deadline);
+                continue;
+            }
+            if (!nr)
+                gen_stats_late(r->stats, now - deadline);
+            if (rewrite) {
+                n = pcap_rewrite(r, hdrs + nr * PCAP_HDR_MAX, frame, len);
+                iov[2 * nr].iov_base = hdrs + nr * PCAP_HDR_MAX;
+                iov[2 * nr].iov_len = n;
+                iov[2 * nr + 1].iov_base = frame + n;
+                iov[2 * nr + 1].iov_len = len - n;
+                msgs[nr].msg_hdr.msg_iovlen = 2;
+            }
+            else {
+                iov[2 * nr].iov_base = frame;
+                iov[2 * nr].iov_len = len;
+                msgs[nr].msg_hdr.msg_iovlen = 1;
+            }
+            lens[nr++] = len;
+            have = 0;
+            r->stats->iterations++;
+            if (nr == r->batch) {
+                pcap_flush(r, sock, msgs, nr, lens);
+                nr = 0;
+            }
+        }
+        pcap_flush(r, sock, msgs, nr, lens);
+        nr = 0;
+        if (!r->loop && rounds)
+            break;
+    }
+    log("Replay: %s done, %llu frames sent", r->path, r->stats->packets);
+    close(sock);
+    free(msgs);
+    free(iov);
+    free(lens);
+    free(hdrs);
+    munmap(r->map, r->size);
+    return 0;
+}
+#endif
+
+#if defined(__linux__)
+/* RECEIVER */
+/* REQUEST/RESPONSE HELPERS */
+int rpc_request(unsigned char *buf, unsigned int len) {
+    return len >= RPC_HDR_SIZE && !memcmp(buf, RPC_MAGIC, 4) && RPC_VERSION == buf[4];
+}
+
+/* request header turned into response one, returns response length */
+unsigned long int rpc_answer(unsigned char *hdr, unsigned long int max) {
+    unsigned long int len = get32(hdr + 12);
+    memcpy(hdr, RPC_REPLY_MAGIC, 4);
+    if (len < RPC_HDR_SIZE)
+        len = RPC_HDR_SIZE;
+    return (len > max) ? max : len;
+}
+
+/* datagram answering request 'hdr' (header in place, body from 'zeros') */
+void rpc_reply(unsigned char *hdr, struct mmsghdr *m, struct iovec *iov, char *zeros, unsigned int max) {
+    unsigned long int len = rpc_answer(hdr, max);
+    iov[0].iov_base = hdr;
+    iov[0].iov_len = RPC_HDR_SIZE;
+    iov[1].iov_base = zeros;
+    iov[1].iov_len = len - RPC_HDR_SIZE;
+    memset(&m->msg_hdr, 0, sizeof(m->msg_hdr));
+    m->msg_hdr.msg_iov = iov;
+    m->msg_hdr.msg_iovlen = 2;
+}
+
+/* THREAD PROCEDURE FOR RECEIVING PROBES (one of SO_REUSEPORT sockets) */
+void* rx_receiver(void *thread_arg) {
+    struct rx_info *info = (struct rx_info*)thread_arg;
+    const int rcvbuf = RX_RCVBUF;
+    int sock, n, i, stamping = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+    struct sockaddr_storage *from;
+    struct mmsghdr *msgs;
+    struct iovec *iov;
+    struct cmsghdr *cm;
+    struct timespec ts, *kts;
+    unsigned char *bufs;
+    char *ctrl, *zeros;
+    struct mmsghdr *replies;
+    struct iovec *reply_iov;
+    unsigned int answers;
+    unsigned long long now;
+    const unsigned int ctrl_len = CMSG_SPACE(sizeof(struct timespec) * 3);
+    /* kernel spreads flows over the sockets by 4-tuple hash */
+    if (0 > (sock = bind_any(SOCK_DGRAM, info->port))) {
+        log("receiver bind() port %d Error #%d: %s", info->port, errno, strerror(errno));
+        return 0;
+    }
+    /* above net.core.rmem_max needs root */
+    if (0 > setsockopt(sock, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof(rcvbuf)))
+        setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    /* without kernel time stamps receive time is taken after recvmmsg() */
+    if (0 > setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPING, &stamping, sizeof(stamping)))
+        log("SO_TIMESTAMPING not used #%d: %s", errno, strerror(errno));
+    /* only probe header is copied: MSG_TRUNC reports real length */
+    msgs = (struct mmsghdr*)calloc(info->batch, sizeof(struct mmsghdr));
+    iov = (struct iovec*)calloc(info->batch, sizeof(struct iovec));
+    from = (struct sockaddr_storage*)calloc(info->batch, sizeof(struct sockaddr_storage));
+    bufs = (unsigned char*)malloc(info->batch * PROBE_SIZE);
+    ctrl = (char*)malloc(info->batch * ctrl_len);
+    /* responses: echoed header and a body out of zeros */
+    replies = (struct mmsghdr*)calloc(info->batch, sizeof(struct mmsghdr));
+    reply_iov = (struct iovec*)calloc(2 * info->batch, sizeof(struct iovec));
+    zeros = (char*)calloc(1, UDP_PING_MSG_SIZE_MAX);
+    if (!msgs || !iov || !from || !bufs || !ctrl || !replies || !reply_iov || !zeros) {
+        log("ERROR: allocate receive batch of %u", info->batch);
+        free(msgs);
+        free(iov);
+        free(from);
+        free(bufs);
+        free(ctrl);
+        free(replies);
+        free(reply_iov);
+        free(zeros);
+        close(sock);
+        return 0;
+    }
+    for (i = 0; i < (int)info->batch; i++) {
+        iov[i].iov_base = bufs + i * PROBE_SIZE;
+        iov[i].iov_len = PROBE_SIZE;
+        msgs[i].msg_hdr.msg_iov = iov + i;
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_name = from + i;
+        msgs[i].msg_hdr.msg_control = ctrl + i * ctrl_len;
+    }
+    while (1) {
+        for (i = 0; i < (int)info->batch; i++) {
+            msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+            msgs[i].msg_hdr.msg_controllen = ctrl_len;
+        }
+        n = recvmmsg(sock, msgs, info->batch, MSG_WAITFORONE | MSG_TRUNC, 0);
+        if (0 >= n)
+            continue;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        for (i = 0, answers = 0; i < n; i++) {
+            if (rpc_request(bufs + i * PROBE_SIZE, msgs[i].msg_len)) {
+                rpc_reply(bufs + i * PROBE_SIZE, replies + answers, reply_iov + 2 * answers,
+                    zeros, UDP_PING_MSG_SIZE_MAX);
+                replies[answers].msg_hdr.msg_name = from + i;
+                replies[answers++].msg_hdr.msg_namelen = msgs[i].msg_hdr.msg_namelen;
+                continue;
+            }
+            now = (unsigned long long)ts.tv_sec * NANOSEC_PER_SEC + ts.tv_nsec;
+            for (cm = CMSG_FIRSTHDR(&msgs[i].msg_hdr); cm; cm = CMSG_NXTHDR(&msgs[i].msg_hdr, cm)) {
+                /* struct scm_timestamping: [0] is software stamp */
+                if (SOL_SOCKET == cm->cmsg_level && SCM_TIMESTAMPING == cm->cmsg_type) {
+                    kts = (struct timespec*)CMSG_DATA(cm);
+                    if (kts->tv_sec)
+                        now = (unsigned long long)kts->tv_sec * NANOSEC_PER_SEC + kts->tv_nsec;
+                }
+            }
+            rx_account(info, from + i, bufs + i * PROBE_SIZE, msgs[i].msg_len, now);
+        }
+        if (answers && 0 < (n = sendmmsg(sock, replies, answers, MSG_DONTWAIT)))
+            info->answered += n;
+    }
+    return 0;
+}
+#endif
+
+#if defined(__linux__)
+/* TCP LOAD */
+/* non-blocking connect() of slot 'c' to its destination; 0 if under way */
+int tcp_open(struct tcp_load_info *info, int ep, struct tcp_conn *c, struct sockaddr_storage *dst) {
+    struct epoll_event ev;
+    struct linger lg = {1, 0};
+    c->connected = c->writable = 0;
+    c->fd = socket(dst[c->dst].ss_family, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (0 > c->fd) {
+        gen_stats_error(info->stats, errno, 1);
+        return -1;
+    }
+    if (TCP_CHURN == c->kind && info->reset)
+        setsockopt(c->fd, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+    /* completion (or failure) of connect is reported as writable */
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    ev.data.ptr = c;
+    if ((0 > connect(c->fd, (struct sockaddr*)(dst + c->dst), addr_len(dst + c->dst)) && EINPROGRESS != errno) ||
+            0 > epoll_ctl(ep, EPOLL_CTL_ADD, c->fd, &ev)) {
+        gen_stats_error(info->stats, errno, 1);
+        info->failures++;
+        close(c->fd);
+        c->fd = -1;
+        return -1;
+    }
+    info->open++;
+    return 0;
+}
+
+void tcp_close(struct tcp_load_info *info, struct tcp_conn *c) {
+    if (0 > c->fd)
+        return;
+    close(c->fd);
+    c->fd = -1;
+    info->open--;
+}
+
+/*
+ * Bulk streams write while pacer allows, at most TCP_EVENTS sends
+ * so that events are not starved. Returns pacer deadline if throttled
+ * by rate, 1 if there is more to write now, 0 if all wait for room.
+ */
+unsigned long long tcp_write(struct tcp_load_info *info, struct tcp_conn *conns, unsigned int nr,
+                             char *buf, struct pacer *pacer) {
+    unsigned int i, busy = 1, sends = 0;
+    ssize_t n;
+    while (busy) {
+        busy = 0;
+        for (i = 0; i < nr; i++) {
+            if (0 > conns[i].fd || !conns[i].writable)
+                continue;
+            if (info->rate && pacer->next_ns > clock_ns())
+                return pacer->next_ns;
+            if (TCP_EVENTS == sends++)
+                return 1;
+            n = send(conns[i].fd, buf, info->msg_size, MSG_DONTWAIT | MSG_NOSIGNAL);
+            if (0 > n) {
+                conns[i].writable = 0;
+                if (EAGAIN == errno)
+                    continue;
+                gen_stats_error(info->stats, errno, 1);
+                tcp_close(info, conns + i);
+                continue;
+            }
+            busy = 1;
+            info->stats->packets++;
+            info->stats->bytes += n;
+            /* never sleeps: deadline has passed */
+            if (info->rate)
+                pacer_wait(pacer, (unsigned long int)n, 1);
+        }
+    }
+    return 0;
+}
+
+/* THREAD PROCEDURE OF TCP LOAD (bulk, held and churned connections) */
+void* tcp_loader(void *thread_arg) {
+    struct tcp_load_info *info = (struct tcp_load_info*)thread_arg;
+    struct epoll_event events[TCP_EVENTS];
+    struct sockaddr_storage *dst;
+    struct tcp_conn *conns, *c, *churn;
+    struct pacer pacer;
+    unsigned long long now, wake, churn_next = 0, retry = 0, its_time = 0, more;
+    unsigned int i, nr, seen, inflight = 0, slot = 0;
+    int ep, n, err;
+    socklen_t len;
+    char *buf, drain[512];
+    numa_prefer(info->node);
+    dst = (struct sockaddr_storage*)calloc(info->hosts_nr, sizeof(struct sockaddr_storage));
+    nr = info->bulk + info->hold;
+    conns = (struct tcp_conn*)calloc(nr + TCP_CHURN_INFLIGHT, sizeof(struct tcp_conn));
+    buf = (char*)malloc(info->msg_size);
+    ep = epoll_create1(0);
+    if (!dst || !conns || !buf || 0 > ep) {
+        log("ERROR: TCP load of %u connections", nr);
+        free(dst);
+        free(conns);
+        free(buf);
+        return 0;
+    }
+    for (i = 0; i < info->hosts_nr; i++) {
+        if (!resolve_addr(info->hosts[i], info->port, dst + i)) {
+            log("ERROR: Invalid host %s\n", info->hosts[i]);
+            close(ep);
+            free(dst);
+            free(conns);
+            free(buf);
+            return 0;
+        }
+    }
+    (void)payload_fill(buf, info->msg_size);
+    /* bulk streams first, then held ones; churn slots are taken in turn */
+    for (i = 0; i < nr + TCP_CHURN_INFLIGHT; i++) {
+        conns[i].fd = -1;
+        conns[i].kind = (i < info->bulk) ? TCP_BULK : (i < nr) ? TCP_HOLD : TCP_CHURN;
+        conns[i].dst = (info->offset + i) % info->hosts_nr;
+    }
+    churn = conns + nr;
+
+    /* eternal loop */
+    while (1) {
+        ctl_hold(LOAD_NET);
+        seen = control.gen[LOAD_NET];
+        if (info->phases.sleep) {
+            its_time = time(0) + info->phases.active;
+        }
+        pacer_init(&pacer, LOAD_NET, info->rate, info->burst, 0);
+        churn_next = retry = clock_ns();
+        while ((info->phases.sleep ? (time(0) < its_time) : 1) && seen == control.gen[LOAD_NET]) {
+            now = clock_ns();
+            /* missing long-lived connections, not faster than TCP_RETRY_NS */
+            if (now >= retry) {
+                for (i = 0; i < nr; i++)
+                    if (0 > conns[i].fd)
+                        tcp_open(info, ep, conns + i, dst);
+                retry = now + TCP_RETRY_NS;
+            }
+            /* churn: connects due by now, as many as slots allow;
+             * backlog of more than a second is not caught up */
+            if (churn_next + NANOSEC_PER_SEC < now)
+                churn_next = now - NANOSEC_PER_SEC;
+            while (info->churn && churn_next <= now && inflight < TCP_CHURN_INFLIGHT) {
+                for (c = churn + slot; 0 <= c->fd; c = churn + slot)
+                    slot = (slot + 1) % TCP_CHURN_INFLIGHT;
+                c->dst = (unsigned int)((info->offset + info->connects + info->failures) % info->hosts_nr);
+                if (0 == tcp_open(info, ep, c, dst))
+                    inflight++;
+                gen_stats_late(info->stats, now - churn_next);
+                churn_next += NANOSEC_PER_SEC / info->churn;
+            }
+            more = tcp_write(info, conns, info->bulk, buf, &pacer);
+            /* sleep until the next due thing: churn, rate, retry or command */
+            wake = now + CTL_POLL_NS;
+            if (info->churn && inflight < TCP_CHURN_INFLIGHT && churn_next < wake)
+                wake = churn_next;
+            if (more && more < wake)
+                wake = more;
+            if (retry < wake)
+                wake = retry;
+            now = clock_ns();
+            n = epoll_wait(ep, events, TCP_EVENTS, (wake > now) ? (int)((wake - now + 999999) / 1000000) : 0);
+            for (i = 0; (int)i < n; i++) {
+                c = (struct tcp_conn*)events[i].data.ptr;
+                if (!c->connected) {
+                    err = 0;
+                    len = sizeof(err);
+                    getsockopt(c->fd, SOL_SOCKET, SO_ERROR, &err, &len);
+                    if (err || (events[i].events & (EPOLLERR | EPOLLHUP))) {
+                        gen_stats_error(info->stats, err ? err : ECONNREFUSED, 1);
+                        info->failures++;
+                        if (TCP_CHURN == c->kind)
+                            inflight--;
+                        tcp_close(info, c);
+                        continue;
+                    }
+                    c->connected = 1;
+                    info->connects++;
+                    info->stats->iterations++;
+                    if (TCP_CHURN == c->kind) {
+                        inflight--;
+                        tcp_close(info, c);
+                        continue;
+                    }
+                }
+                if (events[i].events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) {
+                    tcp_close(info, c);
+                    continue;
+                }
+                /* sink sends nothing: anything read is just dropped */
+                if (events[i].events & EPOLLIN) {
+                    while (0 < recv(c->fd, drain, sizeof(drain), MSG_DONTWAIT))
+                        ;
+                }
+                if (events[i].events & EPOLLOUT)
+                    c->writable = 1;
+            }
+        }
+        /* sleep phase and pause: no connections at all */
+        if (seen == control.gen[LOAD_NET] || ctl_stopped(LOAD_NET)) {
+            for (i = 0; i < nr + TCP_CHURN_INFLIGHT; i++)
+                tcp_close(info, conns + i);
+            inflight = 0;
+        }
+        if (seen == control.gen[LOAD_NET] && info->phases.sleep) {
+            ctl_sleep(LOAD_NET, info->phases.sleep);
+        }
+    }
+    close(ep);
+    free(dst);
+    free(conns);
+    free(buf);
+    return 0;
+}
+
+/*
+ * Serve accepted connection until socket has nothing more to give
+ * (or to take). Requests are answered in order, each after its body
+ * is read; anything else is drained. Returns -1 when peer is gone.
+ */
+int tcp_serve(struct tcp_sink_info *info, struct tcp_peer *p, char *buf, char *zeros) {
+    ssize_t n;
+    while (1) {
+        /* response first: no more reading until it is written */
+        while (p->out) {
+            if (p->out_hdr < RPC_HDR_SIZE)
+                n = send(p->fd, p->hdr + p->out_hdr, RPC_HDR_SIZE - p->out_hdr, MSG_DONTWAIT | MSG_NOSIGNAL);
+            else
+                n = send(p->fd, zeros, min(p->out, TCP_SINK_BUF), MSG_DONTWAIT | MSG_NOSIGNAL);
+            if (0 > n)
+                return (EAGAIN == errno) ? 0 : -1;
+            if (p->out_hdr < RPC_HDR_SIZE)
+                p->out_hdr += n;
+            p->out -= n;
+            if (!p->out)
+                info->answered++;
+        }
+        if (p->rpc && !p->skip && p->got < RPC_HDR_SIZE)
+            n = recv(p->fd, p->hdr + p->got, RPC_HDR_SIZE - p->got, MSG_DONTWAIT);
+        else
+            n = recv(p->fd, buf, p->skip ? min(p->skip, TCP_SINK_BUF) : TCP_SINK_BUF, MSG_DONTWAIT);
+        if (0 >= n)
+            return (0 > n && EAGAIN == errno) ? 0 : -1;
+        info->bytes += n;
+        if (!p->rpc)
+            continue;
+        if (p->skip) {
+            p->skip -= n;
+        }
+        else {
+            p->got += n;
+            if (p->got < RPC_HDR_SIZE)
+                continue;
+            /* stream of something else: just drain it */
+            if (!rpc_request(p->hdr, RPC_HDR_SIZE)) {
+                p->rpc = 0;
+                continue;
+            }
+            p->skip = get32(p->hdr + 8);
+            p->skip = (p->skip > RPC_HDR_SIZE) ? p->skip - RPC_HDR_SIZE : 0;
+        }
+        if (!p->skip) {
+            p->out = rpc_answer(p->hdr, 0xffffffffUL);
+            p->out_hdr = 0;
+            p->got = 0;
+        }
+    }
+}
+
+/* THREAD PROCEDURE OF TCP SINK: accepts connections, drains or answers */
+void* tcp_sink(void *thread_arg) {
+    struct tcp_sink_info *info = (struct tcp_sink_info*)thread_arg;
+    struct epoll_event ev, events[TCP_EVENTS];
+    struct tcp_peer *p;
+    int sock, ep, fd, n, i;
+    char *buf = (char*)malloc(TCP_SINK_BUF), *zeros = (char*)calloc(1, TCP_SINK_BUF);
+    ep = epoll_create1(0);
+    if (!buf || !zeros || 0 > ep) {
+        log("ERROR: create TCP sink");
+        free(buf);
+        free(zeros);
+        return 0;
+    }
+    /* kernel spreads connections over the listeners (IPv4 and IPv6) */
+    sock = bind_any(SOCK_STREAM | SOCK_NONBLOCK, info->port);
+    /* listener is the only one without peer */
+    ev.events = EPOLLIN;
+    ev.data.ptr = 0;
+    if (0 > sock || 0 > listen(sock, SOMAXCONN) ||
+            0 > epoll_ctl(ep, EPOLL_CTL_ADD, sock, &ev)) {
+        log("TCP sink port %d Error #%d: %s", info->port, errno, strerror(errno));
+        close(sock);
+        close(ep);
+        free(buf);
+        free(zeros);
+        return 0;
+    }
+    while (1) {
+        n = epoll_wait(ep, events, TCP_EVENTS, -1);
+        for (i = 0; i < n; i++) {
+            if (!(p = (struct tcp_peer*)events[i].data.ptr)) {
+                while (0 <= (fd = accept4(sock, 0, 0, SOCK_NONBLOCK))) {
+                    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+                    ev.data.ptr = p = (struct tcp_peer*)calloc(1, sizeof(struct tcp_peer));
+                    if (!p || 0 > epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev)) {
+                        free(p);
+                        close(fd);
+                        continue;
+                    }
+                    p->fd = fd;
+                    p->rpc = 1;
+                    info->accepts++;
+                    info->open++;
+                }
+                continue;
+            }
+            /* end of stream or reset */
+            if (0 > tcp_serve(info, p, buf, zeros)) {
+                close(p->fd);
+                free(p);
+                info->open--;
+            }
+        }
+    }
+    close(sock);
+    close(ep);
+    free(buf);
+    free(zeros);
+    return 0;
+}
+#endif
+
+#if defined(__linux__)
+/* REQUEST/RESPONSE LOAD */
+/* connection 'i' to its destination, watched by 'ep'; 0 on success */
+int rpc_open(struct rpc_info *info, struct rpc_conn *c, int ep, unsigned int i) {
+    struct epoll_event ev;
+    /* both sides stuck writing: request fails instead of waiting forever
+     * (connect gives up alike) */
+    struct timeval stuck = {1, 0};
+    int err;
+    c->got = 0;
+    c->skip = 0;
+    c->fd = c->sa_len ? socket(c->sa.ss_family, info->tcp ? SOCK_STREAM : SOCK_DGRAM, 0) : -1;
+    if (info->tcp && 0 <= c->fd)
+        setsockopt(c->fd, SOL_SOCKET, SO_SNDTIMEO, &stuck, sizeof(stuck));
+    ev.events = EPOLLIN;
+    ev.data.u32 = i;
+    if (0 > c->fd || 0 > connect(c->fd, (struct sockaddr*)&c->sa, c->sa_len) ||
+            0 > epoll_ctl(ep, EPOLL_CTL_ADD, c->fd, &ev)) {
+        err = errno;
+        if (0 <= c->fd)
+            close(c->fd);
+        c->fd = -1;
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Request of 'slot' scheduled at 'when' on connection 'c'; 0 if sent.
+ * TCP request is written whole or the stream is closed: a part of it
+ * would break framing of the rest (responses on it are lost alike).
+ */
+int rpc_send(struct rpc_info *info, struct rpc_conn *c, unsigned int slot,
+             unsigned long long when, char *buf) {
+    unsigned int off = 0;
+    ssize_t n;
+    memcpy(buf, RPC_MAGIC, 4);
+    buf[4] = RPC_VERSION;
+    hb_put32(buf + 8, info->req_size);
+    hb_put32(buf + 12, info->resp_size);
+    hb_put32(buf + 16, slot);
+    hb_put64(buf + 24, when);
+    if (0 > c->fd) {
+        gen_stats_error(info->stats, ENOTCONN, 1);
+        return -1;
+    }
+    if (!info->tcp) {
+        if (0 > send(c->fd, buf, info->req_size, MSG_NOSIGNAL | MSG_DONTWAIT)) {
+            gen_stats_error(info->stats, errno, 1);
+            return -1;
+        }
+    }
+    while (info->tcp && off < info->req_size) {
+        if (0 <= (n = send(c->fd, buf + off, info->req_size - off, MSG_NOSIGNAL))) {
+            off += n;
+            continue;
+        }
+        if (EINTR == errno)
+            continue;
+        gen_stats_error(info->stats, errno, 1);
+        close(c->fd);
+        c->fd = -1;
+        return -1;
+    }
+    info->stats->packets++;
+    info->stats->bytes += info->req_size;
+    return 0;
+}
+
+/* responses which arrived on 'c' (at most 'room'): latency accounted,
+ * slots of complete ones returned in 'done' (closed loop), count returned */
+int rpc_receive(struct rpc_info *info, struct rpc_conn *c, unsigned long long *slots,
+                unsigned int *done, unsigned int room) {
+    char drain[TCP_SINK_BUF / 16];
+    unsigned long long now, when;
+    unsigned int slot;
+    int nr = 0;
+    ssize_t n;
+    while (1) {
+        if (!info->tcp) {
+            /* header is all that matters: MSG_TRUNC drops the rest */
+            n = recv(c->fd, c->hdr, RPC_HDR_SIZE, MSG_DONTWAIT | MSG_TRUNC);
+            if (n < RPC_HDR_SIZE)
+                break;
+        }
+        else {
+            if (c->skip)
+                n = recv(c->fd, drain, min(c->skip, sizeof(drain)), MSG_DONTWAIT);
+            else
+                n = recv(c->fd, c->hdr + c->got, RPC_HDR_SIZE - c->got, MSG_DONTWAIT);
+            /* end of stream or reset: opened again later */
+            if (!n || (0 > n && EAGAIN != errno && EWOULDBLOCK != errno && EINTR != errno)) {
+                close(c->fd);
+                c->fd = -1;
+            }
+            if (0 >= n)
+                break;
+            if (c->skip) {
+                c->skip -= n;
+                continue;
+            }
+            if ((c->got += n) < RPC_HDR_SIZE)
+                continue;
+            c->got = 0;
+            c->skip = info->resp_size - RPC_HDR_SIZE;
+        }
+        if (memcmp(c->hdr, RPC_REPLY_MAGIC, 4))
+            continue;
+        now = clock_ns();
+        when = get64(c->hdr + 24);
+        slot = get32(c->hdr + 16);
+        /* closed loop: reissued request made this one stale */
+        if (slots && (slot >= info->outstanding || slots[slot] != when))
+            continue;
+        info->latency[jitter_bucket(now - when)]++;
+        info->answered++;
+        info->stats->iterations++;
+        if (slots)
+            done[nr] = slot;
+        /* the rest stays in socket: level triggered */
+        if (++nr == (int)room)
+            break;
+    }
+    return nr;
+}
+
+/* THREAD PROCEDURE OF REQUEST/RESPONSE LOAD */
+void* rpc_client(void *thread_arg) {
+    struct rpc_info *info = (struct rpc_info*)thread_arg;
+    struct epoll_event events[TCP_EVENTS];
+    struct rpc_conn *conns;
+    unsigned long long *slots = 0, start, count, now, next, wake, checked;
+    unsigned int i, j, seen, *done, its_time = 0, rr = 0;
+    int ep, n, k;
+    char *buf;
+    numa_prefer(info->node);
+    conns = (struct rpc_conn*)calloc(info->conns, sizeof(struct rpc_conn));
+    buf = (char*)malloc(info->req_size);
+    done = (unsigned int*)malloc(TCP_EVENTS * sizeof(unsigned int));
+    if (info->outstanding)
+        slots = (unsigned long long*)calloc(info->outstanding, sizeof(unsigned long long));
+    ep = epoll_create1(0);
+    if (!conns || !buf || !done || (info->outstanding && !slots) || 0 > ep) {
+        log("ERROR: request/response load of %u connections", info->conns);
+        free(conns);
+        free(buf);
+        free(done);
+        free(slots);
+        return 0;
+    }
+    (void)payload_fill(buf, info->req_size);
+    /* connections to destinations round-robin, set up once (TCP one
+     * closed on a failed request is opened again) */
+    for (i = 0; i < info->conns; i++) {
+        conns[i].sa_len = resolve_addr(info->hosts[(info->offset + i) % info->hosts_nr],
+                                       info->port, &conns[i].sa);
+        if (0 > rpc_open(info, conns + i, ep, i)) {
+            log("ERROR: request/response connection to %s #%d: %s",
+                info->hosts[(info->offset + i) % info->hosts_nr], errno, strerror(errno));
+            for (j = 0; j <= i; j++)
+                if (0 <= conns[j].fd)
+                    close(conns[j].fd);
+            close(ep);
+            free(conns);
+            free(buf);
+            free(done);
+            free(slots);
+            return 0;
+        }
+    }
+
+    /* eternal loop */
+    while (1) {
+        ctl_hold(LOAD_NET);
+        seen = control.gen[LOAD_NET];
+        if (info->phases.sleep) {
+            its_time = time(0) + info->phases.active;
+        }
+        start = checked = clock_ns();
+        count = 0;
+        /* closed loop: every slot starts with a request of its own */
+        for (i = 0; i < info->outstanding; i++) {
+            slots[i] = start;
+            if (rpc_send(info, conns + i % info->conns, i, start, buf))
+                slots[i] = 0;
+        }
+        while ((info->phases.sleep ? (time(0) < its_time) : 1) && seen == control.gen[LOAD_NET]) {
+            now = clock_ns();
+            /* open loop: every request due by now, at most a batch of them;
+             * latency counts from the schedule, late sends included */
+            for (k = 0; info->rps && k < TCP_EVENTS; k++) {
+                next = start + count * NANOSEC_PER_SEC / info->rps;
+                if (next > now)
+                    break;
+                if (!k)
+                    gen_stats_late(info->stats, now - next);
+                rpc_send(info, conns + rr, 0, next, buf);
+                rr = (rr + 1) % info->conns;
+                count++;
+            }
+            /* closed TCP connection again (not more often than the
+             * timeout): requests in flight on it are gone */
+            for (i = 0; info->tcp && now - checked > RPC_CHECK_NS && i < info->conns; i++) {
+                if (0 <= conns[i].fd || now < conns[i].retry)
+                    continue;
+                if (0 > rpc_open(info, conns + i, ep, i)) {
+                    conns[i].retry = now + RPC_TIMEOUT_NS;
+                    continue;
+                }
+                for (j = i; j < info->outstanding; j += info->conns)
+                    slots[j] = 0;
+            }
+            /* closed loop: unsent (0) ones and over UDP lost ones are
+             * reissued; those of closed connection wait for it */
+            if (info->outstanding && now - checked > RPC_CHECK_NS) {
+                for (i = 0; i < info->outstanding; i++) {
+                    if (slots[i] && (info->tcp || now - slots[i] < RPC_TIMEOUT_NS))
+                        continue;
+                    if (0 > conns[i % info->conns].fd)
+                        continue;
+                    if (slots[i])
+                        info->timeouts++;
+                    slots[i] = now;
+                    if (rpc_send(info, conns + i % info->conns, i, now, buf))
+                        slots[i] = 0;
+                }
+            }
+            if (now - checked > RPC_CHECK_NS)
+                checked = now;
+            wake = now + CTL_POLL_NS;
+            if (info->rps && start + count * NANOSEC_PER_SEC / info->rps < wake)
+                wake = start + count * NANOSEC_PER_SEC / info->rps;
+            /* the last millisecond is spun: epoll timeout is coarse */
+            now = clock_ns();
+            n = epoll_wait(ep, events, TCP_EVENTS, (wake > now) ? (int)((wake - now) / 1000000) : 0);
+            for (k = 0; k < n; k++) {
+                i = events[k].data.u32;
+                j = rpc_receive(info, conns + i, slots, done, TCP_EVENTS);
+                /* closed loop: next request of the slot goes right away */
+                while (slots && j--) {
+                    now = clock_ns();
+                    slots[done[j]] = now;
+                    if (rpc_send(info, conns + i, done[j], now, buf))
+                        slots[done[j]] = 0;
+                }
+            }
+        }
+        if (seen == control.gen[LOAD_NET] && info->phases.sleep) {
+            ctl_sleep(LOAD_NET, info->phases.sleep);
+        }
+    }
+    for (i = 0; i < info->conns; i++)
+        close(conns[i].fd);
+    close(ep);
+    free(conns);
+    free(buf);
+    free(done);
+    free(slots);
     return 0;
 }
 
-/* FILL BUFFER WITH JUNK */
-unsigned int fill_dummy(char* buf, unsigned int buf_size) {
-    if (!buf || buf_size < 4) {
+/* FLEET COLLECTOR */
+/* host of name and address, added if not seen yet; 0 if table is full */
+struct fleet_host* fleet_find(struct fleet *fl, const char *name, unsigned long int ip) {
+    unsigned int h = 2166136261U, i, mask = fl->slots - 1;
+    const char *c;
+    struct fleet_host *host = 0;
+    for (c = name; *c; c++)
+        h = (h ^ (unsigned char)*c) * 16777619U;
+    h ^= (unsigned int)(ip * 2654435761UL);
+    /* lookup without lock: slot is published by 'used' once filled */
+    for (i = 0; i <= mask; i++) {
+        host = fl->hosts + ((h + i) & mask);
+        if (!host->used)
+            break;
+        if (host->ip == ip && !strcmp(host->name, name))
+            return host;
+    }
+    pthread_mutex_lock(&fl->lock);
+    /* other socket thread may have added it meanwhile */
+    for (; i <= mask; i++) {
+        host = fl->hosts + ((h + i) & mask);
+        if (host->used && host->ip == ip && !strcmp(host->name, name))
+            break;
+        if (host->used)
+            continue;
+        if (fl->hosts_nr == fl->hosts_max) {
+            host = 0;
+            break;
+        }
+        strcpy(host->name, name);
+        host->ip = ip;
+        host->interval_ms = HEARTBEAT_DELAY_DEFAULT / 1000;
+        host->ring = fl->arena + (unsigned long)fl->hosts_nr * fl->history;
+        fl->list[fl->hosts_nr] = host;
+        __sync_synchronize();
+        host->used = 1;
+        fl->hosts_nr++;
+        break;
+    }
+    pthread_mutex_unlock(&fl->lock);
+    return host;
+}
+
+/* one heartbeat datagram of 'len' bytes received at 'now' (CLOCK_MONOTONIC) */
+void fleet_account(struct fleet *fl, struct fleet_rx *rx, unsigned char *buf,
+                   unsigned int len, unsigned long long now) {
+    char name[FLEET_NAME_LEN];
+    unsigned int i, n, off, rec_len, records;
+    unsigned long int seq, ms;
+    unsigned char *r;
+    struct fleet_host *host;
+    struct fleet_sample *s;
+    off = HB_HEADER_SIZE + ((buf[7] + 3) & ~3U);
+    if (len < HB_HEADER_SIZE || memcmp(buf, HB_MAGIC, 4) || HB_VERSION != buf[4] || len < off) {
+        rx->foreign++;
+        return;
+    }
+    /* names end up in JSON and CSV: quotes, separators and controls replaced */
+    n = min(buf[7], FLEET_NAME_LEN - 1);
+    for (i = 0; i < n; i++) {
+        r = buf + HB_HEADER_SIZE + i;
+        name[i] = (isgraph(*r) && '"' != *r && '\\' != *r && ',' != *r) ? (char)*r : '_';
+    }
+    name[n] = '\0';
+    if (!(host = fleet_find(fl, name, get32(buf + 24)))) {
+        rx->overflow++;
+        return;
+    }
+    seq = get32(buf + 8);
+    s = host->ring + host->head;
+    if (!host->nr || s->seq != seq) {
+        /* next heartbeat: oldest sample is overwritten */
+        i = host->nr ? (host->head + 1) % fl->history : 0;
+        s = host->ring + i;
+        memset(s, 0, sizeof(*s));
+        s->seq = seq;
+        s->time = (unsigned int)(get64(buf + 16) / NANOSEC_PER_SEC);
+        s->parts = buf[6] ? buf[6] : 1;
+        s->cpu = FLEET_CPU_NONE;
+        __sync_synchronize();
+        host->head = i;
+        if (host->nr < fl->history)
+            host->nr++;
+        /* first heartbeat of sender has no interval */
+        if ((ms = get32(buf + 12)))
+            host->interval_ms = ms;
+    }
+    records = get16(buf + 28);
+    for (i = 0; i < records && off + 4 <= len; i++, off += rec_len) {
+        rec_len = get16(buf + off + 2);
+        if (rec_len < 4 || off + rec_len > len)
+            break;
+        r = buf + off + 4;
+        switch (buf[off]) {
+        case HB_REC_LOAD:
+            if (rec_len >= 4 + 4)
+                s->load = get32(r);
+            break;
+        case HB_REC_IFACE:
+            /* traffic of loopback never leaves the host */
+            if (rec_len >= 4 + HB_NAME_LEN + 16 && strncmp((char*)r, "lo", HB_NAME_LEN)) {
+                s->rx += get64(r + HB_NAME_LEN);
+                s->tx += get64(r + HB_NAME_LEN + 8);
+            }
+            break;
+        case HB_REC_HOST:
+            if (rec_len >= 4 + 8)
+                s->cpu = get32(r);
+            break;
+        default:
+            break;
+        }
+    }
+    s->got++;
+    host->seen_ns = now;
+    rx->datagrams++;
+}
+
+/* latest heartbeat of host with all its parts, 0 if none yet */
+struct fleet_sample* fleet_latest(struct fleet *fl, struct fleet_host *host) {
+    unsigned int nr = host->nr, head = host->head;
+    if (!nr)
         return 0;
+    if (host->ring[head].got >= host->ring[head].parts)
+        return host->ring + head;
+    return (nr > 1) ? host->ring + (head + fl->history - 1) % fl->history : 0;
+}
+
+int fleet_online(struct fleet_host *host, unsigned long long now) {
+    return now - host->seen_ns <= FLEET_MISSED * (unsigned long long)host->interval_ms * 1000000;
+}
+
+int fleet_cpu_cmp(const void *a, const void *b) {
+    unsigned int x = *(const unsigned int*)a, y = *(const unsigned int*)b;
+    return (x > y) - (x < y);
+}
+
+/* CPU % of 'permille' of the hosts (sorted) */
+unsigned int fleet_percentile(unsigned int *cpu, unsigned int nr, unsigned int permille) {
+    unsigned int i = (nr * permille + 999) / 1000;
+    return cpu[i ? i - 1 : 0];
+}
+
+/* aggregates over online hosts; exporter only (uses fl->cpu) */
+void fleet_aggregate(struct fleet *fl, struct fleet_totals *t) {
+    unsigned long long now = clock_ns(), load = 0;
+    unsigned int i, sampled = 0;
+    struct fleet_host *host;
+    struct fleet_sample *s;
+    memset(t, 0, sizeof(*t));
+    t->time = (unsigned long int)time(0);
+    t->hosts = fl->hosts_nr;
+    for (i = 0; i < t->hosts; i++) {
+        host = fl->list[i];
+        if (!fleet_online(host, now)) {
+            t->offline++;
+            continue;
+        }
+        t->online++;
+        if (!(s = fleet_latest(fl, host)))
+            continue;
+        sampled++;
+        t->rx += s->rx;
+        t->tx += s->tx;
+        load += s->load;
+        if (FLEET_CPU_NONE == s->cpu)
+            continue;
+        fl->cpu[t->cpu_hosts++] = s->cpu;
+        t->cpu_hist[min(s->cpu * FLEET_CPU_BUCKETS / 10000, FLEET_CPU_BUCKETS - 1)]++;
+    }
+    if (sampled)
+        t->load = (unsigned int)(load / sampled);
+    if (t->cpu_hosts) {
+        qsort(fl->cpu, t->cpu_hosts, sizeof(unsigned int), fleet_cpu_cmp);
+        t->cpu_p50 = fleet_percentile(fl->cpu, t->cpu_hosts, 500);
+        t->cpu_p90 = fleet_percentile(fl->cpu, t->cpu_hosts, 900);
+        t->cpu_p99 = fleet_percentile(fl->cpu, t->cpu_hosts, 990);
+        t->cpu_max = fl->cpu[t->cpu_hosts - 1];
+    }
+    for (i = 0; i < (unsigned int)fl->rx_nr; i++) {
+        t->datagrams += fl->rx[i].datagrams;
+        t->foreign += fl->rx[i].foreign;
+        t->overflow += fl->rx[i].overflow;
     }
-    buf[0] = 'B';
-    buf[1] = '\0';
-    memset(buf + 2, 'D', buf_size - 3);
-    buf[buf_size - 1] = '\0';
-    return buf_size;
 }
 
-/* FILL BUFFER WITH HOST PERFORMANCE STATISTICS */
+/* aggregates as JSON object (without closing brace) or CSV row */
+int fleet_totals_line(struct fleet *fl, struct fleet_totals *t, char *buf, int room) {
+    int i, used;
+    if (fl->csv) {
+        used = stats_append(buf, 0, room, "%lu,%u,%u,%u,%llu,%llu,%.2f,%u,%.2f,%.2f,%.2f,%.2f",
+            t->time, t->hosts, t->online, t->offline, t->rx, t->tx, t->load / 100.0,
+            t->cpu_hosts, t->cpu_p50 / 100.0, t->cpu_p90 / 100.0, t->cpu_p99 / 100.0, t->cpu_max / 100.0);
+        for (i = 0; i < FLEET_CPU_BUCKETS; i++)
+            used = stats_append(buf, used, room, ",%u", t->cpu_hist[i]);
+        return stats_append(buf, used, room, ",%llu,%llu,%llu", t->datagrams, t->foreign, t->overflow);
+    }
+    used = stats_append(buf, 0, room, "{\"time\":%lu,\"hosts\":%u,\"online\":%u,\"offline\":%u,"
+        "\"rx_bytes_per_sec\":%llu,\"tx_bytes_per_sec\":%llu,\"load1\":%.2f,\"cpu_hosts\":%u,"
+        "\"cpu_p50\":%.2f,\"cpu_p90\":%.2f,\"cpu_p99\":%.2f,\"cpu_max\":%.2f,\"cpu_hist\":[",
+        t->time, t->hosts, t->online, t->offline, t->rx, t->tx, t->load / 100.0,
+        t->cpu_hosts, t->cpu_p50 / 100.0, t->cpu_p90 / 100.0, t->cpu_p99 / 100.0, t->cpu_max / 100.0);
+    for (i = 0; i < FLEET_CPU_BUCKETS; i++)
+        used = stats_append(buf, used, room, i ? ",%u" : "%u", t->cpu_hist[i]);
+    return stats_append(buf, used, room, "],\"heartbeats\":%llu,\"foreign\":%llu,\"overflow\":%llu",
+        t->datagrams, t->foreign, t->overflow);
+}
+
+/* snapshot: aggregates and every host, replaced at once (rename);
+ * stream: aggregates appended */
+void fleet_write(struct fleet *fl, struct fleet_totals *t) {
+    char tmp[LOCK_FILE_NAME_LEN + 8], line[512], cpu[16];
+    unsigned long long now = clock_ns();
+    unsigned int i;
+    struct fleet_host *host;
+    struct fleet_sample *s;
+    struct in_addr a;
+    FILE *f;
+    snprintf(tmp, sizeof(tmp), "%s.tmp", fl->path);
+    if (!(f = fopen(fl->stream ? fl->path : tmp, fl->stream ? "a" : "w"))) {
+        log("fleet file %s Error #%d: %s", fl->stream ? fl->path : tmp, errno, strerror(errno));
+        return;
+    }
+    fleet_totals_line(fl, t, line, sizeof(line));
+    if (fl->csv && (!fl->stream || 0 == ftell(f)))
+        fprintf(f, "%stime,hosts,online,offline,rx_bytes_per_sec,tx_bytes_per_sec,load1,cpu_hosts,"
+            "cpu_p50,cpu_p90,cpu_p99,cpu_max,cpu_0_10,cpu_10_20,cpu_20_30,cpu_30_40,cpu_40_50,"
+            "cpu_50_60,cpu_60_70,cpu_70_80,cpu_80_90,cpu_90_100,heartbeats,foreign,overflow\n",
+            fl->stream ? "" : "# ");
+    if (fl->stream) {
+        fprintf(f, fl->csv ? "%s\n" : "%s}\n", line);
+        fclose(f);
+        return;
+    }
+    if (fl->csv)
+        fprintf(f, "# %s\nname,ip,online,age_ms,seq,time,cpu,load1,rx_bytes_per_sec,tx_bytes_per_sec\n", line);
+    else
+        fprintf(f, "%s,\"host\":[", line);
+    for (i = 0; i < t->hosts; i++) {
+        host = fl->list[i];
+        a.s_addr = htonl(host->ip);
+        s = fleet_latest(fl, host);
+        if (s && FLEET_CPU_NONE != s->cpu)
+            snprintf(cpu, sizeof(cpu), "%.2f", s->cpu / 100.0);
+        else
+            strcpy(cpu, fl->csv ? "" : "null");
+        fprintf(f, fl->csv ? "%s%s,%s,%d,%llu,%u,%u,%s,%.2f,%llu,%llu\n" :
+            "%s\n{\"name\":\"%s\",\"ip\":\"%s\",\"online\":%d,\"age_ms\":%llu,\"seq\":%u,\"time\":%u,"
+            "\"cpu\":%s,\"load1\":%.2f,\"rx_bytes_per_sec\":%llu,\"tx_bytes_per_sec\":%llu}",
+            fl->csv ? "" : (i ? "," : ""), host->name, inet_ntoa(a), fleet_online(host, now),
+            (now - host->seen_ns) / 1000000, s ? s->seq : 0, s ? s->time : 0, cpu,
+            s ? s->load / 100.0 : 0.0, s ? s->rx : 0, s ? s->tx : 0);
+    }
+    if (!fl->csv)
+        fprintf(f, "]}\n");
+    if (fclose(f) || rename(tmp, fl->path))
+        log("fleet file %s Error #%d: %s", fl->path, errno, strerror(errno));
+}
+
+/* "seq time cpu load1 rx tx" per sample of host, oldest first */
+int fleet_history(struct fleet *fl, char *name, char *buf, int room) {
+    unsigned int i, k, nr, head;
+    int used = 0;
+    struct fleet_host *host = 0;
+    struct fleet_sample *s;
+    for (i = 0; i < fl->hosts_nr && !host; i++)
+        if (!strcmp(fl->list[i]->name, name))
+            host = fl->list[i];
+    if (!host)
+        return stats_append(buf, 0, room, "error: host %s not seen", name);
+    nr = host->nr;
+    head = host->head;
+    used = stats_append(buf, 0, room, "ok\n# seq time cpu load1 rx_bytes_per_sec tx_bytes_per_sec\n");
+    for (i = 0; i < nr && used < room - 1; i++) {
+        k = (head + fl->history + 1 - nr + i) % fl->history;
+        s = host->ring + k;
+        if (FLEET_CPU_NONE == s->cpu)
+            used = stats_append(buf, used, room, "%u %u - %.2f %llu %llu\n",
+                s->seq, s->time, s->load / 100.0, s->rx, s->tx);
+        else
+            used = stats_append(buf, used, room, "%u %u %.2f %.2f %llu %llu\n",
+                s->seq, s->time, s->cpu / 100.0, s->load / 100.0, s->rx, s->tx);
+    }
+    return used;
+}
+
+/* THREAD PROCEDURE OF FLEET COLLECTOR: heartbeats in bulk off SO_REUSEPORT socket */
+void* fleet_collector(void *thread_arg) {
+    struct fleet_rx *rx = (struct fleet_rx*)thread_arg;
+    const int rcvbuf = RX_RCVBUF;
+    struct mmsghdr msgs[FLEET_BATCH];
+    struct iovec iov[FLEET_BATCH];
+    unsigned char *bufs;
+    unsigned long long now;
+    int sock, n, i;
+    /* senders of IPv4 and IPv6 alike: host is known by its heartbeat */
+    if (0 > (sock = bind_any(SOCK_DGRAM, fleet.port))) {
+        log("collector bind() port %d Error #%d: %s", fleet.port, errno, strerror(errno));
+        return 0;
+    }
+    /* heartbeats of a fleet come in bursts */
+    if (0 > setsockopt(sock, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof(rcvbuf)))
+        setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    if (!(bufs = (unsigned char*)malloc(FLEET_BATCH * HB_DGRAM_MAX))) {
+        log("ERROR: allocate collector batch");
+        close(sock);
+        return 0;
+    }
+    memset(msgs, 0, sizeof(msgs));
+    for (i = 0; i < FLEET_BATCH; i++) {
+        iov[i].iov_base = bufs + i * HB_DGRAM_MAX;
+        iov[i].iov_len = HB_DGRAM_MAX;
+        msgs[i].msg_hdr.msg_iov = iov + i;
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    while (1) {
+        n = recvmmsg(sock, msgs, FLEET_BATCH, MSG_WAITFORONE, 0);
+        if (0 >= n)
+            continue;
+        now = clock_ns();
+        for (i = 0; i < n; i++) {
+            /* longer than any heartbeat: cut off */
+            if (msgs[i].msg_hdr.msg_flags & MSG_TRUNC)
+                rx->foreign++;
+            else
+                fleet_account(&fleet, rx, bufs + i * HB_DGRAM_MAX, msgs[i].msg_len, now);
+        }
+    }
+    return 0;
+}
+
+/* THREAD PROCEDURE OF FLEET EXPORTER: aggregates every 'every' seconds */
+void* fleet_exporter(void *thread_arg) {
+    struct fleet *fl = (struct fleet*)thread_arg;
+    struct fleet_totals t;
+    unsigned long long deadline = clock_ns();
+    while (1) {
+        deadline += (unsigned long long)fl->every * NANOSEC_PER_SEC;
+        sleep_until_ns(deadline);
+        fleet_aggregate(fl, &t);
+        fl->last = t;
+        fleet_write(fl, &t);
+    }
+    return 0;
+}
+#endif
+
+/* RUNTIME CONTROL */
+/* CPU thread in slot 'i', parameters are taken from lists round-robin */
+int cpu_thread_start(int i, pthread_t *thread) {
+    struct cpu_load_info *info = cpu_loaders + i;
+    char name[16];
+    info->phases = control.phases;
+    /* targets list is applied to threads round-robin */
+    info->util = control.util_nr ? control.util[i % control.util_nr] : 100;
+    info->period = control.period;
+    info->achieved = 0;
+    info->ops_per_sec = 0;
+    info->kernel = control.kernel_nr ? control.kernel[i % control.kernel_nr] : cpu_kernels;
+    info->stats = gen_stats + i;
+    info->quit = 0;
+    info->running = 1;
+    snprintf(name, sizeof(name), "cpu#%d", i);
+    strcpy(info->stats->name, name);
+    log("CPU thread # %d: kernel %s %.2f%% of %u usec", i, info->kernel->name,
+        info->util, info->period);
+    return place_create(thread, cpuloader, (void*)info, name, 0);
+}
+
+/* "<pct>[,<pct>...]" => control.util; returns number of targets, -1 if invalid
+ * (anything but numbers 0-100, at most CPU_UTIL_TARGETS_MAX of them) */
+int ctl_parse_util(char *str) {
+    double util[CPU_UTIL_TARGETS_MAX];
+    char *end;
+    int nr;
+    for (nr = 0; *str; nr++) {
+        if (CPU_UTIL_TARGETS_MAX == nr)
+            return -1;
+        util[nr] = strtod(str, &end);
+        if (end == str || !(util[nr] >= 0 && util[nr] <= 100) || (*end && ',' != *end))
+            return -1;
+        str = end;
+        if (',' == *str && !*++str)
+            return -1;
+    }
+    memcpy(control.util, util, nr * sizeof(double));
+    control.util_nr = nr;
+    return nr;
+}
+
+/* "cpu|net|mem|disk|all" => bit mask of load classes */
+int ctl_parse_classes(char *str) {
+    int c;
+    if (!str || !strcmp(str, "all"))
+        return (1 << LOAD_CLASSES) - 1;
+    for (c = 0; c < LOAD_CLASSES; c++)
+        if (!strcmp(str, load_class_names[c]))
+            return 1 << c;
+    return 0;
+}
+
 /*
- * Host statistic in the format:
- * {
- * char CODE - ('S' - os name; 'C' - cpu stats; 'N' - network stats)
- * char '\0'
- * char DATA[]
- * char '\0'
- * }
+ * Execute one command, reply is "ok ..." or "error: ..."
+ *   cpu <threads>             add or remove CPU threads
+ *   util <pct>[,<pct>...]     CPU utilization per thread (100 => busy loop)
+ *   rate <bytes/sec>          net load per destination (0 => -d interval)
+ *   size <bytes>              UDP message size
+ *   delay <usec>              interval between packets without rate
+ *   mem|disk <bytes/sec>      memory or disk load in total (0 => unpaced)
+ *   phases <active> <sleep>   schedule of all loads (0 0 => continuous)
+ *   pause|resume [cpu|net|mem|disk|all]
+ *   stats                     counters of all generator threads
+ *   fleet [<host>]            collector aggregates, or samples of host
  */
-unsigned int fill_stats(char *buf, unsigned int buf_size) {
-    int fd, cpu_stat_size, net_stat_size;
-    /* TODO include timestamp: time_t t = time(0); */
-    /* TODO: put each stats in its own procedure */
-    /* code */
-    buf[0] = 'C';
-    buf[1] = '\0';
-    buf += 2;
-    fd = -1;
-#ifdef __linux__
-    /* cpu stats */
-    fd = open ("/proc/loadavg", O_RDONLY);
-    if (-1 == fd) {
-        return -2;
+int ctl_execute(char *cmd, char *reply, int room) {
+    char *verb, *arg, *arg2, *save = 0;
+    pthread_t thread;
+    long int v, v2;
+    int i, n, used = 0, changed = 0;
+    verb = strtok_r(cmd, " \t\r\n", &save);
+    arg = strtok_r(0, " \t\r\n", &save);
+    arg2 = strtok_r(0, " \t\r\n", &save);
+    if (!verb)
+        return stats_append(reply, 0, room, "error: empty command");
+    if (!strcmp(verb, "stats")) {
+        used = stats_append(reply, 0, room, "ok\n");
+        for (i = 0; i < gen_stats_count() && used < room - 1; i++) {
+            used += gen_stats_line(gen_stats_at(i), reply + used, room - used);
+            used = stats_append(reply, used, room, "\n");
+        }
+#if defined(__linux__)
+        for (i = 0; i < rx_receivers_nr * RX_FLOWS_MAX && used < room - 1; i++) {
+            if (!rx_flow_at(i))
+                continue;
+            used = stats_append(reply, used, room, "flow ");
+            used += rx_flow_line(rx_flow_at(i), reply + used, room - used);
+            used = stats_append(reply, used, room, "\n");
+        }
+        for (i = 0; i < rpc_loaders_nr && used < room - 1; i++) {
+            used = stats_append(reply, used, room, "rpc ");
+            used += rpc_stats_line(rpc_loaders + i, reply + used, room - used);
+            used = stats_append(reply, used, room, "\n");
+        }
+        for (i = 0; i < rx_receivers_nr; i++)
+            if (rx_receivers[i].answered)
+                used = stats_append(reply, used, room, "answered %s %llu\n",
+                    rx_receivers[i].name, rx_receivers[i].answered);
+        for (i = 0; i < tcp_sinks_nr; i++)
+            if (tcp_sinks[i].answered)
+                used = stats_append(reply, used, room, "answered %s %llu\n",
+                    tcp_sinks[i].name, tcp_sinks[i].answered);
+        for (i = 0; i < tcp_loaders_nr + tcp_sinks_nr && used < room - 1; i++) {
+            used = stats_append(reply, used, room, "tcp ");
+            used += tcp_stats_line(i, reply + used, room - used);
+            used = stats_append(reply, used, room, "\n");
+        }
+        if (TARGET_NONE != target.kind)
+            used = stats_append(reply, used, room, "target %s goal %.2f measured %.2f output %.3f\n",
+                target_names[target.kind], target.goal, target.measured, target.out);
+#endif
+        if (profile.nr)
+            used = stats_append(reply, used, room, "profile %s segment %d/%d at %.1f of %.1f sec\n",
+                profile.path, profile.cur + 1, profile.nr, profile.at, profile.total);
+        if (phase_sync.period && used < room - 1) {
+            used += sync_stats_line(&phase_sync, reply + used, room - used);
+            used = stats_append(reply, used, room, "\n");
+        }
+        return used;
     }
-    cpu_stat_size = read (fd, buf, buf_size - 2);
-    (void) close (fd);
-    if (cpu_stat_size <= 0 ) {
-        return -4;
+    if (!strcmp(verb, "pause") || !strcmp(verb, "resume")) {
+        if (!(n = ctl_parse_classes(arg)))
+            return stats_append(reply, 0, room, "error: pause|resume [cpu|net|mem|disk|all]");
+        pthread_mutex_lock(&control.lock);
+        for (i = 0; i < LOAD_CLASSES; i++)
+            if ((n & (1 << i)) && control.paused[i] != ('p' == verb[0])) {
+                control.paused[i] = ('p' == verb[0]);
+                control.gen[i]++;
+            }
+        pthread_cond_broadcast(&control.changed);
+        pthread_mutex_unlock(&control.lock);
+        return stats_append(reply, 0, room, "ok");
     }
-#endif
-#ifdef __FreeBSD__
-    int mib[2];
-    size_t len;
-    struct loadavg lavg;
-    mib[0] = CTL_VM; mib[1] = VM_LOADAVG;
-    len = sizeof(struct loadavg);
-    sysctl(mib, 2, &lavg, &len, 0, 0);
-    cpu_stat_size = sprintf(buf, "%.2f %.2f %.2f ", 
-                    ((float)lavg.ldavg[0]) / ((float)lavg.fscale),
-                    ((float)lavg.ldavg[1]) / ((float)lavg.fscale),
-                    ((float)lavg.ldavg[2]) / ((float)lavg.fscale ));
-    if (0 >= cpu_stat_size) {
-        return -1;
+#if defined(__linux__)
+    if (!strcmp(verb, "fleet")) {
+        if (!fleet.rx_nr)
+            return stats_append(reply, 0, room, "error: not a fleet collector (-G)");
+        if (arg)
+            return fleet_history(&fleet, arg, reply, room);
+        used = stats_append(reply, 0, room, "ok\n");
+        used += fleet_totals_line(&fleet, &fleet.last, reply + used, room - used);
+        return stats_append(reply, used, room, fleet.csv ? "" : "}");
     }
 #endif
-#if !defined(__linux__) && !defined(__FreeBSD__)
-    strncpy(buf, stub_msg, STUB_MSG_SIZE);
-    cpu_stat_size = STUB_MSG_SIZE;
+    if (!arg)
+        return stats_append(reply, 0, room, "error: %s needs a value", verb);
+    pthread_mutex_lock(&control.lock);
+    if (!strcmp(verb, "cpu")) {
+        n = atoi(arg);
+        if (n < 0 || n > CPU_THREADS_MAX) {
+            used = stats_append(reply, 0, room, "error: cpu 0..%d", CPU_THREADS_MAX);
+        }
+        else {
+            for (i = cpu_loaders_nr; i < n; i++) {
+                /* removed thread which has not noticed it yet stays */
+                if (cpu_loaders[i].running)
+                    cpu_loaders[i].quit = 0;
+                else if (0 == cpu_thread_start(i, &thread))
+                    pthread_detach(thread);
+                else
+                    break;
+            }
+            if (n > cpu_loaders_nr)
+                n = i;
+            for (i = n; i < cpu_loaders_nr; i++)
+                cpu_loaders[i].quit = 1;
+            cpu_loaders_nr = n;
+            changed = 1 << LOAD_CPU;
+            used = stats_append(reply, 0, room, "ok cpu %d", n);
+        }
+    }
+    else if (!strcmp(verb, "util")) {
+        if (0 >= ctl_parse_util(arg)) {
+            used = stats_append(reply, 0, room, "error: util <pct>[,<pct>...] 0-100");
+        }
+        else {
+            for (i = 0; i < cpu_loaders_nr; i++)
+                cpu_loaders[i].util = control.util[i % control.util_nr];
+            changed = 1 << LOAD_CPU;
+            used = stats_append(reply, 0, room, "ok");
+        }
+    }
+    else if (!strcmp(verb, "rate") || !strcmp(verb, "delay")) {
+        v = str2long(arg);
+        if (v < 0) {
+            used = stats_append(reply, 0, room, "error: %s must be positive", verb);
+        }
+        else {
+            for (i = 0; i < udp_senders_nr; i++) {
+                if ('r' == verb[0])
+                    udp_senders[i].rate = v;
+                else
+                    udp_senders[i].delay = v;
+            }
+#if defined(__linux__)
+            /* raw threads share one destination */
+            for (i = 0; i < raw_senders_nr; i++) {
+                if ('r' == verb[0])
+                    raw_senders[i].rate = v / raw_senders_nr;
+                else
+                    raw_senders[i].delay = v * raw_senders_nr;
+            }
+            /* TCP threads share all destinations */
+            for (i = 0; 'r' == verb[0] && i < tcp_loaders_nr; i++)
+                tcp_loaders[i].rate = v * tcp_loaders[i].hosts_nr / tcp_loaders_nr;
+            for (i = 0; i < sched_workers_nr; i++) {
+                if ('r' == verb[0])
+                    sched_workers[i].rate = v;
+                else
+                    sched_workers[i].delay = v;
+            }
 #endif
-    buf[cpu_stat_size] = '\0';
-    buf += cpu_stat_size + 1;
-    /* network stats */
-    buf[0] = 'N';
-    buf[1] = '\0';
-    buf += 2;
-#ifdef __linux__
-    fd = open ("/proc/net/dev", O_RDONLY);
-    if (-1 == fd) {
-        return -5;
+            changed = 1 << LOAD_NET;
+            used = stats_append(reply, 0, room, "ok");
+        }
     }
-    net_stat_size = read (fd, buf, buf_size - cpu_stat_size - 5);
-    (void) close (fd);
-    if (net_stat_size <= 0 ) {
-        return -7;
+    else if (!strcmp(verb, "mem") || !strcmp(verb, "disk")) {
+        v = str2long(arg);
+        if (v < 0) {
+            used = stats_append(reply, 0, room, "error: %s must be positive", verb);
+        }
+        else {
+            for (i = 0; 'm' == verb[0] && i < mem_loaders_nr; i++)
+                mem_loaders[i].rate = v / mem_loaders_nr;
+            for (i = 0; 'd' == verb[0] && i < disk_loaders_nr; i++)
+                disk_loaders[i].rate = v / disk_loaders_nr;
+            changed = 1 << ('m' == verb[0] ? LOAD_MEM : LOAD_DISK);
+            used = stats_append(reply, 0, room, "ok");
+        }
     }
-#else
-    strncpy(buf, stub_msg, STUB_MSG_SIZE);
-    net_stat_size = STUB_MSG_SIZE;
+    else if (!strcmp(verb, "size")) {
+        v = str2long(arg);
+        if (v < PROBE_SIZE || v > UDP_PING_MSG_SIZE_MAX) {
+            used = stats_append(reply, 0, room, "error: size %d..%d", PROBE_SIZE, UDP_PING_MSG_SIZE_MAX);
+        }
+        else {
+            for (i = 0; i < udp_senders_nr; i++)
+                udp_senders[i].msg_size = v;
+#if defined(__linux__)
+            for (i = 0; i < sched_workers_nr; i++)
+                sched_workers[i].msg_size = v;
 #endif
-    buf[net_stat_size] = '\0';
-    buf += net_stat_size + 1;
-    /* os name */
-    buf[0] = 'S';
-    buf[1] = '\0';
-    buf += 2;
-    strncpy(buf, os_name, OS_NAME_LEN);
-    buf[OS_NAME_LEN + 1] = '\0';
-    return cpu_stat_size + net_stat_size + OS_NAME_LEN + 3*3;
+            /* Ethernet frames are built once at start */
+            changed = 1 << LOAD_NET;
+            used = stats_append(reply, 0, room, "ok (UDP senders only)");
+        }
+    }
+    else if (!strcmp(verb, "phases")) {
+        v = str2long(arg);
+        v2 = arg2 ? str2long(arg2) : v;
+        if (v < 0 || v2 < 0 || (!v != !v2)) {
+            used = stats_append(reply, 0, room, "error: phases <active> <sleep>, both or none 0");
+        }
+        /* -J: cycle on wall clock boundaries (msec, as -J) changes under
+         * lock, runner notices; the wave keeps its offset + index * step */
+        else if (phase_sync.period) {
+            if (!v) {
+                used = stats_append(reply, 0, room, "error: -J phases can not be 0");
+            }
+            else {
+                phase_sync.active = (unsigned long long)v * 1000000;
+                phase_sync.period = (unsigned long long)(v + v2) * 1000000;
+                phase_sync.offset = phase_sync.shift % phase_sync.period;
+                used = stats_append(reply, 0, room, "ok (msec)");
+            }
+        }
+        else {
+            control.phases.active = v;
+            control.phases.sleep = v2;
+            for (i = 0; i < CPU_THREADS_MAX && cpu_loaders; i++)
+                cpu_loaders[i].phases = control.phases;
+            for (i = 0; i < mem_loaders_nr; i++)
+                mem_loaders[i].phases = control.phases;
+            for (i = 0; i < disk_loaders_nr; i++)
+                disk_loaders[i].phases = control.phases;
+            for (i = 0; i < udp_senders_nr; i++)
+                udp_senders[i].phases = control.phases;
+#if defined(__linux__)
+            for (i = 0; i < raw_senders_nr; i++)
+                raw_senders[i].phases = control.phases;
+            for (i = 0; i < sched_workers_nr; i++)
+                sched_workers[i].phases = control.phases;
+#endif
+            changed = (1 << LOAD_CLASSES) - 1;
+            used = stats_append(reply, 0, room, "ok");
+        }
+    }
+    else {
+        used = stats_append(reply, 0, room, "error: unknown command %s", verb);
+    }
+    /* only classes changed start over: errors restart nothing */
+    for (i = 0; i < LOAD_CLASSES; i++)
+        if (changed & (1 << i))
+            control.gen[i]++;
+    if (changed)
+        pthread_cond_broadcast(&control.changed);
+    pthread_mutex_unlock(&control.lock);
+    return used;
 }
 
-/* THREAD PROCEDURE FOR CPU LOAD */
-void* cpuloader(void *thread_arg) {
-    unsigned short i, i1, i2;
-    int vector[VECTOR_SIZE];
-    unsigned long int its_time = 0;
-    struct schedule *sch = (struct schedule *)thread_arg;
-    pthread_mutex_lock( &mutex_ini );
-    srand(time(0));
-    for (i = 0; i < VECTOR_SIZE; i++) {
-        vector[i] = rand();
+/* sender of UDP command is master host, IPv4 or IPv6 */
+int ctl_from_master(struct sockaddr_storage *from) {
+    if (from->ss_family != control.master.ss_family)
+        return 0;
+    if (AF_INET6 == from->ss_family)
+        return !memcmp(&((struct sockaddr_in6*)from)->sin6_addr,
+                       &((struct sockaddr_in6*)&control.master)->sin6_addr, sizeof(struct in6_addr));
+    return ((struct sockaddr_in*)from)->sin_addr.s_addr ==
+           ((struct sockaddr_in*)&control.master)->sin_addr.s_addr;
+}
+
+/* THREAD PROCEDURE FOR CONTROL COMMANDS: local socket and UDP from master */
+void* ctl_receiver(void *thread_arg) {
+    struct pollfd pfd[2];
+    struct sockaddr_storage from;
+    socklen_t from_len;
+    char msg[CTL_MSG_MAX], reply[CTL_MSG_MAX], peer[INET6_ADDRSTRLEN] = "?";
+    int i, n, nfds = 1;
+    pfd[0].fd = control.unix_sock;
+    pfd[0].events = POLLIN;
+    if (0 <= control.udp_sock) {
+        pfd[1].fd = control.udp_sock;
+        pfd[1].events = POLLIN;
+        nfds = 2;
     }
-    pthread_mutex_unlock( &mutex_ini );
-    i = 0;
-    /* eternal loop */
     while (1) {
-        if (sch->sleep) {
-            its_time = time(0) + sch->active;
+        if (0 >= poll(pfd, nfds, -1))
+            continue;
+        for (i = 0; i < nfds; i++) {
+            if (!(pfd[i].revents & POLLIN))
+                continue;
+            from_len = sizeof(from);
+            n = recvfrom(pfd[i].fd, msg, sizeof(msg) - 1, 0, (struct sockaddr*)&from, &from_len);
+            if (n <= 0)
+                continue;
+            msg[n] = '\0';
+            /* UDP port is open with master only */
+            if (1 == i && !ctl_from_master(&from)) {
+                inet_ntop(from.ss_family, AF_INET6 == from.ss_family
+                    ? (void*)&((struct sockaddr_in6*)&from)->sin6_addr
+                    : (void*)&((struct sockaddr_in*)&from)->sin_addr, peer, sizeof(peer));
+                log("Control: command from %s ignored", peer);
+                continue;
+            }
+            log("Control: %s", msg);
+            n = ctl_execute(msg, reply, sizeof(reply));
+            /* unbound local client gets no reply */
+            if (from_len > sizeof(sa_family_t))
+                (void)sendto(pfd[i].fd, reply, n, 0, (struct sockaddr*)&from, from_len);
         }
-        /* active phase */
-        while (sch->sleep ? (time(0) < its_time) : 1) {
-            i1 = i % VECTOR_SIZE;
-            i2 = (i + 1) % VECTOR_SIZE;
-            vector[i1] ^= vector[i2];
-            vector[i1] *= 17;
-            vector[i1] |= vector[i2];
-            i++;
+    }
+    return 0;
+}
+
+/* control sockets of daemon; 0 on success */
+int ctl_open(int udp_port, char *master_host) {
+    struct sockaddr_un su;
+    struct sockaddr_storage sa;
+    socklen_t sa_len;
+    control.udp_sock = -1;
+    memset(&su, 0, sizeof(su));
+    su.sun_family = AF_UNIX;
+    memcpy(su.sun_path, control.path, CTL_PATH_LEN);
+    unlink(control.path);
+    if (0 > (control.unix_sock = socket(AF_UNIX, SOCK_DGRAM, 0)) ||
+            0 > bind(control.unix_sock, (struct sockaddr*)&su, sizeof(su))) {
+        log("control socket %s Error #%d: %s", control.path, errno, strerror(errno));
+        return -1;
+    }
+    chmod(control.path, S_IRUSR|S_IWUSR|S_IRGRP|S_IWGRP);
+    if (!udp_port)
+        return 0;
+    /* only master host may command: no UDP port without one */
+    if (!master_host || !resolve_addr(master_host, 0, &control.master) ||
+            (AF_INET != control.master.ss_family && AF_INET6 != control.master.ss_family)) {
+        log("control UDP port %d: master host %s not resolved", udp_port,
+            master_host ? master_host : "(none)");
+        return -1;
+    }
+    /* port is of master's family, on any address */
+    memset(&sa, 0, sizeof(sa));
+    sa.ss_family = control.master.ss_family;
+    if (AF_INET6 == sa.ss_family) {
+        ((struct sockaddr_in6*)&sa)->sin6_port = htons(udp_port);
+        sa_len = sizeof(struct sockaddr_in6);
+    }
+    else {
+        ((struct sockaddr_in*)&sa)->sin_port = htons(udp_port);
+        sa_len = sizeof(struct sockaddr_in);
+    }
+    if (0 > (control.udp_sock = socket(sa.ss_family, SOCK_DGRAM, 0)) ||
+            0 > bind(control.udp_sock, (struct sockaddr*)&sa, sa_len)) {
+        log("control UDP port %d Error #%d: %s", udp_port, errno, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/* -c: send command to running instance, print reply */
+int ctl_client(char *cmd) {
+    struct sockaddr_un su, me;
+    struct pollfd pfd;
+    char reply[CTL_MSG_MAX];
+    int sock, n;
+    memset(&su, 0, sizeof(su));
+    su.sun_family = AF_UNIX;
+    memcpy(su.sun_path, control.path, CTL_PATH_LEN);
+    memset(&me, 0, sizeof(me));
+    me.sun_family = AF_UNIX;
+    snprintf(me.sun_path, sizeof(me.sun_path), CTL_CLIENT_FORMAT, (int)getpid());
+    unlink(me.sun_path);
+    if (0 > (sock = socket(AF_UNIX, SOCK_DGRAM, 0)) ||
+            0 > bind(sock, (struct sockaddr*)&me, sizeof(me))) {
+        printf("Error: client socket #%d: %s\n", errno, strerror(errno));
+        return 1;
+    }
+    n = 1;
+    if (0 > sendto(sock, cmd, strlen(cmd), 0, (struct sockaddr*)&su, sizeof(su))) {
+        printf("Error: no instance at %s #%d: %s\n", control.path, errno, strerror(errno));
+    }
+    else {
+        pfd.fd = sock;
+        pfd.events = POLLIN;
+        if (0 < poll(&pfd, 1, 2000) && 0 < (n = recv(sock, reply, sizeof(reply) - 1, 0))) {
+            reply[n] = '\0';
+            printf("%s\n", reply);
+            n = strncmp(reply, "ok", 2) ? 1 : 0;
         }
-        /* sleep phase */
-        if (sch->sleep) {
-            sleep(sch->sleep);
+        else {
+            printf("Error: no reply from %s\n", control.path);
+            n = 1;
         }
     }
+    close(sock);
+    unlink(me.sun_path);
+    return n;
+}
+
+#if defined(__linux__)
+/* CLOSED LOOP LOAD */
+/* /proc/net/dev tx bytes and drops of target interface */
+int target_read_iface(struct target *t, unsigned long long *bytes, unsigned long long *dropped) {
+    char text[HB_PROC_BUF_SIZE], *line, *colon, *save = 0;
+    int n;
+    if (0 >= (n = pread(t->net_dev_fd, text, sizeof(text) - 1, 0)))
+        return -1;
+    text[n] = '\0';
+    /* "name: rx bytes packets errs drop fifo frame compressed multicast tx ..." */
+    for (line = strtok_r(text, "\n", &save); line; line = strtok_r(0, "\n", &save)) {
+        if (!(colon = strchr(line, ':')))
+            continue;
+        *colon++ = '\0';
+        while (' ' == *line)
+            line++;
+        if (!strcmp(line, t->iface))
+            return (2 == sscanf(colon, "%*u %*u %*u %*u %*u %*u %*u %*u %llu %*u %*u %llu",
+                bytes, dropped)) ? 0 : -1;
+    }
+    return -1;
 }
 
-/* THREAD PROCEDURE FOR SENDING UDP PACKETS */
-void* udp_sender (void *thread_arg) {
-    const int set_on = 1;
-    unsigned long int packet_size, its_time = 0;
-    struct hostent *he;
-    struct sockaddr_in sa;
-    int sock;
-    char * payload;
-    struct udp_ping_info* info = (struct udp_ping_info*)thread_arg;
-    pthread_mutex_lock( &mutex_ini );
-    sock = socket(PF_INET, SOCK_DGRAM, 0);
-    if (sock < 0) {
-        log("ERROR: create socket");
-        return 0;
+/* packets, send errors and payload bytes of all net generators */
+void target_read_senders(unsigned long long *packets, unsigned long long *errors,
+                         unsigned long long *sent) {
+    struct gen_stats *gs;
+    int i, e;
+    *packets = *errors = *sent = 0;
+    for (i = cpu_loaders_nr; i < gen_stats_count(); i++) {
+        gs = gen_stats_at(i);
+        *packets += gs->packets;
+        *sent += gs->bytes;
+        for (e = 0; e < SEND_ERRORS; e++)
+            *errors += gs->errors[e];
     }
-    /* filling socket address structure */
-    memset((char *)&sa, 0, sizeof(struct sockaddr_in));
-    sa.sin_family = AF_INET;
-    sa.sin_port = htons(info->port);
-    /* special treat for host name == 0 => SEND BROADCAST */
-    if (0 == info->host) {
-        sa.sin_addr.s_addr = INADDR_BROADCAST;
+}
+
+/*
+ * Measured value since previous call: host CPU %, interface tx bytes/sec
+ * or % of packets lost at the sender (send errors and interface drops).
+ * -1 if nothing to compare with (first call, no packets).
+ */
+double target_measure(struct target *t, double dt) {
+    unsigned long long busy = 0, total = 0, bytes = 0, dropped = 0, packets, errors, sent;
+    double v = -1;
+    int ok = 1;
+    if (TARGET_CPU == t->kind) {
+        ok = (0 == proc_read_cpu(t->stat_fd, &busy, &total));
+        if (ok && t->total && total > t->total)
+            v = 100.0 * (busy - t->busy) / (total - t->total);
+        t->busy = busy;
+        t->total = total;
+        return ok ? v : -1;
     }
-    else {
-        he = gethostbyname(info->host);
-        if ( 0 == ((char *)he) ) {
-                log("ERROR: Invalid host %s\n", info->host);
-                return 0;
+    ok = (0 == target_read_iface(t, &bytes, &dropped));
+    target_read_senders(&packets, &errors, &sent);
+    if (TARGET_TX == t->kind && ok && t->tx_bytes && dt > 0)
+        v = (bytes - t->tx_bytes) / dt;
+    if (TARGET_LOSS == t->kind && t->packets + t->errors && packets + errors > t->packets + t->errors)
+        v = 100.0 * (errors - t->errors + (ok ? dropped - t->tx_dropped : 0)) /
+            (packets - t->packets + errors - t->errors);
+    /* senders' own rate (tells if message size limits them) */
+    if (dt > 0)
+        t->sent_rate = (sent - t->sent) / dt;
+    t->tx_bytes = bytes;
+    t->tx_dropped = dropped;
+    t->packets = packets;
+    t->errors = errors;
+    t->sent = sent;
+    return v;
+}
+
+/* output => control commands, only the changed ones */
+void target_apply(struct target *t) {
+    char cmd[64], reply[CTL_MSG_MAX];
+    double threads, util, cur, rate;
+    unsigned int size, max_size;
+    int n, short_rate;
+    if (TARGET_CPU == t->kind) {
+        threads = t->out * t->max;
+        n = (int)(threads + 0.999);
+        if (n < 1)
+            n = 1;
+        util = threads / n * 100;
+        if (util > 99.5)
+            util = 100;
+        pthread_mutex_lock(&control.lock);
+        cur = control.util_nr ? control.util[0] : 100;
+        pthread_mutex_unlock(&control.lock);
+        if (util - cur > 0.05 || cur - util > 0.05) {
+            snprintf(cmd, sizeof(cmd), "util %.2f", util);
+            ctl_execute(cmd, reply, sizeof(reply));
+        }
+        if (n != cpu_loaders_nr) {
+            log("Target: %s %.2f => %d CPU threads", target_names[t->kind], t->goal, n);
+            snprintf(cmd, sizeof(cmd), "cpu %d", n);
+            ctl_execute(cmd, reply, sizeof(reply));
         }
-        /* TODO: check if there are more than 1 address */
-        /* #define h_addr  h_addr_list[0]  for backward compatibility */
-         memcpy(&(sa.sin_addr), he->h_addr, he->h_length);
+        return;
     }
-    if (sa.sin_addr.s_addr == INADDR_BROADCAST) {
-        setsockopt(sock, SOL_SOCKET, SO_BROADCAST, &set_on, sizeof(set_on));
+    /* -N is per destination */
+    rate = t->out * t->max / (udp_senders_nr ? udp_senders_nr : 1);
+    snprintf(cmd, sizeof(cmd), "rate %lu", (unsigned long int)rate + 1);
+    ctl_execute(cmd, reply, sizeof(reply));
+    if (TARGET_TX != t->kind || !udp_senders_nr)
+        return;
+    /* senders fall behind the rate for a while (not a transient or
+     * ENOBUFS burst): fewer, bigger datagrams, never fragmented;
+     * demand down to half and met: back towards the size at start */
+    size = udp_senders[0].msg_size;
+    max_size = udp_senders[0].path_payload ? udp_senders[0].path_payload : UDP_PING_MSG_SIZE_MAX;
+    if (max_size > UDP_PING_MSG_SIZE_MAX)
+        max_size = UDP_PING_MSG_SIZE_MAX;
+    if (!t->size_min)
+        t->size_min = size;
+    short_rate = t->sent_rate < 0.9 * rate * udp_senders_nr;
+    t->short_nr = short_rate ? t->short_nr + 1 : 0;
+    t->met_nr = short_rate ? 0 : t->met_nr + 1;
+    n = size;
+    if (t->short_nr >= TARGET_SIZE_SAMPLES && size < max_size) {
+        n = (size * 2 > max_size) ? max_size : size * 2;
+        t->size_rate = rate;
     }
-    payload = (char*)malloc(info->msg_size);
-    packet_size = (info->fill_buffer_procedure)(payload, info->msg_size);
-    pthread_mutex_unlock( &mutex_ini );
+    else if (t->met_nr >= TARGET_SIZE_SAMPLES && size > t->size_min && 2 * rate < t->size_rate) {
+        n = (size / 2 < t->size_min) ? t->size_min : size / 2;
+        t->size_rate /= 2;
+    }
+    if (n != size) {
+        t->short_nr = t->met_nr = 0;
+        log("Target: %s %.0f => message size %d", target_names[t->kind], t->goal, n);
+        snprintf(cmd, sizeof(cmd), "size %d", n);
+        ctl_execute(cmd, reply, sizeof(reply));
+    }
+}
 
-    /* eternal loop */
+/* THREAD PROCEDURE OF CLOSED LOOP */
+void* target_controller(void *thread_arg) {
+    struct target *t = (struct target*)thread_arg;
+    enum load_class c = (TARGET_CPU == t->kind) ? LOAD_CPU : LOAD_NET;
+    unsigned long long deadline, prev, now;
+    double v, e, dt, scale;
+    t->measured = -1;
+    t->stat_fd = open("/proc/stat", O_RDONLY);
+    t->net_dev_fd = open("/proc/net/dev", O_RDONLY);
+    /* full scale of measured value, so that plant gain is about 1 */
+    scale = (TARGET_CPU == t->kind) ? 100 : (TARGET_TX == t->kind) ? t->max : TARGET_LOSS_SCALE;
+    target_measure(t, 0);
+    prev = deadline = clock_ns();
     while (1) {
-        if (info->phases.sleep) {
-            its_time = time(0) + info->phases.active;
-        }
-        while (info->phases.sleep ? (time(0) < its_time) : 1) {
-            pthread_mutex_lock( &mutex_send );
-            (void)sendto(sock, payload, packet_size,
-                0, (struct sockaddr *) &sa, sizeof(struct sockaddr));
-            pthread_mutex_unlock( &mutex_send );
-            usleep(info->delay);
-            if (info->update_every_packet) {
-                packet_size = (info->fill_buffer_procedure)(payload, info->msg_size);
-            }
-        }
-        if (info->phases.sleep) {
-            sleep(info->phases.sleep);
-        }
+        deadline += (unsigned long long)t->period * 1000000;
+        sleep_until_ns(deadline);
+        now = clock_ns();
+        dt = (double)(now - prev) / NANOSEC_PER_SEC;
+        prev = now;
+        v = target_measure(t, dt);
+        /* paused load is not measured: loop would wind up */
+        if (ctl_stopped(c) || v < 0)
+            continue;
+        t->measured = v;
+        /* positive => more load (loss grows with load too) */
+        e = (t->goal - v) / scale;
+        if (e > 1)
+            e = 1;
+        if (e < -1)
+            e = -1;
+        /* incremental form: clamping the output is the anti-windup */
+        t->out += t->kp * (e - t->err[0]) + t->ki * e * dt +
+                  t->kd * (e - 2 * t->err[0] + t->err[1]) / dt;
+        t->err[1] = t->err[0];
+        t->err[0] = e;
+        if (t->out > 1)
+            t->out = 1;
+        if (t->out < TARGET_OUT_MIN)
+            t->out = TARGET_OUT_MIN;
+        target_apply(t);
     }
-    close(sock);
-    free(payload);
+    return 0;
 }
+#endif
 
-/* THREAD PROCEDURE FOR SENDING RAW ETHERNET PACKETS */
-#if defined(__linux__)
-void* raw_sender (void *thread_arg) {
-    struct sockaddr_ll target_addr;
-    int raw_sock = 0, if_index;
-    unsigned long int packet_size, its_time = 0;
-    char *packet, *payload;
-    struct ethhdr *packet_header;
+/* LOAD PROFILE */
+/* "<number>[K|M|G]", durations "<number>[s|m|h|d]"; -1 if invalid */
+double profile_number(char *str, char **end, int duration) {
+    double v = strtod(str, end);
+    if (*end == str || v < 0)
+        return -1;
+    switch (**end) {
+    case 'K':
+    case 'M':
+    case 'G':
+        if (duration)
+            return -1;
+        v *= ('K' == **end) ? 1024.0 : ('M' == **end) ? 1048576.0 : 1073741824.0;
+        (*end)++;
+        break;
+    case 's':
+    case 'm':
+    case 'h':
+    case 'd':
+        if (!duration)
+            return -1;
+        v *= ('s' == **end) ? 1 : ('m' == **end) ? 60 : ('h' == **end) ? 3600 : 86400;
+        (*end)++;
+        break;
+    }
+    return v;
+}
 
-    struct raw_ping_info *info = (struct raw_ping_info*)thread_arg;
-    packet = (char*) malloc(info->msg_size + ETH_HLEN);
-    packet_header = (struct ethhdr *)packet;
-    payload = packet + ETH_HLEN;
-    if (0 > (raw_sock = socket(PF_PACKET, SOCK_RAW, htons(ETH_P_ALL)))) {
-        log("socket() Error #%d: %s\n", errno, strerror(errno));
-        return 0;
+/* "key=a[..b|~b]" or "period=", "steps=" of segment; 0 on success */
+int profile_level(struct profile_segment *sg, char *word) {
+    char *eq = strchr(word, '='), *end;
+    int k;
+    if (!eq)
+        return -1;
+    *eq++ = '\0';
+    if (!strcmp(word, "period"))
+        return (0 < (sg->period = profile_number(eq, &end, 1)) && !*end) ? 0 : -1;
+    if (!strcmp(word, "steps"))
+        return (1 < (sg->steps = (unsigned int)atoi(eq))) ? 0 : -1;
+    for (k = 0; k < PROF_KEYS && strcmp(word, profile_keys[k]); k++)
+        ;
+    /* strtod() would take "1..2" as "1." */
+    if ((word = strstr(eq, "..")))
+        *word = '\0';
+    if (PROF_KEYS == k || 0 > (sg->a[k] = profile_number(eq, &end, 0)))
+        return -1;
+    /* plain level holds for the whole segment of any shape */
+    sg->b[k] = (SHAPE_SINE == sg->shape || SHAPE_WALK == sg->shape) ? 0 : sg->a[k];
+    if (word && (*end || (SHAPE_RAMP != sg->shape && SHAPE_STEP != sg->shape) ||
+            0 > (sg->b[k] = profile_number(word + 2, &end, 0))))
+        return -1;
+    if ('~' == *end && ((SHAPE_SINE != sg->shape && SHAPE_WALK != sg->shape) ||
+            0 > (sg->b[k] = profile_number(end + 1, &end, 0))))
+        return -1;
+    if (*end || (PROF_CPU == k && (sg->a[k] > 100 || sg->b[k] > 100)))
+        return -1;
+    sg->set[k] = 1;
+    return 0;
+}
+
+/*
+ * Profile file: one segment per line "<duration> <shape> <key>=<level> ...",
+ * directives "speed <x>" and "loop", '#' starts a comment.
+ * Returns 0 on success, prints what is wrong otherwise.
+ */
+int profile_load(struct profile *pr, char *path) {
+    FILE *f = fopen(path, "r");
+    char line[PROFILE_LINE_MAX], *word, *save, *end;
+    struct profile_segment *sg;
+    int n = 0, k;
+    if (!f) {
+        printf("Error: can not open profile %s\n", path);
+        return -1;
     }
-    /* fill address */
-    memset(&target_addr, 0, sizeof (struct sockaddr_ll));
-    target_addr.sll_family = PF_PACKET;
-    target_addr.sll_protocol = htons(ETH_P_IP);
-    /* index of the network device lo - 1; eth0 - 2
-     * TODO: calculate index */
-    if_index = get_first_suitable_if();
-    if (0 > if_index) {
-        log("Error: no suitable (RUNNING) iface found");
-        return 0;
+    pr->path = path;
+    pr->speed = 1;
+    pr->seg = (struct profile_segment*)calloc(PROFILE_SEGMENTS_MAX, sizeof(struct profile_segment));
+    while (pr->seg && fgets(line, sizeof(line), f)) {
+        n++;
+        if ((word = strchr(line, '#')))
+            *word = '\0';
+        if (!(word = strtok_r(line, " \t\r\n", &save)))
+            continue;
+        if (!strcmp(word, "loop")) {
+            pr->loop = 1;
+            continue;
+        }
+        if (!strcmp(word, "speed")) {
+            word = strtok_r(0, " \t\r\n", &save);
+            if (!word || 0 >= (pr->speed = strtod(word, &end)) || *end)
+                break;
+            continue;
+        }
+        if (PROFILE_SEGMENTS_MAX == pr->nr)
+            break;
+        sg = pr->seg + pr->nr;
+        if (0 >= (sg->duration = profile_number(word, &end, 1)) || *end)
+            break;
+        if (!(word = strtok_r(0, " \t\r\n", &save)))
+            break;
+        for (k = 0; k < SHAPE_NR && strcmp(word, profile_shapes[k]); k++)
+            ;
+        if (SHAPE_NR == k)
+            break;
+        sg->shape = k;
+        sg->steps = 2;
+        while ((word = strtok_r(0, " \t\r\n", &save)) && 0 == profile_level(sg, word))
+            ;
+        if (word)
+            break;
+        if (!sg->period)
+            sg->period = sg->duration;
+        pr->total += sg->duration;
+        pr->nr++;
     }
-    target_addr.sll_ifindex = if_index;
-    // ARP hardware identifier is ethernet
-    target_addr.sll_hatype = ARPHRD_ETHER;
-    // target is another host
-    target_addr.sll_pkttype = PACKET_OTHERHOST;
-    //address length
-    target_addr.sll_halen = ETH_ALEN;
-    memcpy(&(target_addr.sll_addr), info->target_mac, ETH_ALEN);
+    k = feof(f) && pr->nr;
+    fclose(f);
+    if (!k) {
+        printf("Error: profile %s line %d: expected \"<duration>[s|m|h|d] "
+            "const|ramp|step|sine|walk <key>=<level> ...\"\n", path, n);
+        return -1;
+    }
+    for (k = 0; k < PROF_KEYS; k++)
+        pr->pushed[k] = -1;
+    return 0;
+}
 
-    /* Ethernet Packet Header*/
-    memcpy(packet, info->target_mac, ETH_ALEN);
-    memcpy((packet + ETH_ALEN), info->source_mac, ETH_ALEN);
+/* level of key 'k' at 't' seconds into segment; 'dt' since previous tick */
+double profile_eval(struct profile_segment *sg, int k, double t, double dt, double *walk) {
+    unsigned int stair;
+    double v = sg->a[k];
+    switch (sg->shape) {
+    case SHAPE_RAMP:
+        v = sg->a[k] + (sg->b[k] - sg->a[k]) * t / sg->duration;
+        break;
+    case SHAPE_STEP:
+        stair = (unsigned int)(t / sg->duration * sg->steps);
+        if (stair >= sg->steps)
+            stair = sg->steps - 1;
+        v = sg->a[k] + (sg->b[k] - sg->a[k]) * stair / (sg->steps - 1);
+        break;
+    case SHAPE_SINE:
+        v = sg->a[k] + sg->b[k] * sin(2 * M_PI * t / sg->period);
+        break;
+    case SHAPE_WALK:
+        /* position itself stays in range: it never sticks at a bound */
+        *walk += sg->b[k] * dt * (2.0 * rand() / RAND_MAX - 1);
+        if (*walk < 0)
+            *walk = 0;
+        if (PROF_CPU == k && *walk > 100)
+            *walk = 100;
+        v = *walk;
+        break;
+    default:
+        break;
+    }
+    if (v < 0)
+        v = 0;
+    if (PROF_CPU == k && v > 100)
+        v = 100;
+    return v;
+}
 
-    /* using non-existing protocol 8200 instead of ETH_P_IP */
-    packet_header->h_proto = htons(0x8200);
-    /* User data */
-    packet_size = (info->fill_buffer_procedure)(payload, info->msg_size);
-    packet_size += ETH_HLEN;
+/*
+ * level => control commands, which restart only threads of the load
+ * class of 'k'; 0 of any level of a class (size excepted) pauses it,
+ * so threads=0 never removes the CPU threads
+ */
+void profile_push(struct profile *pr, int k, double v) {
+    enum load_class c[PROF_KEYS] = {LOAD_CPU, LOAD_CPU, LOAD_NET, LOAD_NET, LOAD_MEM, LOAD_DISK};
+    char *verb[PROF_KEYS] = {"util", "cpu", "rate", "size", "mem", "disk"};
+    char cmd[64], reply[CTL_MSG_MAX];
+    unsigned short pause = 0;
+    int j;
+    pr->pushed[k] = v;
+    for (j = 0; j < PROF_KEYS; j++)
+        if (c[j] == c[k] && PROF_SIZE != j && 0 == pr->pushed[j])
+            pause = 1;
+    if (PROF_SIZE != k && pause != control.paused[c[k]]) {
+        snprintf(cmd, sizeof(cmd), "%s %s", pause ? "pause" : "resume", load_class_names[c[k]]);
+        ctl_execute(cmd, reply, sizeof(reply));
+    }
+    if (0 == v && PROF_SIZE != k)
+        return;
+    if (PROF_CPU == k)
+        snprintf(cmd, sizeof(cmd), "util %.2f", v);
+    else
+        snprintf(cmd, sizeof(cmd), "%s %lu", verb[k], (unsigned long int)(v + 0.5));
+    ctl_execute(cmd, reply, sizeof(reply));
+    if (strncmp(reply, "ok", 2))
+        log("Profile: %s: %s", cmd, reply);
+}
 
-    /* eternal loop */
+/* THREAD PROCEDURE OF LOAD PROFILE: levels every PROFILE_TICK_NS */
+void* profile_runner(void *thread_arg) {
+    struct profile *pr = (struct profile*)thread_arg;
+    struct profile_segment *sg;
+    unsigned long long start = clock_ns(), deadline = start;
+    double t, dt, prev = 0, v, seg_start;
+    int k, cur = -1;
     while (1) {
-        if (info->phases.sleep) {
-            its_time = time(0) + info->phases.active;
+        t = (double)(clock_ns() - start) / NANOSEC_PER_SEC * pr->speed;
+        if (t >= pr->total) {
+            if (!pr->loop)
+                break;
+            start += (unsigned long long)(pr->total / pr->speed * NANOSEC_PER_SEC);
+            t -= pr->total;
+            prev = 0;
+            cur = -1;
         }
-        while (info->phases.sleep ? (time(0) < its_time) : 1) {
-            pthread_mutex_lock( &mutex_send );
-            (void)sendto(raw_sock, packet, packet_size,
-                0, (struct sockaddr *) &(target_addr), sizeof (struct sockaddr_ll));
-            pthread_mutex_unlock( &mutex_send );
-            usleep(info->delay);
-            if (info->update_every_packet) {
-                packet_size = (info->fill_buffer_procedure)(payload, info->msg_size);
+        dt = t - prev;
+        prev = t;
+        /* segment of 't' */
+        for (k = 0, seg_start = 0; k < pr->nr - 1 && t >= seg_start + pr->seg[k].duration; k++)
+            seg_start += pr->seg[k].duration;
+        sg = pr->seg + k;
+        if (k != cur) {
+            log("Profile: segment %d %s (%.0f sec) at %.0f sec", k + 1,
+                profile_shapes[sg->shape], sg->duration, seg_start);
+            for (cur = 0; cur < PROF_KEYS; cur++)
+                pr->walk[cur] = sg->a[cur];
+            cur = k;
+        }
+        pr->cur = cur;
+        pr->at = t;
+        for (k = 0; k < PROF_KEYS; k++) {
+            if (!sg->set[k])
+                continue;
+            v = profile_eval(sg, k, t - seg_start, dt, pr->walk + k);
+            if (PROF_THREADS == k)
+                v = (int)(v + 0.5);
+            /* small changes would only restart generators' phases */
+            if (0 > pr->pushed[k] || (v != pr->pushed[k] &&
+                    (!v || !pr->pushed[k] || fabs(v - pr->pushed[k]) > PROFILE_DEADBAND * pr->pushed[k]))) {
+                profile_push(pr, k, v);
             }
         }
-        if (info->phases.sleep) {
-            sleep(info->phases.sleep);
+        deadline += PROFILE_TICK_NS;
+        sleep_until_ns(deadline);
+    }
+    pr->at = pr->total;
+    log("Profile: finished after %.0f sec, last levels hold", pr->total);
+    return 0;
+}
+
+/* SELF BENCHMARK (--bench) */
+/* list "a:b:c" (':' as in -P cpus=, getsubopt takes ',') => values; count or -1 */
+int bench_list(char *str, unsigned int *v, int room) {
+    char *end;
+    int nr = 0;
+    while (str && *str) {
+        if (nr == room)
+            return -1;
+        v[nr] = (unsigned int)strtoul(str, &end, 10);
+        if (end == str || !v[nr] || (*end && ':' != *end))
+            return -1;
+        nr++;
+        str = *end ? end + 1 : end;
+    }
+    return nr;
+}
+
+/* "sendto:mmsg:..." => bit mask of paths, 0 if unknown name */
+unsigned int bench_paths(char *str) {
+    unsigned int mask = 0, len;
+    int p;
+    while (str && *str) {
+        len = strcspn(str, ":");
+        for (p = 0; p < BENCH_PATHS; p++)
+            if (len == strlen(bench_path_names[p]) && !strncmp(str, bench_path_names[p], len))
+                break;
+        if (BENCH_PATHS == p)
+            return 0;
+        mask |= 1U << p;
+        str += len;
+        if (':' == *str)
+            str++;
+    }
+    return mask;
+}
+
+/* counters of all threads of the cell and CPU time of the process */
+void bench_sample(struct gen_stats *st, int threads, unsigned long long *v) {
+    struct timespec ts;
+    int i, k;
+    memset(v, 0, BENCH_COUNTERS * sizeof(unsigned long long));
+    v[0] = clock_ns();
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    v[1] = (unsigned long long)ts.tv_sec * NANOSEC_PER_SEC + ts.tv_nsec;
+#if defined(CPU_KERNELS_X86)
+    v[2] = __rdtsc();
+#endif
+    for (i = 0; i < threads; i++) {
+        v[3] += st[i].packets;
+        v[4] += st[i].bytes;
+        for (k = 0; k < SEND_ERRORS; k++)
+            v[5] += st[i].errors[k];
+    }
+}
+
+/*
+ * One cell of the sweep: 'threads' real sender threads of the path,
+ * unpaced, measured for 'msec' after warm-up, then ended by 'quit'.
+ * Prints "path size batch threads pps gbit/s cpus ns/packet cycles/packet errors".
+ */
+int bench_cell(struct bench *b, enum bench_path path, unsigned int size, int threads) {
+    struct udp_ping_info *udp;
+    struct gen_stats *st;
+    pthread_t thread[BENCH_THREADS_MAX];
+    unsigned long long v[2][BENCH_COUNTERS], ns, packets;
+    unsigned int batch = (BENCH_SENDTO == path) ? 1 : b->batch;
+    char cycles[32];
+    int i, started = 0;
+#if defined(__linux__)
+    struct raw_ping_info *raw;
+    int is_raw = (BENCH_RAW == path || BENCH_RING == path);
+    /* frames of raw paths are Ethernet sized */
+    if (is_raw && size > RAW_PING_MSG_SIZE_MAX)
+        size = RAW_PING_MSG_SIZE_MAX;
+    raw = (struct raw_ping_info*)calloc(threads, sizeof(struct raw_ping_info));
+#endif
+    udp = (struct udp_ping_info*)calloc(threads, sizeof(struct udp_ping_info));
+    if (posix_memalign((void**)&st, CACHE_LINE, threads * sizeof(struct gen_stats)))
+        st = 0;
+    if (!udp || !st
+#if defined(__linux__)
+        || !raw
+#endif
+    ) {
+        printf("Error: allocate %d threads\n", threads);
+        free(udp);
+        free(st);
+#if defined(__linux__)
+        free(raw);
+#endif
+        return -1;
+    }
+    memset(st, 0, threads * sizeof(struct gen_stats));
+    for (i = 0; i < threads; i++) {
+#if defined(__linux__)
+        if (is_raw) {
+            memcpy(raw[i].source_mac, fictive_mac_1, ETH_ALEN);
+            memcpy(raw[i].target_mac, fictive_mac_2, ETH_ALEN);
+            raw[i].msg_size = size;
+            raw[i].batch = batch;
+            raw[i].ring = (BENCH_RING == path);
+            raw[i].if_index = b->if_index;
+            raw[i].node = -1;
+            raw[i].stats = st + i;
+            raw[i].fill_buffer_procedure = payload_fill;
+            if (pthread_create(thread + i, 0, raw_sender, (void*)(raw + i)))
+                break;
+            started++;
+            continue;
         }
+        udp[i].gso = (BENCH_GSO == path);
+#endif
+        udp[i].host = b->host;
+        udp[i].port = b->port;
+        udp[i].msg_size = size;
+        udp[i].batch = batch;
+        udp[i].node = -1;
+        udp[i].stats = st + i;
+        udp[i].fill_buffer_procedure = payload_fill;
+        udp[i].stamp = 1;
+        udp[i].flow_id = i;
+        if (pthread_create(thread + i, 0, udp_sender, (void*)(udp + i)))
+            break;
+        started++;
     }
-    close(raw_sock);
-    free(payload);
-    return (0);
+    sleep_until_ns(clock_ns() + BENCH_WARMUP_NS);
+    bench_sample(st, threads, v[0]);
+    sleep_until_ns(v[0][0] + (unsigned long long)b->msec * 1000000);
+    bench_sample(st, threads, v[1]);
+    for (i = 0; i < threads; i++) {
+        udp[i].quit = 1;
+#if defined(__linux__)
+        raw[i].quit = 1;
+#endif
+    }
+    ctl_changed(LOAD_NET);
+    for (i = 0; i < started; i++)
+        pthread_join(thread[i], 0);
+    ns = v[1][0] - v[0][0];
+    packets = v[1][3] - v[0][3];
+    strcpy(cycles, "-");
+    /* TSC ticks per ns measured over the cell itself */
+    if (packets && v[1][2] > v[0][2])
+        snprintf(cycles, sizeof(cycles), "%.0f",
+            (double)(v[1][1] - v[0][1]) * (v[1][2] - v[0][2]) / ns / packets);
+    printf("%s %u %u %d %.0f %.3f %.2f %.0f %s %llu\n", bench_path_names[path], size, batch, started,
+        (double)packets * NANOSEC_PER_SEC / ns, (double)(v[1][4] - v[0][4]) * 8 / ns,
+        (double)(v[1][1] - v[0][1]) / ns, packets ? (double)(v[1][1] - v[0][1]) / packets : 0.0,
+        cycles, v[1][5] - v[0][5]);
+    fflush(stdout);
+    free(udp);
+    free(st);
+#if defined(__linux__)
+    free(raw);
+#endif
+    return (started == threads) ? 0 : -1;
 }
+
+/* sweep paths x sizes x threads, table on stdout; exit code */
+int bench_run(struct bench *b) {
+    int p, i, j;
+    printf("# stressgen bench: %s port %u, %u msec per cell, payload bytes\n", b->host, b->port, b->msec);
+#if defined(__linux__)
+    if ((b->paths & ((1U << BENCH_RAW) | (1U << BENCH_RING))) && (0 != geteuid() || 0 >= b->if_index)) {
+        printf("# raw, ring: skipped (root and -i<iface> needed, e.g. one end of veth pair)\n");
+        b->paths &= ~((1U << BENCH_RAW) | (1U << BENCH_RING));
+    }
+#else
+    b->paths &= (1U << BENCH_SENDTO) | (1U << BENCH_MMSG);
 #endif
+    printf("# path size batch threads pps gbit_per_sec cpus cpu_ns_per_packet cycles_per_packet errors\n");
+    for (p = 0; p < BENCH_PATHS; p++) {
+        if (!(b->paths & (1U << p)))
+            continue;
+        for (i = 0; i < b->sizes_nr; i++)
+            for (j = 0; j < b->threads_nr; j++)
+                if (0 > bench_cell(b, p, b->sizes[i], b->threads[j]))
+                    return 1;
+    }
+    return 0;
+}
 
 void signal_handler(int sgn) {
     /* TODO: implement cleanup - stopping threads, closing sockets etc */
      if (0 == lockf(lock_file, F_ULOCK, 0))
         close(lock_file);
+     unlink(control.path);
      exit(0);
 }
 
@@ -574,20 +7577,108 @@ int main(int argc, char** argv) {
     pthread_t *thread_pool, *thread;
 
     struct udp_ping_info *udp_pinger_pool = 0, *udp_pinger = 0;
-    struct schedule *cpu_schedule_pool = 0, *cpu_schedule = 0;
+    struct cpu_load_info *cpu_info_pool = 0;
+    unsigned int cpu_period = CPU_PERIOD_DEFAULT;
+    char *util_str, *subopts;
+    struct cpu_kernel *cpu_kernel[CPU_UTIL_TARGETS_MAX];
+    int cpu_kernel_nr = 0;
+    struct mem_load_info *mem_info_pool = 0, *mem_info = 0, mem_spec;
+    int mem = 0;
+    char *const mem_tokens[] = {"size", "mode", "threads", "rate", "huge", "lock", "node", 0};
+    struct disk_load_info disk_info[DISK_TARGETS_MAX], *disk = disk_info;
+    int disks = 0;
+    char *const fill_tokens[] = {"random", "ratio", "pattern", "file", "pool", 0};
+    char *fill_val;
+    char *const disk_tokens[] = {"file", "size", "bs", "qd", "mix", "rand", "direct",
+                                "iops", "rate", "force", 0};
+    unsigned long int disk_iops;
 
 #if defined(__linux__)
-    struct raw_ping_info *raw_pinger = 0;
-    unsigned short int raw_ping = 0;
+    struct raw_ping_info *raw_pinger_pool = 0, *raw_pinger = 0;
+    unsigned short int raw_ping = 0, raw_ring = 0, raw_bypass = 0;
+    unsigned int raw_threads = 1;
+    int raw_if_index = -1;
+    char *raw_if_name = 0;
+    struct flow_spec raw_flows, *raw_flow_spec = 0;
+    unsigned short int udp_gso = 0, udp_zerocopy = 0;
+    char *subval;
+    char *const raw_tokens[] = {"ring", "bypass", 0};
+    /* order matches enum flow_field */
+    char *const flow_tokens[] = {"smac", "dmac", "vlan", "sip", "dip", "sport", "dport", 0};
+    char *const place_tokens[] = {"cpus", "per", "policy", "prio", "nice", "netnode", 0};
+    /* order matches enum target_kind (after none) */
+    char *const target_tokens[] = {"cpu", "tx", "loss", "iface", "max", "period",
+                                   "kp", "ki", "kd", 0};
+    pthread_t target_thread;
+    struct rx_info *rx_info_pool = 0;
+    int rx = 0, rx_port = PING_PORT_DEFAULT;
+    char *const listen_tokens[] = {"port", "sockets", "udp", "tcp", 0};
+    unsigned short rx_proto = 0;
+    char *const tcp_tokens[] = {"bulk", "hold", "churn", "threads", "rst", 0};
+    struct tcp_load_info *tcp_info_pool = 0;
+    struct tcp_sink_info *tcp_sink_pool = 0;
+    unsigned int tcp_bulk = 0, tcp_hold = 0;
+    unsigned long int tcp_churn = 0;
+    unsigned short tcp_reset = 0;
+    int tcp = 0, tcp_sink_nr = 0, tcp_hosts_nr = 0;
+    char **tcp_hosts = 0;
+    struct rlimit nofile;
+    char *const rpc_tokens[] = {"rps", "outstanding", "req", "resp", "tcp", "conns", "threads", 0};
+    struct rpc_info *rpc_info_pool = 0, rpc_spec;
+    int rpc = 0;
+    char *const replay_tokens[] = {"file", "speed", "pps", "loop", "smac", "dmac", "sip", "dip", 0};
+    char *const fleet_tokens[] = {"port", "sockets", "hosts", "history", "every", "out", "csv", "stream", 0};
+    char *fleet_out = 0;
+    pthread_t fleet_thread;
+    struct sched_info *sched_pool = 0;
+    struct udp_ping_info *sched_hb = 0;
+    int sched = 0, sched_hosts_nr = 0;
+    char **sched_hosts = 0;
+    struct ether_addr *mac;
+    struct in_addr net;
+    char *prefix;
+    cpu_set_t place_cpus, place_allowed;
+    int place_cpus_given = 0, place_nice = 0, place_nice_given = 0, net_node_given = 0;
 #endif
+    /* thread names (and -i interface name): 16 bytes, as IF_NAMESIZE */
+    char place_name[16];
 
     int op, rc, i, hb=0, cpu=0, ping=0, thread_pool_size=0, socket_pool_size=0;
+    char *ctl_command = 0;
+    int ctl_port = 0;
+    struct bench bench;
+    unsigned short bench_mode = 0;
+    char *const bench_tokens[] = {"sizes", "threads", "paths", "time", 0};
+    char *const resolve_tokens[] = {"threads", "timeout", "inet6", 0};
+    char *resolve_val;
+    char *bench_val;
+    long nproc;
+    struct option long_options[] = {
+        {"bench", optional_argument, 0, OPT_BENCH},
+        {"resolve", required_argument, 0, OPT_RESOLVE},
+        {0, 0, 0, 0}
+    };
+    pthread_t ctl_thread, profile_thread, sync_thread;
+    char *const sync_tokens[] = {"start", "period", "active", "index", "step", "offset", 0};
+    char *sync_val;
+    double sync_start = 0, sync_period = 0, sync_active = 0, sync_step = 0, sync_offset = 0;
+    unsigned long long sync_next;
+    unsigned int sync_index = 0;
+    unsigned short sync = 0;
+    pthread_condattr_t ctl_attr;
+    pthread_t stats_thread;
+    sigset_t stats_signal;
+    unsigned short int stop_daemon = 0;
     unsigned int ping_msg_size = PING_MSG_SIZE_DEFAULT;
+    unsigned int batch = 0;
+    unsigned long int burst = 0;
+    unsigned short int msg_size_given = 0;
     int ping_delay = PING_DELAY_DEFAULT;
     int master_port = MASTER_PORT_DEFAULT;
     int ping_port = PING_PORT_DEFAULT;
     char* master_host = 0;
     int heartbeat_delay = HEARTBEAT_DELAY_DEFAULT;
+    enum hb_format heartbeat_format = HB_BINARY;
     unsigned int active_period = 0;
     unsigned int sleep_period = 0;
 #define RANDOM_START 1
@@ -598,62 +7689,779 @@ int main(int argc, char** argv) {
         printf("Usage: %s [options] [hosts]\n"
         "   Where options are:\n"
         "       -X                   Stop Daemon\n"
+        "       -n<name>             Instance name (several daemons may run)\n"
         "       -C<threads>          CPU Load\n"
-        "       -N<Bytes/sec>[K|M]   Net Load\n"
+        "       -u<pct>[,<pct>...]   CPU utilization per thread (fractional, 0-100)\n"
+        "       -w<usec>             CPU utilization period (default 10000)\n"
+        "       -K<kernel>[,...]     CPU load kernel per thread: xor (default)\n"
+        "                            int branch fma avx2 avx512 fma-scalar\n"
+        "                            l1 l2 l3 dram (cache tier working sets,\n"
+        "                            l2 and beyond pointer-chased)\n"
+        "       -W<opt=val,...>      Memory load, options:\n"
+        "                            size=<bytes>[K|M|G] total footprint (required)\n"
+        "                            mode=hold|read|write|copy|chase (default hold)\n"
+        "                            threads=<n> rate=<bytes/sec>[K|M|G] in total\n"
+        "                            huge (hugepages) lock (mlock) node=<numa node>\n"
+        "       -D<opt=val,...>      Disk load (may be repeated), options:\n"
+        "                            file=<path> file or block device (required)\n"
+        "                            size=<bytes> bs=<bytes> qd=<queue depth>\n"
+        "                            mix=<%% of reads> (default 100) rand direct\n"
+        "                            iops=<n> or rate=<bytes/sec>[K|M|G]\n"
+        "                            force (allow writes to block device)\n"
+        "       -N<Bytes/sec>[K|M|G] Net Load (per destination)\n"
 #if defined (__linux__)
-        "       -E                   Use Ethernet packets (only root)\n"
+        "       -E[ring][,bypass]    Use Ethernet packets (only root)\n"
+        "                            ring: PACKET_MMAP TX ring, frames sent in bulk\n"
+        "                            bypass: skip qdisc layer (PACKET_QDISC_BYPASS)\n"
+        "       -F<field=a[-b],...>  IPv4/UDP Ethernet flows (implies -E), fields:\n"
+        "                            smac dmac (MAC) vlan sip dip (IPv4) sport dport\n"
+        "                            each one cycles a..b independently per packet\n"
+        "       -i<iface>            Interface for Ethernet packets (and NIC node for -P)\n"
+        "       -t<threads>          Ethernet sender threads (-N is split among them)\n"
+        "       -L[port=<n>,sockets=<n>] Receive UDP load (default port 50888, 1 socket):\n"
+        "                            per flow rate, loss, reordering, one-way latency\n"
+        "                            udp, tcp: what to receive (both may be given),\n"
+        "                            tcp: accept and drain connections (epoll)\n"
+        "       -q<opt=val,...>      TCP load to hosts instead of UDP (epoll), per host:\n"
+        "                            bulk=<streams> hold=<idle connections>\n"
+        "                            churn=<connections/sec> (connect and close)\n"
+        "                            rst (churn closes by reset) threads=<n>\n"
+        "                            -N paces bulk streams, -s is write size, -p port\n"
+        "       -Q<opt=val,...>      Request/response load to hosts instead of UDP, per host:\n"
+        "                            rps=<n> open loop (latency from schedule) or\n"
+        "                            outstanding=<n> closed loop, req= resp=<bytes>\n"
+        "                            (default 64) tcp (default udp) conns=<n> threads=<n>\n"
+        "                            -L answers requests (udp and tcp), -p port\n"
+        "       -j<workers>          UDP hosts multiplexed over a few threads (0 => CPUs)\n"
+        "                            instead of thread per host: timer wheel of\n"
+        "                            per host buckets, due datagrams sent by one\n"
+        "                            sendmmsg(); first worker sends heartbeats\n"
+        "       -r<opt=val,...>      Replay pcap/pcapng capture through -i (only root):\n"
+        "                            file=<path> (required) speed=<x> (default 1,\n"
+        "                            0 => top speed) or pps=<n>, loop, rewriting:\n"
+        "                            smac= dmac=<MAC> sip= dip=<IPv4 net>/<bits>\n"
 #endif
         "   Schedule options:\n"
         "       -A<seconds>[m|h]     Active phase duration\n"
         "       -S<seconds>[m|h]     Sleep phase duration\n"
         "       -I                   Alternate CPU and Net loads in turn\n"
         "       -R                   Random mix of CPU and Net phases\n"
+        "       -J[opt=val,...]      Phases on wall clock (CLOCK_REALTIME) boundaries:\n"
+        "                            period=<msec> active=<msec> (default -A + -S, -A)\n"
+        "                            start=<unix time> (default 0: epoch aligned)\n"
+        "                            offset=<msec> index=<n> step=<msec> (offset +=\n"
+        "                            index * step); with -I net load takes the rest\n"
+        "   Net options:\n"
+        "       -b<packets>          Batch depth: packets per sendmmsg() call\n"
+        "       -k<bytes>[K|M]       Burst: token bucket depth for -N pacing\n"
+        "       -s<bytes>[K]         Message size (with -N default is maximum)\n"
+        "       -d<usec>             Interval between packets (without -N)\n"
+        "       -f<opt[=val],...>    Payload (UDP, Ethernet and disk writes), one of:\n"
+        "                            random (incompressible) ratio=<%% compressible>\n"
+        "                            pattern=<text|0xhex> file=<path>\n"
+        "                            pool=<n> bodies rotated per datagram (default 64)\n"
+#if defined (__linux__)
+        "       -g                   UDP GSO: send up to 64 datagrams per call\n"
+        "       -z                   MSG_ZEROCOPY sends\n"
+#endif
+        "       --resolve=<opt=val,...> Hosts resolved at start in parallel (getaddrinfo):\n"
+        "                            threads=<n> (default 32) timeout=<msec> for all\n"
+        "                            (5000) inet6 (prefer IPv6 addresses); addresses\n"
+        "                            of a name are taken round-robin by senders\n"
+#if defined (__linux__)
+        "   Placement options:\n"
+        "       -P<opt=val,...>      Load threads placement, options:\n"
+        "                            cpus=<list> e.g. 0-3:6 (default: all allowed)\n"
+        "                            per=cpu|core|node one thread per CPU (default),\n"
+        "                            physical core or NUMA node, round-robin\n"
+        "                            policy=other|batch|idle|fifo|rr prio=<n> nice=<n>\n"
+        "                            netnode=<n> NIC NUMA node: senders' buffers\n"
+        "                            (default: node of -i interface)\n"
+        "   Closed loop options:\n"
+        "       -T<goal>[,opt=val,...] Hold host level, adjusting the load, goal is one of:\n"
+        "                            cpu=<pct> host CPU utilization (/proc/stat)\n"
+        "                            tx=<bytes/sec>[K|M|G] interface tx (/proc/net/dev)\n"
+        "                            loss=<pct> send errors and tx drops\n"
+        "                            options: iface=<name> (default: -i or first up)\n"
+        "                            max=<threads|bytes/sec> (default: CPUs; tx goal;\n"
+        "                            -N for loss) period=<msec> kp= ki= kd= (PID gains)\n"
+#endif
+        "   Profile options:\n"
+        "       -O<file>             Load profile: levels change over time, lines of\n"
+        "                            <duration>[s|m|h|d] <shape> [period=<dur>] [steps=<n>]\n"
+        "                            <key>=<level> ...; keys: cpu (%%), threads, net\n"
+        "                            (B/sec per destination), size, mem, disk (B/sec);\n"
+        "                            shapes: const <v>, ramp|step <a>..<b>,\n"
+        "                            sine <mean>~<amp>, walk <start>~<step/sec>;\n"
+        "                            level 0 pauses the load; 'speed <x>', 'loop'\n"
+        "   Control options:\n"
+        "       -c<command>          Send command to running instance (see -n):\n"
+        "                            cpu <threads>, util <pct>[,...], rate <B/sec>,\n"
+        "                            size <bytes>, delay <usec>, phases <A> <S>\n"
+        "                            (seconds; msec with -J),\n"
+        "                            mem|disk <B/sec>,\n"
+        "                            pause|resume [cpu|net|mem|disk|all], stats,\n"
+        "                            fleet [<host>] (collector aggregates, host samples)\n"
+        "       -U<port>             Accept commands over UDP (from -M host only)\n"
         "   Heartbeat options:\n"
         "       -M<host>             Send heartbeats to master host\n"
-        "       -B                   Send heartbeats broadcast\n\n"
+        "       -B                   Send heartbeats broadcast\n"
+        "       -H<bin|text>         Heartbeat format: binary with rates (default)\n"
+        "                            or legacy text (raw /proc dumps)\n"
+#if defined (__linux__)
+        "       -G[opt=val,...]      Collect binary heartbeats of a fleet (recvmmsg):\n"
+        "                            port=<n> (default -m) sockets=<n> hosts=<max>\n"
+        "                            (default 16384) history=<samples per host> (60)\n"
+        "                            every=<sec> aggregates and hosts written to\n"
+        "                            out=<path> (default /tmp/stressgen[-name].fleet)\n"
+        "                            csv (default json) stream (append aggregates)\n"
+#endif
+        "   Benchmark:\n"
+        "       --bench[=opt=val,...] Measure send capacity, no daemon: table of pps,\n"
+        "                            Gbit/s, CPUs, CPU ns and cycles per packet of\n"
+        "                            paths x sizes x threads, unpaced, to first host\n"
+        "                            (default 127.0.0.1, -p port), options:\n"
+        "                            paths=sendto:mmsg:gso:raw:ring (default all;\n"
+        "                            raw and ring need root and -i, e.g. veth end)\n"
+        "                            sizes=<bytes>:... (64:512:1472) threads=<n>:...\n"
+        "                            (1:2:4 up to CPUs) time=<msec> per cell (1000)\n"
+        "                            -b batch of mmsg, gso, raw, ring (default 64);\n"
+        "                            loopback does not cut GSO buffers: prefer veth\n"
+        "\n"
         "   'K'=KiB; 'M'=MiB; 'm'=minute; 'h'=hour\n\n"
         "   'hosts' - list of hosts to direct net load to\n"
         , argv[0]);
         return 0;
     }
+#if defined(__linux__)
+    place.mode = PLACE_NONE;
+    place.policy = -1;
+    place.net_node = -1;
+    target.kp = TARGET_KP_DEFAULT;
+    target.ki = TARGET_KI_DEFAULT;
+    target.period = TARGET_PERIOD_DEFAULT;
+#endif
+    strcpy(control.path, CTL_SOCK_NAME);
     /* parsing named cmd line parameters */
-    while (-1 != (op = getopt (argc, argv, "C:N:BM:S:A:RIXEm:p:s:d:h:"))) {
+    memset(&bench, 0, sizeof(bench));
+    while (-1 != (op = getopt_long (argc, argv, "C:N:BM:S:A:RIXE::m:p:s:d:h:H:b:n:k:F:i:t:gzu:w:K:W:D:P:c:U:T:L::f:O:r:q:Q:G::j:J::",
+            long_options, 0))) {
         switch (op) {
+        case OPT_BENCH:
+            bench_mode = 1;
+            subopts = optarg ? optarg : "";
+            while ('\0' != *subopts) {
+                op = getsubopt(&subopts, bench_tokens, &bench_val);
+                if (0 > op || !bench_val) {
+                    printf("Error: invalid --bench option %s\n", bench_val ? bench_val : "");
+                    return 1;
+                }
+                switch (op) {
+                case 0:
+                    bench.sizes_nr = bench_list(bench_val, bench.sizes, BENCH_LIST_MAX);
+                    break;
+                case 1:
+                    bench.threads_nr = bench_list(bench_val, bench.threads, BENCH_LIST_MAX);
+                    break;
+                case 2:
+                    bench.paths = bench_paths(bench_val);
+                    break;
+                default:
+                    bench.msec = (unsigned int)atoi(bench_val);
+                    break;
+                }
+                if (0 > bench.sizes_nr || 0 > bench.threads_nr || (2 == op && !bench.paths) ||
+                        (3 == op && !bench.msec)) {
+                    printf("Error: --bench sizes=<bytes>:... threads=<n>:... (up to %d values)\n"
+                        "       paths=sendto:mmsg:gso:raw:ring time=<msec>\n", BENCH_LIST_MAX);
+                    return 1;
+                }
+            }
+            break;
+        case OPT_RESOLVE:
+            subopts = optarg;
+            while ('\0' != *subopts) {
+                op = getsubopt(&subopts, resolve_tokens, &resolve_val);
+                if (0 > op || (2 != op && !resolve_val)) {
+                    printf("Error: invalid --resolve option %s\n", resolve_val ? resolve_val : "");
+                    return 1;
+                }
+                if (0 == op)
+                    resolver.threads = (unsigned int)atoi(resolve_val);
+                else if (1 == op)
+                    resolver.timeout = (unsigned int)atoi(resolve_val);
+                else
+                    resolver.inet6 = 1;
+            }
+            if (resolver.threads < 1 || resolver.threads > RESOLVE_THREADS_MAX || !resolver.timeout) {
+                printf("Error: --resolve threads=1..%d timeout=<msec>\n", RESOLVE_THREADS_MAX);
+                return 1;
+            }
+            break;
         /* main options */
         case 'C':
             cpu = atoi(optarg);
             break;
-        case 'N':
-            tx_speed = str2long(optarg);
+        case 'N':
+            tx_speed = str2long(optarg);
+            break;
+        case 'B':
+            master_host = 0;
+            hb = 1;
+            break;
+        case 'M':
+            master_host = optarg;
+            hb = 1;
+            break;
+        case 'S':
+            sleep_period = (unsigned int)str2long(optarg);
+            break;
+        case 'A':
+            active_period = (unsigned int)str2long(optarg);
+            break;
+        case 'R':
+            shuffle_phases = RANDOM_START;
+            break;
+        case 'I':
+            shuffle_phases = ALTERNATE_LOAD;
+            break;
+        case 'J':
+            sync = 1;
+            subopts = optarg;
+            while (subopts && '\0' != *subopts) {
+                op = getsubopt(&subopts, sync_tokens, &sync_val);
+                if (0 > op || !sync_val) {
+                    printf("Error: invalid -J option %s\n", sync_val ? sync_val : "");
+                    return 1;
+                }
+                switch (op) {
+                case 0:
+                    sync_start = atof(sync_val);
+                    break;
+                case 1:
+                    sync_period = atof(sync_val);
+                    break;
+                case 2:
+                    sync_active = atof(sync_val);
+                    break;
+                case 3:
+                    sync_index = (unsigned int)atoi(sync_val);
+                    break;
+                case 4:
+                    sync_step = atof(sync_val);
+                    break;
+                default:
+                    sync_offset = atof(sync_val);
+                    break;
+                }
+            }
+            break;
+#if defined(__linux__)
+        case 'E':
+            raw_ping = 1;
+            subopts = optarg;
+            while (subopts && '\0' != *subopts) {
+                switch (getsubopt(&subopts, raw_tokens, &subval)) {
+                case 0:
+                    raw_ring = 1;
+                    break;
+                case 1:
+                    raw_bypass = 1;
+                    break;
+                default:
+                    printf("Error: unknown -E option %s\n", subval);
+                    return 1;
+                }
+            }
+            break;
+        case 'F':
+            raw_ping = 1;
+            if (!raw_flow_spec) {
+                /* defaults: one flow between fictive hosts */
+                raw_flow_spec = &raw_flows;
+                for (i = 0; i < FLOW_FIELDS; i++)
+                    raw_flows.range[i].count = 1;
+                (void)str2range("00:17:9a:22:22:22", FLOW_SMAC, raw_flows.range + FLOW_SMAC);
+                (void)str2range("00:17:9a:11:11:11", FLOW_DMAC, raw_flows.range + FLOW_DMAC);
+                raw_flows.range[FLOW_VLAN].base = 0;
+                raw_flows.range[FLOW_SIP].base = 0x0a000001; /* 10.0.0.1 */
+                raw_flows.range[FLOW_DIP].base = 0x0a000002;
+                raw_flows.range[FLOW_SPORT].base = PING_PORT_DEFAULT;
+                raw_flows.range[FLOW_DPORT].base = PING_PORT_DEFAULT;
+            }
+            subopts = optarg;
+            while ('\0' != *subopts) {
+                i = getsubopt(&subopts, flow_tokens, &subval);
+                if (0 > i || str2range(subval, i, raw_flows.range + i)) {
+                    printf("Error: invalid -F option %s\n", subval ? subval : "");
+                    return 1;
+                }
+            }
+            break;
+        case 'i':
+            raw_if_name = optarg;
+            break;
+        case 'r':
+            replay.speed = 1;
+            subopts = optarg;
+            while ('\0' != *subopts) {
+                op = getsubopt(&subopts, replay_tokens, &subval);
+                if (0 > op || (3 != op && !subval)) {
+                    printf("Error: invalid -r option %s\n", subval ? subval : "");
+                    return 1;
+                }
+                switch (op) {
+                case 0:
+                    replay.path = subval;
+                    break;
+                case 1:
+                    replay.speed = strtod(subval, 0);
+                    break;
+                case 2:
+                    replay.pps = (unsigned long int)str2long(subval);
+                    break;
+                case 3:
+                    replay.loop = 1;
+                    break;
+                case 4:
+                case 5:
+                    if (!(mac = ether_aton(subval))) {
+                        printf("Error: invalid MAC %s\n", subval);
+                        return 1;
+                    }
+                    memcpy((4 == op) ? replay.smac : replay.dmac, mac, ETH_ALEN);
+                    *((4 == op) ? &replay.set_smac : &replay.set_dmac) = 1;
+                    break;
+                default:
+                    /* <net>[/<prefix length>] */
+                    prefix = strchr(subval, '/');
+                    if (prefix)
+                        *prefix++ = '\0';
+                    i = prefix ? atoi(prefix) : 32;
+                    if (1 != inet_pton(AF_INET, subval, &net) || i < 1 || i > 32) {
+                        printf("Error: -r %s needs <IPv4 net>/<1..32>\n", replay_tokens[op]);
+                        return 1;
+                    }
+                    *((6 == op) ? &replay.sip : &replay.dip) = ntohl(net.s_addr);
+                    *((6 == op) ? &replay.sip_len : &replay.dip_len) = (unsigned int)i;
+                    break;
+                }
+            }
+            if (!replay.path || replay.speed < 0) {
+                printf("Error: -r needs file=<capture>, speed must be positive\n");
+                return 1;
+            }
+            if (pcap_open(&replay))
+                return 1;
+            break;
+        case 'u':
+            /* CPU threads, also those added at run time, take these */
+            if (0 >= ctl_parse_util(optarg)) {
+                printf("Error: CPU utilization must be 0-100%% (at most %d, comma separated)\n",
+                    CPU_UTIL_TARGETS_MAX);
+                return 1;
+            }
+            break;
+        case 'w':
+            cpu_period = (unsigned int)atoi(optarg);
+            break;
+        case 'W':
+            memset(&mem_spec, 0, sizeof(mem_spec));
+            mem_spec.node = -1;
+            mem = 1;
+            subopts = optarg;
+            while ('\0' != *subopts) {
+                switch (getsubopt(&subopts, mem_tokens, &util_str)) {
+                case 0:
+                    mem_spec.size = util_str ? (unsigned long int)str2long(util_str) : 0;
+                    break;
+                case 1:
+                    for (i = 0; mem_mode_names[i]; i++) {
+                        if (util_str && 0 == strcmp(util_str, mem_mode_names[i]))
+                            break;
+                    }
+                    if (!mem_mode_names[i]) {
+                        printf("Error: unknown memory mode %s\n", util_str ? util_str : "");
+                        return 1;
+                    }
+                    mem_spec.mode = (enum mem_mode)i;
+                    break;
+                case 2:
+                    mem = util_str ? atoi(util_str) : 1;
+                    break;
+                case 3:
+                    mem_spec.rate = util_str ? (unsigned long int)str2long(util_str) : 0;
+                    break;
+                case 4:
+                    mem_spec.huge = 1;
+                    break;
+                case 5:
+                    mem_spec.lock = 1;
+                    break;
+                case 6:
+                    mem_spec.node = util_str ? atoi(util_str) : -1;
+                    break;
+                default:
+                    printf("Error: unknown -W option %s\n", util_str ? util_str : "");
+                    return 1;
+                }
+            }
+            break;
+        case 'D':
+            if (DISK_TARGETS_MAX == disks) {
+                printf("Error: too many -D (max %d)\n", DISK_TARGETS_MAX);
+                return 1;
+            }
+            disk = disk_info + disks++;
+            memset(disk, 0, sizeof(struct disk_load_info));
+            disk->block = DISK_BLOCK_DEFAULT;
+            disk->queue = DISK_QUEUE_DEFAULT;
+            disk->read_pct = 100;
+            disk_iops = 0;
+            subopts = optarg;
+            while ('\0' != *subopts) {
+                switch (getsubopt(&subopts, disk_tokens, &util_str)) {
+                case 0:
+                    disk->path = util_str;
+                    break;
+                case 1:
+                    disk->size = util_str ? (unsigned long int)str2long(util_str) : 0;
+                    break;
+                case 2:
+                    disk->block = util_str ? (unsigned long int)str2long(util_str) : 0;
+                    break;
+                case 3:
+                    disk->queue = util_str ? (unsigned int)atoi(util_str) : 0;
+                    break;
+                case 4:
+                    disk->read_pct = util_str ? (unsigned short)atoi(util_str) : 100;
+                    break;
+                case 5:
+                    disk->random = 1;
+                    break;
+                case 6:
+                    disk->direct = 1;
+                    break;
+                case 7:
+                    disk_iops = util_str ? (unsigned long int)str2long(util_str) : 0;
+                    break;
+                case 8:
+                    disk->rate = util_str ? (unsigned long int)str2long(util_str) : 0;
+                    break;
+                case 9:
+                    disk->force = 1;
+                    break;
+                default:
+                    printf("Error: unknown -D option %s\n", util_str ? util_str : "");
+                    return 1;
+                }
+            }
+            if (!disk->path || !disk->block || disk->block % 512 ||
+                    disk->read_pct > 100 || !disk->queue || disk->queue > DISK_QUEUE_MAX) {
+                printf("Error: -D needs file=, bs= multiple of 512, qd=1..%d, mix=0..100\n",
+                    DISK_QUEUE_MAX);
+                return 1;
+            }
+            if (disk_iops)
+                disk->rate = disk_iops * disk->block;
+            break;
+        case 'K':
+            subopts = optarg;
+            for (cpu_kernel_nr = 0; cpu_kernel_nr < CPU_UTIL_TARGETS_MAX && subopts; ) {
+                util_str = strsep(&subopts, ",");
+                cpu_kernel[cpu_kernel_nr] = cpu_kernel_find(util_str);
+                if (!cpu_kernel[cpu_kernel_nr]) {
+                    printf("Error: CPU kernel %s unknown or not supported by this CPU\n", util_str);
+                    return 1;
+                }
+                cpu_kernel_nr++;
+            }
             break;
-        case 'B':
-            master_host = 0;
-            hb = 1;
+        case 'g':
+            udp_gso = 1;
             break;
-        case 'M':
-            master_host = optarg;
-            hb = 1;
+        case 'z':
+            udp_zerocopy = 1;
             break;
-        case 'S':
-            sleep_period = (unsigned int)str2long(optarg);
+        case 't':
+            raw_threads = (unsigned int)atoi(optarg);
             break;
-        case 'A':
-            active_period = (unsigned int)str2long(optarg);
+        case 'j':
+            sched = atoi(optarg);
+            if (sched <= 0)
+                sched = (int)sysconf(_SC_NPROCESSORS_ONLN);
+            if (sched > SCHED_THREADS_MAX) {
+                printf("Error: at most %d scheduler workers\n", SCHED_THREADS_MAX);
+                return 1;
+            }
             break;
-        case 'R':
-            shuffle_phases = RANDOM_START;
+        case 'P':
+            if (PLACE_NONE == place.mode)
+                place.mode = PLACE_LIST;
+            subopts = optarg;
+            while ('\0' != *subopts) {
+                switch (getsubopt(&subopts, place_tokens, &subval)) {
+                case 0:
+                    if (!subval || 0 >= str2cpuset(subval, &place_cpus)) {
+                        printf("Error: invalid CPU list %s\n", subval ? subval : "");
+                        return 1;
+                    }
+                    place_cpus_given = 1;
+                    break;
+                case 1:
+                    if (subval && !strcmp(subval, "cpu"))
+                        place.mode = PLACE_LIST;
+                    else if (subval && !strcmp(subval, "core"))
+                        place.mode = PLACE_CORE;
+                    else if (subval && !strcmp(subval, "node"))
+                        place.mode = PLACE_NODE;
+                    else {
+                        printf("Error: per=cpu|core|node\n");
+                        return 1;
+                    }
+                    break;
+                case 2:
+                    if (subval && !strcmp(subval, "other"))
+                        place.policy = SCHED_OTHER;
+                    else if (subval && !strcmp(subval, "batch"))
+                        place.policy = SCHED_BATCH;
+                    else if (subval && !strcmp(subval, "idle"))
+                        place.policy = SCHED_IDLE;
+                    else if (subval && !strcmp(subval, "fifo"))
+                        place.policy = SCHED_FIFO;
+                    else if (subval && !strcmp(subval, "rr"))
+                        place.policy = SCHED_RR;
+                    else {
+                        printf("Error: policy=other|batch|idle|fifo|rr\n");
+                        return 1;
+                    }
+                    break;
+                case 3:
+                    place.prio = subval ? atoi(subval) : 0;
+                    break;
+                case 4:
+                    place_nice = subval ? atoi(subval) : 0;
+                    place_nice_given = 1;
+                    break;
+                case 5:
+                    place.net_node = subval ? atoi(subval) : -1;
+                    net_node_given = 1;
+                    break;
+                default:
+                    printf("Error: unknown -P option %s\n", subval ? subval : "");
+                    return 1;
+                }
+            }
             break;
-        case 'I':
-            shuffle_phases = ALTERNATE_LOAD;
+        case 'L':
+            rx = 1;
+            subopts = optarg ? optarg : "";
+            while ('\0' != *subopts) {
+                switch (op = getsubopt(&subopts, listen_tokens, &subval)) {
+                case 0:
+                    rx_port = subval ? atoi(subval) : 0;
+                    break;
+                case 1:
+                    rx = subval ? atoi(subval) : 0;
+                    break;
+                case 2:
+                case 3:
+                    rx_proto |= (2 == op) ? 1 : 2;
+                    break;
+                default:
+                    printf("Error: unknown -L option %s\n", subval ? subval : "");
+                    return 1;
+                }
+            }
+            if (rx < 1 || rx > RX_THREADS_MAX || rx_port <= 0 || rx_port > 65535) {
+                printf("Error: -L port=1..65535 sockets=1..%d\n", RX_THREADS_MAX);
+                return 1;
+            }
+            /* UDP unless told otherwise; TCP sink takes as many threads */
+            tcp_sink_nr = (rx_proto & 2) ? rx : 0;
+            if (rx_proto && !(rx_proto & 1))
+                rx = 0;
             break;
-#if defined(__linux__)
-        case 'E':
-            raw_ping = 1;
+        case 'G':
+            fleet.rx_nr = 1;
+            fleet.hosts_max = FLEET_HOSTS_DEFAULT;
+            fleet.history = FLEET_HISTORY_DEFAULT;
+            fleet.every = 1;
+            subopts = optarg ? optarg : "";
+            while ('\0' != *subopts) {
+                op = getsubopt(&subopts, fleet_tokens, &subval);
+                if (0 > op || (op < 6 && !subval)) {
+                    printf("Error: invalid -G option %s\n", subval ? subval : "");
+                    return 1;
+                }
+                switch (op) {
+                case 0:
+                    fleet.port = atoi(subval);
+                    break;
+                case 1:
+                    fleet.rx_nr = atoi(subval);
+                    break;
+                case 2:
+                    fleet.hosts_max = (unsigned int)str2long(subval);
+                    break;
+                case 3:
+                    fleet.history = (unsigned int)atoi(subval);
+                    break;
+                case 4:
+                    fleet.every = (unsigned int)str2long(subval);
+                    break;
+                case 5:
+                    fleet_out = subval;
+                    break;
+                case 6:
+                    fleet.csv = 1;
+                    break;
+                default:
+                    fleet.stream = 1;
+                    break;
+                }
+            }
+            if (fleet.port < 0 || fleet.port > 65535 || fleet.rx_nr < 1 || fleet.rx_nr > FLEET_THREADS_MAX ||
+                    !fleet.hosts_max || fleet.hosts_max > (1U << 30) || !fleet.history || !fleet.every) {
+                printf("Error: -G port=1..65535 sockets=1..%d hosts=1.. history=1.. every=1..\n",
+                    FLEET_THREADS_MAX);
+                return 1;
+            }
+            break;
+        case 'Q':
+            rpc = 1;
+            memset(&rpc_spec, 0, sizeof(rpc_spec));
+            rpc_spec.req_size = rpc_spec.resp_size = RPC_SIZE_DEFAULT;
+            rpc_spec.conns = 1;
+            subopts = optarg;
+            while ('\0' != *subopts) {
+                op = getsubopt(&subopts, rpc_tokens, &subval);
+                if (0 > op || (4 != op && !subval)) {
+                    printf("Error: invalid -Q option %s\n", subval ? subval : "");
+                    return 1;
+                }
+                switch (op) {
+                case 0:
+                    rpc_spec.rps = (unsigned long int)str2long(subval);
+                    break;
+                case 1:
+                    rpc_spec.outstanding = (unsigned int)atoi(subval);
+                    break;
+                case 2:
+                    rpc_spec.req_size = (unsigned int)str2long(subval);
+                    break;
+                case 3:
+                    rpc_spec.resp_size = (unsigned int)str2long(subval);
+                    break;
+                case 4:
+                    rpc_spec.tcp = 1;
+                    break;
+                case 5:
+                    rpc_spec.conns = (unsigned int)atoi(subval);
+                    break;
+                default:
+                    rpc = atoi(subval);
+                    break;
+                }
+            }
+            if (!rpc_spec.rps == !rpc_spec.outstanding || rpc < 1 || rpc > RPC_THREADS_MAX ||
+                    !rpc_spec.conns || rpc_spec.req_size < RPC_HDR_SIZE || rpc_spec.resp_size < RPC_HDR_SIZE ||
+                    (!rpc_spec.tcp && (rpc_spec.req_size > UDP_PING_MSG_SIZE_MAX ||
+                                       rpc_spec.resp_size > UDP_PING_MSG_SIZE_MAX))) {
+                printf("Error: -Q needs one of rps=, outstanding=; threads=1..%d;"
+                    " req=, resp=%d..%d bytes (UDP)\n", RPC_THREADS_MAX, RPC_HDR_SIZE, UDP_PING_MSG_SIZE_MAX);
+                return 1;
+            }
+            break;
+        case 'q':
+            tcp = 1;
+            subopts = optarg;
+            while ('\0' != *subopts) {
+                op = getsubopt(&subopts, tcp_tokens, &subval);
+                if (0 > op || (4 != op && !subval)) {
+                    printf("Error: invalid -q option %s\n", subval ? subval : "");
+                    return 1;
+                }
+                switch (op) {
+                case 0:
+                    tcp_bulk = (unsigned int)atoi(subval);
+                    break;
+                case 1:
+                    tcp_hold = (unsigned int)atoi(subval);
+                    break;
+                case 2:
+                    tcp_churn = (unsigned long int)str2long(subval);
+                    break;
+                case 3:
+                    tcp = atoi(subval);
+                    break;
+                default:
+                    tcp_reset = 1;
+                    break;
+                }
+            }
+            if (tcp < 1 || tcp > TCP_THREADS_MAX || !(tcp_bulk || tcp_hold || tcp_churn)) {
+                printf("Error: -q needs bulk=, hold= or churn=, threads=1..%d\n", TCP_THREADS_MAX);
+                return 1;
+            }
+            break;
+        case 'T':
+            subopts = optarg;
+            while ('\0' != *subopts) {
+                switch (op = getsubopt(&subopts, target_tokens, &subval)) {
+                case 0:
+                case 1:
+                case 2:
+                    target.kind = TARGET_CPU + op;
+                    target.goal = subval ? ((1 == op) ? (double)str2long(subval) : atof(subval)) : -1;
+                    break;
+                case 3:
+                    snprintf(target.iface, sizeof(target.iface), "%s", subval ? subval : "");
+                    break;
+                case 4:
+                    target.max = subval ? (double)str2long(subval) : 0;
+                    break;
+                case 5:
+                    target.period = subval ? (unsigned int)atoi(subval) : 0;
+                    break;
+                case 6:
+                    target.kp = subval ? atof(subval) : 0;
+                    break;
+                case 7:
+                    target.ki = subval ? atof(subval) : 0;
+                    break;
+                case 8:
+                    target.kd = subval ? atof(subval) : 0;
+                    break;
+                default:
+                    printf("Error: unknown -T option %s\n", subval ? subval : "");
+                    return 1;
+                }
+            }
+            if (TARGET_NONE == target.kind || target.goal < 0 ||
+                    (TARGET_TX != target.kind && target.goal > 100) ||
+                    (TARGET_LOSS != target.kind && !target.goal) || !target.period) {
+                printf("Error: -T needs one goal: cpu=1..100, tx=<bytes/sec> or loss=0..100\n");
+                return 1;
+            }
             break;
 #endif
         case 'X':
-            kill_previous_instance();
-            return 0;
+            stop_daemon = 1;
+            break;
+        case 'c':
+            ctl_command = optarg;
+            break;
+        case 'U':
+            ctl_port = atoi(optarg);
+            break;
+        case 'n':
+            snprintf(lock_file_name, sizeof(lock_file_name), LOCK_FILE_FORMAT, optarg);
+            snprintf(stats_file_name, sizeof(stats_file_name), STATS_FILE_FORMAT, optarg);
+            snprintf(control.path, sizeof(control.path), CTL_SOCK_FORMAT, optarg);
+#if defined(__linux__)
+            snprintf(fleet.path, sizeof(fleet.path), FLEET_FILE_FORMAT, optarg);
+#endif
             break;
         /* fine tuning options */
         case 'm':
@@ -664,6 +8472,7 @@ int main(int argc, char** argv) {
             break;
         case 's':
             ping_msg_size = (unsigned int)str2long(optarg);
+            msg_size_given = 1;
             break;
         case 'd':
             ping_delay = atoi(optarg);
@@ -671,19 +8480,243 @@ int main(int argc, char** argv) {
         case 'h':
             heartbeat_delay = MICROSEC_PER_SEC*(unsigned int)str2long(optarg);
             break;
+        case 'H':
+            if (!strcmp(optarg, "bin"))
+                heartbeat_format = HB_BINARY;
+            else if (!strcmp(optarg, "text"))
+                heartbeat_format = HB_TEXT;
+            else {
+                printf("Error: heartbeat format is bin or text\n");
+                return 1;
+            }
+            break;
+        case 'b':
+            batch = (unsigned int)str2long(optarg);
+            break;
+        case 'O':
+            if (profile_load(&profile, optarg))
+                return 1;
+            break;
+        case 'f':
+            content.pool = PAYLOAD_POOL_DEFAULT;
+            subopts = optarg;
+            while ('\0' != *subopts) {
+                switch (getsubopt(&subopts, fill_tokens, &fill_val)) {
+                case 0:
+                    content.kind = PAYLOAD_RANDOM;
+                    payload_fill = fill_random;
+                    break;
+                case 1:
+                    content.kind = PAYLOAD_RATIO;
+                    content.ratio = fill_val ? (unsigned int)atoi(fill_val) : 101;
+                    payload_fill = fill_ratio;
+                    break;
+                case 2:
+                    content.kind = PAYLOAD_PATTERN;
+                    payload_fill = fill_data;
+                    if (0 > payload_pattern(fill_val)) {
+                        printf("Error: pattern is text or 0x<hex bytes>\n");
+                        return 1;
+                    }
+                    break;
+                case 3:
+                    content.kind = PAYLOAD_FILE;
+                    payload_fill = fill_data;
+                    if (!fill_val || 0 > payload_file(fill_val)) {
+                        printf("Error: can not read payload file %s\n", fill_val ? fill_val : "");
+                        return 1;
+                    }
+                    break;
+                case 4:
+                    content.pool = fill_val ? (unsigned int)atoi(fill_val) : 0;
+                    break;
+                default:
+                    printf("Error: unknown -f option %s\n", fill_val ? fill_val : "");
+                    return 1;
+                }
+            }
+            if (content.ratio > 100 || !content.pool) {
+                printf("Error: -f ratio=0..100 pool=1..\n");
+                return 1;
+            }
+            break;
+        case 'k':
+            burst = (unsigned long int)str2long(optarg);
+            break;
         default:
             break;
         }
     }
+    /* instance name may follow -X, so stop only after all options parsed */
+    if (stop_daemon) {
+        kill_previous_instance();
+        return 0;
+    }
+    if (ctl_command)
+        return ctl_client(ctl_command);
+    /* control changes wake sleepers on monotonic clock */
+    pthread_condattr_init(&ctl_attr);
+    pthread_condattr_setclock(&ctl_attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&control.changed, &ctl_attr);
+    pthread_condattr_destroy(&ctl_attr);
+#if defined(CPU_KERNELS_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        prng_fill = prng_fill_avx2;
+#endif
+    /* benchmark runs in foreground: first host (default loopback), -p, -b, -i */
+    if (bench_mode) {
+        if (!bench.sizes_nr) {
+            bench.sizes[0] = 64;
+            bench.sizes[1] = 512;
+            bench.sizes[2] = 1472;
+            bench.sizes_nr = 3;
+        }
+        if (!bench.threads_nr) {
+            nproc = sysconf(_SC_NPROCESSORS_ONLN);
+            for (i = 1; i <= 4 && (1 == i || i <= nproc); i *= 2)
+                bench.threads[bench.threads_nr++] = i;
+        }
+        for (i = 0; i < bench.sizes_nr; i++) {
+            if (bench.sizes[i] < PROBE_SIZE || bench.sizes[i] > UDP_PING_MSG_SIZE_MAX) {
+                printf("Error: --bench sizes %d..%d\n", PROBE_SIZE, UDP_PING_MSG_SIZE_MAX);
+                return 1;
+            }
+        }
+        for (i = 0; i < bench.threads_nr; i++) {
+            if (bench.threads[i] > BENCH_THREADS_MAX) {
+                printf("Error: --bench threads 1..%d\n", BENCH_THREADS_MAX);
+                return 1;
+            }
+        }
+        if (!bench.paths)
+            bench.paths = (1U << BENCH_PATHS) - 1;
+        if (!bench.msec)
+            bench.msec = BENCH_MSEC_DEFAULT;
+        bench.host = (optind < argc) ? argv[optind] : "127.0.0.1";
+        if (0 > resolve_init(&resolver, 1) || !resolve_find(&resolver, bench.host, 1) ||
+                resolve_run(&resolver))
+            return 1;
+        bench.port = (ping_port > 0 && ping_port <= 65535) ? ping_port : PING_PORT_DEFAULT;
+        bench.batch = (batch && batch <= BATCH_SIZE_MAX) ? batch : BENCH_BATCH_DEFAULT;
+#if defined(__linux__)
+        if (raw_if_name && !(bench.if_index = (int)if_nametoindex(raw_if_name))) {
+            printf("Error: unknown interface %s\n", raw_if_name);
+            return 1;
+        }
+#endif
+        return bench_run(&bench);
+    }
     /* the rest of cmd line - hostnames */
 #if defined(__linux__)
-    if (!raw_ping)
+    /* TCP load goes to the hosts instead of UDP */
+    if (tcp || rpc) {
+        tcp_hosts = argv + optind;
+        tcp_hosts_nr = argc - optind;
+        if (!tcp_hosts_nr) {
+            printf("Error: -q and -Q need hosts to connect to\n");
+            return 1;
+        }
+    }
+    if (!raw_ping && !tcp && !rpc)
 #endif
         ping = argc - optind;
-    thread_pool_size = hb + cpu + ping;
+#if defined(__linux__)
+    /* UDP destinations multiplexed over a few workers instead of thread per host */
+    if (sched) {
+        if (!ping) {
+            printf("Error: -j needs UDP hosts (no -E, -q, -Q)\n");
+            return 1;
+        }
+        sched_hosts = argv + optind;
+        sched_hosts_nr = ping;
+        if (sched > sched_hosts_nr)
+            sched = sched_hosts_nr;
+        ping = 0;
+    }
+#endif
+    if (mem < 0 || mem > MEM_THREADS_MAX)
+        mem = 1;
+#if defined(__linux__)
+    /* closed loop on CPU starts from one thread */
+    if (TARGET_CPU == target.kind && !cpu)
+        cpu = 1;
+    if (TARGET_NONE != target.kind && profile.nr) {
+        printf("Error: -T and -O both drive the load, use one of them\n");
+        return 1;
+    }
+#endif
+    if (profile.nr) {
+        if (active_period || sleep_period) {
+            printf("Error: -O is a schedule itself, it does not go with -A/-S\n");
+            return 1;
+        }
+        /* levels of the profile apply to running threads */
+        for (i = 0; i < profile.nr && !cpu; i++) {
+            if (profile.seg[i].set[PROF_CPU] || profile.seg[i].set[PROF_THREADS])
+                cpu = 1;
+        }
+    }
+    /* -J: cycle of -A/-S unless given in msec, threads keep no phases of their own */
+    if (sync) {
+        if (!sync_period && !sync_active) {
+            sync_period = 1000.0 * (active_period + sleep_period);
+            sync_active = 1000.0 * active_period;
+        }
+        if (sync_active <= 0 || sync_period <= sync_active || sync_start < 0 || sync_step < 0 ||
+                sync_offset < 0) {
+            printf("Error: -J needs period= and active= msec (or -A and -S), active < period\n");
+            return 1;
+        }
+        if (RANDOM_START == shuffle_phases) {
+            printf("Error: -J aligns phases, -R shuffles them: use one of them\n");
+            return 1;
+        }
+        phase_sync.start = (unsigned long long)(sync_start * NANOSEC_PER_SEC);
+        phase_sync.period = (unsigned long long)(sync_period * 1000000);
+        phase_sync.active = (unsigned long long)(sync_active * 1000000);
+        phase_sync.shift = (unsigned long long)((sync_offset + sync_index * sync_step) * 1000000);
+        phase_sync.offset = phase_sync.shift % phase_sync.period;
+        phase_sync.alternate = (ALTERNATE_LOAD == shuffle_phases);
+        shuffle_phases = 0;
+        active_period = sleep_period = 0;
+    }
+    if (cpu < 0 || cpu > CPU_THREADS_MAX) {
+        printf("Error: at most %d CPU threads\n", CPU_THREADS_MAX);
+        return 1;
+    }
+    if (ctl_port < 0 || ctl_port > 65535) {
+        printf("Error: invalid control port %d\n", ctl_port);
+        return 1;
+    }
+    if (ctl_port && !master_host) {
+        printf("Error: -U accepts commands from -M host only, -M is missing\n");
+        return 1;
+    }
+    thread_pool_size = hb + cpu + mem + disks + ping;
 
 #if defined(__linux__)
-    thread_pool_size += raw_ping;
+    if (raw_threads < 1 || raw_threads > RAW_THREADS_MAX)
+        raw_threads = 1;
+    if (raw_ping)
+        thread_pool_size += raw_threads;
+    thread_pool_size += rx + (replay.path ? 1 : 0) + tcp + tcp_sink_nr + rpc + fleet.rx_nr + sched;
+    /* binary heartbeats are timers of the first worker */
+    if (sched && hb && HB_BINARY == heartbeat_format)
+        thread_pool_size--;
+    /* collector listens on master port unless told otherwise */
+    if (fleet.rx_nr && !fleet.port)
+        fleet.port = master_port;
+    if (fleet_out)
+        snprintf(fleet.path, sizeof(fleet.path), "%s", fleet_out);
+    /* every connection is a descriptor */
+    if ((tcp || tcp_sink_nr) && 0 == getrlimit(RLIMIT_NOFILE, &nofile)) {
+        nofile.rlim_cur = nofile.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &nofile);
+        if (tcp_hosts_nr * (tcp_bulk + tcp_hold) + (unsigned long)tcp * TCP_CHURN_INFLIGHT > nofile.rlim_cur)
+            printf("Warning: %lu connections, open files limit is %lu\n",
+                (unsigned long)tcp_hosts_nr * (tcp_bulk + tcp_hold), (unsigned long)nofile.rlim_cur);
+    }
 #endif
 
     socket_pool_size = ping + hb;
@@ -694,10 +8727,92 @@ int main(int argc, char** argv) {
 
     /* parameter validation */
 #if defined(__linux__)
-    if (raw_ping && (0 != geteuid())) {
-        printf("Error: You must be root to use raw sockets\nTry without -E\n");
+    if ((raw_ping || replay.path) && (0 != geteuid())) {
+        printf("Error: You must be root to use raw sockets\nTry without -E/-r\n");
+        return 1;
+    }
+    if (raw_ping || replay.path) {
+        if (raw_if_name) {
+            raw_if_index = (int)if_nametoindex(raw_if_name);
+            if (!raw_if_index) {
+                printf("Error: unknown interface %s\n", raw_if_name);
+                return 1;
+            }
+        }
+        else {
+            raw_if_index = get_first_suitable_if();
+            if (0 > raw_if_index) {
+                printf("Error: no suitable (RUNNING) iface found\nUse -i\n");
+                return 1;
+            }
+        }
+    }
+    /* placement: CPU sets out of given (or all allowed) CPUs, NIC node */
+    if (0 <= place.policy && (place.prio < sched_get_priority_min(place.policy) ||
+            place.prio > sched_get_priority_max(place.policy))) {
+        printf("Error: prio must be %d..%d for this policy\n",
+            sched_get_priority_min(place.policy), sched_get_priority_max(place.policy));
         return 1;
     }
+    if (PLACE_NONE != place.mode) {
+        sched_getaffinity(0, sizeof(cpu_set_t), &place_allowed);
+        if (place_cpus_given)
+            CPU_AND(&place_allowed, &place_allowed, &place_cpus);
+        place_setup(&place, &place_allowed);
+        if (!place.nr) {
+            printf("Error: no CPUs to place threads on\n");
+            return 1;
+        }
+    }
+    if (!net_node_given) {
+        if (raw_if_name)
+            place.net_node = if_numa_node(raw_if_name);
+        else if ((raw_ping || replay.path) && if_indextoname(raw_if_index, place_name))
+            place.net_node = if_numa_node(place_name);
+    }
+    /* closed loop: actuator range and starting point */
+    if (TARGET_NONE != target.kind) {
+        if (active_period || sleep_period) {
+            printf("Error: -T holds a level, it does not go with -A/-S\n");
+            return 1;
+        }
+        if (TARGET_CPU == target.kind) {
+            if (!target.max)
+                target.max = sysconf(_SC_NPROCESSORS_ONLN);
+            if (target.max < 1 || target.max > CPU_THREADS_MAX) {
+                printf("Error: -T max must be 1..%d CPU threads\n", CPU_THREADS_MAX);
+                return 1;
+            }
+            target.out = cpu / target.max;
+        }
+        else {
+            if (!ping && !raw_ping) {
+                printf("Error: -T %s needs hosts to send to\n", target_names[target.kind]);
+                return 1;
+            }
+            /* own traffic is a part of interface tx: never more than goal */
+            if (!target.max)
+                target.max = (TARGET_TX == target.kind) ? target.goal : (double)tx_speed;
+            if (target.max <= 0) {
+                printf("Error: -T loss needs max= or -N\n");
+                return 1;
+            }
+            if (!target.iface[0]) {
+                if (raw_if_name)
+                    snprintf(target.iface, sizeof(target.iface), "%s", raw_if_name);
+                else if (0 > (i = get_first_suitable_if()) || !if_indextoname(i, target.iface)) {
+                    printf("Error: no suitable (RUNNING) iface found\nUse -T iface=\n");
+                    return 1;
+                }
+            }
+            /* start low, pacing by rate */
+            if (0 >= tx_speed || tx_speed > target.max)
+                tx_speed = (long int)(target.max / 10);
+            target.out = tx_speed / target.max;
+        }
+        if (target.out < TARGET_OUT_MIN)
+            target.out = TARGET_OUT_MIN;
+    }
 #endif
     /* if one of phase is omitted, use equal periods */
     if ( (!active_period) && sleep_period ) {
@@ -716,23 +8831,71 @@ int main(int argc, char** argv) {
     }
     if (ping_delay <= 0)
         ping_delay = PING_DELAY_DEFAULT;
+    if (cpu_period < CPU_PERIOD_MIN)
+        cpu_period = CPU_PERIOD_DEFAULT;
+    /* CPU threads added at run time take these */
+    memcpy(control.kernel, cpu_kernel, sizeof(cpu_kernel));
+    control.kernel_nr = cpu_kernel_nr;
+    control.period = cpu_period;
+    control.phases.active = active_period;
+    control.phases.sleep = sleep_period;
+    /* every thread needs at least two chunks (copy uses halves) */
+    if (mem && mem_spec.size / mem < 2 * MEM_CHUNK) {
+        printf("Error: memory size must be at least %d bytes per thread\n", 2 * MEM_CHUNK);
+        return 1;
+    }
+    if (batch > BATCH_SIZE_MAX)
+        batch = 0;
+#if defined(__linux__)
+    replay.batch = batch ? batch : PCAP_BATCH_DEFAULT;
+    /* ring is worth using only if flushed in bulk */
+    if (!batch && raw_ring)
+        batch = RAW_RING_BATCH_DEFAULT;
+#endif
+    if (!batch)
+        batch = BATCH_SIZE_DEFAULT;
 
-     /* if 'T' option set => override msg_size and delay */
-    if (0 < tx_speed) {
-        if (MAX_BYTES_PER_SEC < tx_speed)
-            tx_speed = MAX_BYTES_PER_SEC;
 #if defined(__linux__)
-        if (raw_ping) {
+    if (raw_ping && ping_msg_size > RAW_PING_MSG_SIZE_MAX) {
         ping_msg_size = RAW_PING_MSG_SIZE_MAX;
-        ping_delay = (int)((float)MICROSEC_PER_SEC/tx_speed*RAW_PING_MSG_SIZE_MAX);
-        }
-        else
+    }
 #endif
-        {
-        ping_msg_size = UDP_PING_MSG_SIZE_MAX;
-        ping_delay = (int)((float)MICROSEC_PER_SEC/tx_speed*UDP_PING_MSG_SIZE_MAX);
+    /* UDP load datagrams carry probe header */
+    if (ping_msg_size < PROBE_SIZE)
+        ping_msg_size = PROBE_SIZE;
+    /* if 'N' option set => pace by rate; biggest message unless given */
+    if (0 < tx_speed) {
+        if (!msg_size_given) {
+#if defined(__linux__)
+            if (raw_ping)
+                ping_msg_size = RAW_PING_MSG_SIZE_MAX;
+            else
+#endif
+                ping_msg_size = UDP_PING_MSG_SIZE_MAX;
         }
+        /* informational only: pacer works in bytes, not in intervals */
+        ping_delay = (int)((double)MICROSEC_PER_SEC/tx_speed*ping_msg_size);
+    }
+    /* bucket must hold at least one batch */
+    if (burst < (unsigned long int)ping_msg_size * batch) {
+        burst = (unsigned long int)ping_msg_size * batch;
+    }
+    /* destinations resolved up front, in parallel: generators start
+     * only then and take addresses from the cache */
+    i = ping;
+#if defined(__linux__)
+    i += sched_hosts_nr + tcp_hosts_nr;
+#endif
+    if (0 > resolve_init(&resolver, (i ? argc - optind : 0) + 1)) {
+        printf("Error: allocate names of %d hosts\n", argc - optind);
+        return 1;
     }
+    for (rc = optind; i && rc < argc; rc++)
+        resolve_find(&resolver, argv[rc], 1);
+    if (master_host)
+        resolve_find(&resolver, master_host, 1);
+    if (resolve_run(&resolver))
+        return 1;
 
     pid = fork();
     if (pid < 0) {
@@ -767,18 +8930,35 @@ int main(int argc, char** argv) {
     close(STDERR_FILENO);
 
     log("Params:"
-        "Tx=%ld (B/sec) Delay=%d(usec) Msg=%d(B)  Active=%d(sec) Sleep=%d(sec)",
-            tx_speed, ping_delay, ping_msg_size, active_period, sleep_period);
+        "Tx=%ld (B/sec) Delay=%d(usec) Msg=%d(B) Batch=%u Burst=%lu(B) Active=%d(sec) Sleep=%d(sec)",
+            tx_speed, ping_delay, ping_msg_size, batch, burst, active_period, sleep_period);
 
     thread = thread_pool = (pthread_t*) malloc(thread_pool_size * sizeof(pthread_t));
-    if (cpu)
-        cpu_schedule = cpu_schedule_pool = (struct schedule*) malloc(cpu * sizeof(struct schedule));
+    placed = (char (*)[PLACE_DESCR_LEN]) malloc(thread_pool_size * PLACE_DESCR_LEN);
+    /* all CPU slots are reserved: threads are added at run time */
+    if (posix_memalign((void**)&gen_stats, CACHE_LINE,
+            (CPU_THREADS_MAX + thread_pool_size) * sizeof(struct gen_stats))) {
+        log("ERROR: allocate counters");
+        return 1;
+    }
+    memset(gen_stats, 0, (CPU_THREADS_MAX + thread_pool_size) * sizeof(struct gen_stats));
+    /* counters are dumped by a thread of its own on SIGUSR1 */
+    sigemptyset(&stats_signal);
+    sigaddset(&stats_signal, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &stats_signal, 0);
+    if (0 == pthread_create(&stats_thread, 0, gen_stats_signal, (void*)&stats_signal))
+        pthread_detach(stats_thread);
+    cpu_info_pool = (struct cpu_load_info*) calloc(CPU_THREADS_MAX, sizeof(struct cpu_load_info));
+    cpu_loaders = cpu_info_pool;
+    if (mem)
+        mem_info = mem_info_pool = (struct mem_load_info*) malloc(mem * sizeof(struct mem_load_info));
+    mem_loaders = mem_info_pool;
     if (socket_pool_size)
-        udp_pinger = udp_pinger_pool = (struct udp_ping_info*) malloc(socket_pool_size * sizeof(struct udp_ping_info));
+        udp_pinger = udp_pinger_pool = (struct udp_ping_info*) calloc(socket_pool_size, sizeof(struct udp_ping_info));
 
 #if defined (__linux__)
     if (raw_ping)
-        raw_pinger = (struct raw_ping_info*) malloc(sizeof(struct raw_ping_info));
+        raw_pinger = raw_pinger_pool = (struct raw_ping_info*) calloc(raw_threads, sizeof(struct raw_ping_info));
 #endif
 
     /* start heartbeats to master host with stats in payload */
@@ -792,29 +8972,141 @@ int main(int argc, char** argv) {
         udp_pinger->host = master_host;
         udp_pinger->port = master_port;
         udp_pinger->update_every_packet = 1;
-        rc = pthread_create(thread, 0, udp_sender, (void*) udp_pinger);
-        if (rc) {
-            /* TODO */
+        udp_pinger->batch = 1;
+        udp_pinger->rate = 0;
+        udp_pinger->burst = 0;
+        udp_pinger->gso = 0;
+        udp_pinger->zerocopy = 0;
+        udp_pinger->node = -1;
+        udp_pinger->stats = 0;
+        udp_pinger->stamp = 0;
+#if defined(__linux__)
+        if (sched && HB_BINARY == heartbeat_format) {
+            sched_hb = udp_pinger;
+        }
+        else
+#endif
+        {
+            rc = pthread_create(thread, 0,
+                (HB_TEXT == heartbeat_format) ? udp_sender : hb_sender, (void*) udp_pinger);
+            if (rc) {
+                log("ERROR: heartbeat thread not started #%d: %s, exiting", rc, strerror(rc));
+                return 1;
+            }
+            thread++;
         }
-        thread++;
         udp_pinger++;
     }
+#if defined(__linux__)
+    /* load threads inherit nice value of main thread; heartbeat keeps its own */
+    if (place_nice_given && 0 > setpriority(PRIO_PROCESS, 0, place_nice))
+        log("setpriority() %d Error #%d: %s", place_nice, errno, strerror(errno));
+#endif
 
+    /* -J: phase is set before load threads start */
+    if (phase_sync.period) {
+        log("Phases: %llu of %llu usec from %llu.%09llu, offset %llu usec%s",
+            phase_sync.active / 1000, phase_sync.period / 1000, phase_sync.start / NANOSEC_PER_SEC,
+            phase_sync.start % NANOSEC_PER_SEC, phase_sync.offset / 1000,
+            phase_sync.alternate ? ", net load alternates" : "");
+        sync_apply(&phase_sync, sync_position(&phase_sync, realtime_ns(), &sync_next));
+        if (0 == pthread_create(&sync_thread, 0, sync_runner, (void*)&phase_sync))
+            pthread_detach(sync_thread);
+    }
     /* start cpu threads */
     for (i=0; i<cpu; i++) {
         log("Starting cpu thread # %d", i);
-        cpu_schedule->active = active_period;
-        cpu_schedule->sleep = sleep_period;
-        rc = pthread_create(thread, 0, cpuloader, (void*)cpu_schedule);
+        rc = cpu_thread_start(i, thread);
+        if (rc) {
+            log("ERROR: cpu thread # %d not started #%d: %s, exiting", i, rc, strerror(rc));
+            return 1;
+        }
+        cpu_loaders[i].stay = 1;
+        /* heartbeat is running already: publish filled entries only */
+        cpu_loaders_nr = i + 1;
+        thread++;
+    }
+
+    /* start memory threads: each allocates and touches its own slice */
+    for (i=0; i<mem; i++) {
+        log("Starting memory thread # %d", i);
+        memcpy(mem_info, &mem_spec, sizeof(struct mem_load_info));
+        mem_info->phases.active = active_period;
+        mem_info->phases.sleep = sleep_period;
+        mem_info->size = mem_spec.size / mem;
+        mem_info->size -= mem_info->size % CACHE_LINE;
+        mem_info->rate = mem_spec.rate / mem;
+        snprintf(place_name, sizeof(place_name), "mem#%d", i);
+        rc = place_create(thread, memloader, (void*)mem_info, place_name, 0);
+        if (rc) {
+            log("ERROR: %s thread not started #%d: %s, exiting", place_name, rc, strerror(rc));
+            return 1;
+        }
+        mem_loaders_nr = i + 1;
+        thread++;
+        mem_info++;
+    }
+
+    /* start disk threads */
+    disk_loaders = disk_info;
+    disk_loaders_nr = disks;
+    for (i=0; i<disks; i++) {
+        log("Starting disk thread # %d", i);
+        disk_info[i].phases.active = active_period;
+        disk_info[i].phases.sleep = sleep_period;
+        snprintf(place_name, sizeof(place_name), "disk#%d", i);
+        rc = place_create(thread, diskloader, (void*)(disk_info + i), place_name, 0);
+        if (rc) {
+            log("ERROR: %s thread not started #%d: %s, exiting", place_name, rc, strerror(rc));
+            return 1;
+        }
+        thread++;
+    }
+
+#if defined(__linux__)
+    /* start receivers: SO_REUSEPORT sockets of the same port */
+    if (rx)
+        rx_info_pool = (struct rx_info*) calloc(rx, sizeof(struct rx_info));
+    rx_receivers = rx_info_pool;
+    for (i=0; i<rx; i++) {
+        log("Starting receiver thread # %d (port %d)", i, rx_port);
+        rx_info_pool[i].port = rx_port;
+        /* receiving in bulk is cheap: no pacing behind it */
+        rx_info_pool[i].batch = (batch > 1) ? batch : RX_BATCH_DEFAULT;
+        rx_info_pool[i].flows = (struct rx_flow*) calloc(RX_FLOWS_MAX, sizeof(struct rx_flow));
+        if (!rx_info_pool[i].flows) {
+            log("ERROR: allocate flows of receiver # %d", i);
+            return 1;
+        }
+        snprintf(place_name, sizeof(place_name), "rx#%d", i);
+        strcpy(rx_info_pool[i].name, place_name);
+        rc = place_create(thread, rx_receiver, (void*)(rx_info_pool + i), place_name, 1);
         if (rc) {
-            /* TODO */
+            log("ERROR: %s thread not started #%d: %s, exiting", place_name, rc, strerror(rc));
+            return 1;
         }
+        rx_receivers_nr = i + 1;
         thread++;
-        cpu_schedule++; 
     }
+    if (tcp_sink_nr)
+        tcp_sink_pool = (struct tcp_sink_info*) calloc(tcp_sink_nr, sizeof(struct tcp_sink_info));
+    tcp_sinks = tcp_sink_pool;
+    for (i=0; i<tcp_sink_nr; i++) {
+        log("Starting TCP sink thread # %d (port %d)", i, rx_port);
+        tcp_sink_pool[i].port = rx_port;
+        snprintf(tcp_sink_pool[i].name, sizeof(tcp_sink_pool[i].name), "sink#%d", i);
+        rc = place_create(thread, tcp_sink, (void*)(tcp_sink_pool + i), tcp_sink_pool[i].name, 1);
+        if (rc) {
+            log("ERROR: %s thread not started #%d: %s, exiting", tcp_sink_pool[i].name, rc, strerror(rc));
+            return 1;
+        }
+        tcp_sinks_nr = i + 1;
+        thread++;
+    }
+#endif
 
     /* make CPU and NET loads out of sync randomly */
-    if ((thread_pool_size>cpu) && (RANDOM_START == shuffle_phases) && active_period) {
+    if ((thread_pool_size>cpu+mem+disks) && (RANDOM_START == shuffle_phases) && active_period) {
         pthread_mutex_lock( &mutex_ini );
         srand(time(0));
         i = (unsigned int)((float)active_period/RAND_MAX*rand());
@@ -822,7 +9114,7 @@ int main(int argc, char** argv) {
         sleep(i);
     }
     /* CPU and NET loads taken in turn */
-    if ((thread_pool_size>cpu) && (ALTERNATE_LOAD == shuffle_phases) && active_period) {
+    if ((thread_pool_size>cpu+mem+disks) && (ALTERNATE_LOAD == shuffle_phases) && active_period) {
         sleep(active_period);
         i = sleep_period;
         sleep_period = active_period;
@@ -832,7 +9124,9 @@ int main(int argc, char** argv) {
     /* start ping threads */
     for (i=0; i<ping; i++) {
         log("Starting ping thread # %d", i);
-        udp_pinger->fill_buffer_procedure = fill_dummy;
+        udp_pinger->fill_buffer_procedure = payload_fill;
+        udp_pinger->stamp = 1;
+        udp_pinger->flow_id = i;
         udp_pinger->msg_size = ping_msg_size;
         udp_pinger->delay = ping_delay;
         udp_pinger->phases.sleep = sleep_period;
@@ -840,49 +9134,267 @@ int main(int argc, char** argv) {
         udp_pinger->host = argv[optind];
         udp_pinger->port = ping_port;
         udp_pinger->update_every_packet = 0;
-        rc = pthread_create(thread, 0, udp_sender, (void*) udp_pinger);
+        udp_pinger->batch = batch;
+        udp_pinger->rate = tx_speed;
+        udp_pinger->burst = burst;
+#if defined(__linux__)
+        udp_pinger->gso = udp_gso;
+        udp_pinger->zerocopy = udp_zerocopy;
+        udp_pinger->node = place.net_node;
+#else
+        udp_pinger->gso = 0;
+        udp_pinger->zerocopy = 0;
+        udp_pinger->node = -1;
+#endif
+        snprintf(place_name, sizeof(place_name), "udp#%d", i);
+        udp_pinger->stats = gen_stats + CPU_THREADS_MAX + gen_net_nr;
+        strcpy(udp_pinger->stats->name, place_name);
+        gen_net_nr++;
+        rc = place_create(thread, udp_sender, (void*) udp_pinger, place_name, 1);
         if (rc) {
-            /* TODO */
+            log("ERROR: %s thread not started #%d: %s, exiting", place_name, rc, strerror(rc));
+            return 1;
         }
+        udp_senders = udp_pinger_pool + hb;
+        udp_senders_nr = i + 1;
         udp_pinger++;
         thread++;
         optind++;
     }
 
 #if defined(__linux__)
-    if (raw_ping) {
-        log("Starting raw ethernet ping thread");
+    /* scheduler: every worker takes every sched-th host, rates are per host */
+    if (sched)
+        sched_pool = (struct sched_info*) calloc(sched, sizeof(struct sched_info));
+    for (i=0; i<sched; i++) {
+        log("Starting scheduler worker # %d: %d destinations", i, (sched_hosts_nr - i + sched - 1) / sched);
+        sched_pool[i].hosts = sched_hosts;
+        sched_pool[i].hosts_nr = sched_hosts_nr;
+        sched_pool[i].offset = i;
+        sched_pool[i].stride = sched;
+        sched_pool[i].port = ping_port;
+        sched_pool[i].msg_size = ping_msg_size;
+        sched_pool[i].delay = ping_delay;
+        sched_pool[i].batch = batch;
+        sched_pool[i].rate = tx_speed;
+        sched_pool[i].burst = burst;
+        sched_pool[i].node = place.net_node;
+        sched_pool[i].phases.active = active_period;
+        sched_pool[i].phases.sleep = sleep_period;
+        sched_pool[i].hb = i ? 0 : sched_hb;
+        snprintf(place_name, sizeof(place_name), "sch#%d", i);
+        sched_pool[i].stats = gen_stats + CPU_THREADS_MAX + gen_net_nr;
+        strcpy(sched_pool[i].stats->name, place_name);
+        gen_net_nr++;
+        rc = place_create(thread, sched_worker, (void*)(sched_pool + i), place_name, 1);
+        if (rc) {
+            log("ERROR: %s thread not started #%d: %s, exiting", place_name, rc, strerror(rc));
+            return 1;
+        }
+        thread++;
+        sched_workers = sched_pool;
+        sched_workers_nr = i + 1;
+    }
+    for (i=0; raw_ping && i<(int)raw_threads; i++) {
+        log("Starting raw ethernet ping thread # %d (ifindex %d)", i, raw_if_index);
         memcpy(raw_pinger->source_mac, fictive_mac_1, ETH_ALEN);
         memcpy(raw_pinger->target_mac, fictive_mac_2, ETH_ALEN);
-        raw_pinger->delay = ping_delay;
-        raw_pinger->fill_buffer_procedure = fill_dummy;
+        raw_pinger->delay = ping_delay * raw_threads;
+        raw_pinger->fill_buffer_procedure = payload_fill;
         raw_pinger->update_every_packet = 0;
+        raw_pinger->batch = batch;
+        raw_pinger->rate = tx_speed / raw_threads;
+        raw_pinger->burst = burst;
+        raw_pinger->ring = raw_ring;
+        raw_pinger->qdisc_bypass = raw_bypass;
+        raw_pinger->if_index = raw_if_index;
+        raw_pinger->flows = raw_flow_spec;
+        raw_pinger->flow_offset = i;
+        raw_pinger->flow_stride = raw_threads;
         raw_pinger->msg_size = ping_msg_size;
         raw_pinger->phases.active = active_period;
         raw_pinger->phases.sleep = sleep_period;
-        rc = pthread_create(thread, 0, raw_sender, (void*) raw_pinger);
+        raw_pinger->node = place.net_node;
+        snprintf(place_name, sizeof(place_name), "raw#%d", i);
+        raw_pinger->stats = gen_stats + CPU_THREADS_MAX + gen_net_nr;
+        strcpy(raw_pinger->stats->name, place_name);
+        gen_net_nr++;
+        rc = place_create(thread, raw_sender, (void*) raw_pinger, place_name, 1);
+        if (rc) {
+            log("ERROR: %s thread not started #%d: %s, exiting", place_name, rc, strerror(rc));
+            return 1;
+        }
+        raw_pinger++;
+        thread++;
+        raw_senders = raw_pinger_pool;
+        raw_senders_nr = i + 1;
+    }
+    if (replay.path) {
+        log("Starting replay of %s (ifindex %d) %s %.2f%s", replay.path, raw_if_index,
+            replay.pps ? "pps" : "speed", replay.pps ? (double)replay.pps : replay.speed,
+            replay.loop ? " looped" : "");
+        replay.if_index = raw_if_index;
+        replay.node = place.net_node;
+        replay.stats = gen_stats + CPU_THREADS_MAX + gen_net_nr;
+        strcpy(replay.stats->name, "pcap#0");
+        gen_net_nr++;
+        rc = place_create(thread, pcap_replayer, (void*)&replay, "pcap#0", 1);
+        if (rc) {
+            log("ERROR: %s thread not started #%d: %s, exiting", "pcap#0", rc, strerror(rc));
+            return 1;
+        }
+        thread++;
+    }
+    /* TCP: counts and rates are per destination, split among threads */
+    if (tcp)
+        tcp_info_pool = (struct tcp_load_info*) calloc(tcp, sizeof(struct tcp_load_info));
+    for (i=0; i<tcp; i++) {
+        log("Starting TCP load thread # %d: %u bulk, %u held, %lu new/sec per host",
+            i, tcp_bulk, tcp_hold, tcp_churn);
+        tcp_info_pool[i].hosts = tcp_hosts;
+        tcp_info_pool[i].hosts_nr = tcp_hosts_nr;
+        tcp_info_pool[i].port = ping_port;
+        tcp_info_pool[i].msg_size = msg_size_given ? ping_msg_size : TCP_WRITE_DEFAULT;
+        tcp_info_pool[i].offset = i;
+        tcp_info_pool[i].bulk = (tcp_bulk * tcp_hosts_nr + tcp - 1 - i) / tcp;
+        tcp_info_pool[i].hold = (tcp_hold * tcp_hosts_nr + tcp - 1 - i) / tcp;
+        tcp_info_pool[i].churn = (tcp_churn * tcp_hosts_nr + tcp - 1 - i) / tcp;
+        tcp_info_pool[i].reset = tcp_reset;
+        tcp_info_pool[i].rate = tx_speed * tcp_hosts_nr / tcp;
+        tcp_info_pool[i].burst = burst;
+        tcp_info_pool[i].node = place.net_node;
+        tcp_info_pool[i].phases.active = active_period;
+        tcp_info_pool[i].phases.sleep = sleep_period;
+        snprintf(place_name, sizeof(place_name), "tcp#%d", i);
+        tcp_info_pool[i].stats = gen_stats + CPU_THREADS_MAX + gen_net_nr;
+        strcpy(tcp_info_pool[i].stats->name, place_name);
+        gen_net_nr++;
+        rc = place_create(thread, tcp_loader, (void*)(tcp_info_pool + i), place_name, 1);
+        if (rc) {
+            log("ERROR: %s thread not started #%d: %s, exiting", place_name, rc, strerror(rc));
+            return 1;
+        }
+        thread++;
+        tcp_loaders = tcp_info_pool;
+        tcp_loaders_nr = i + 1;
+    }
+    /* requests: rate, in flight and connections are per destination */
+    if (rpc)
+        rpc_info_pool = (struct rpc_info*) calloc(rpc, sizeof(struct rpc_info));
+    for (i=0; i<rpc; i++) {
+        rpc_info_pool[i] = rpc_spec;
+        rpc_info_pool[i].hosts = tcp_hosts;
+        rpc_info_pool[i].hosts_nr = tcp_hosts_nr;
+        rpc_info_pool[i].port = ping_port;
+        rpc_info_pool[i].offset = i;
+        rpc_info_pool[i].rps = (rpc_spec.rps * tcp_hosts_nr + rpc - 1 - i) / rpc;
+        rpc_info_pool[i].outstanding = (rpc_spec.outstanding * tcp_hosts_nr + rpc - 1 - i) / rpc;
+        rpc_info_pool[i].conns = (rpc_spec.conns * tcp_hosts_nr + rpc - 1 - i) / rpc;
+        if (!rpc_info_pool[i].conns)
+            rpc_info_pool[i].conns = 1;
+        rpc_info_pool[i].node = place.net_node;
+        rpc_info_pool[i].phases.active = active_period;
+        rpc_info_pool[i].phases.sleep = sleep_period;
+        log("Starting request/response thread # %d: %lu/sec %u in flight, %u connections (%s)",
+            i, rpc_info_pool[i].rps, rpc_info_pool[i].outstanding, rpc_info_pool[i].conns,
+            rpc_spec.tcp ? "tcp" : "udp");
+        snprintf(place_name, sizeof(place_name), "rpc#%d", i);
+        rpc_info_pool[i].stats = gen_stats + CPU_THREADS_MAX + gen_net_nr;
+        strcpy(rpc_info_pool[i].stats->name, place_name);
+        gen_net_nr++;
+        rc = place_create(thread, rpc_client, (void*)(rpc_info_pool + i), place_name, 1);
         if (rc) {
-            /* TODO */
+            log("ERROR: %s thread not started #%d: %s, exiting", place_name, rc, strerror(rc));
+            return 1;
         }
         thread++;
+        rpc_loaders = rpc_info_pool;
+        rpc_loaders_nr = i + 1;
+    }
+    /* fleet collector: samples of all hosts are allocated and touched up front */
+    if (fleet.rx_nr) {
+        for (fleet.slots = 1; fleet.slots < 2 * fleet.hosts_max; fleet.slots <<= 1)
+            ;
+        fleet.hosts = (struct fleet_host*) calloc(fleet.slots, sizeof(struct fleet_host));
+        fleet.list = (struct fleet_host**) calloc(fleet.hosts_max, sizeof(struct fleet_host*));
+        fleet.cpu = (unsigned int*) malloc(fleet.hosts_max * sizeof(unsigned int));
+        fleet.rx = (struct fleet_rx*) calloc(fleet.rx_nr, sizeof(struct fleet_rx));
+        fleet.arena = (struct fleet_sample*) arena_alloc((unsigned long)fleet.hosts_max * fleet.history *
+            sizeof(struct fleet_sample), 0, -1, 0);
+        if (!fleet.hosts || !fleet.list || !fleet.cpu || !fleet.rx || !fleet.arena) {
+            log("ERROR: allocate fleet of %u hosts, %u samples each", fleet.hosts_max, fleet.history);
+            return 1;
+        }
+        pthread_mutex_init(&fleet.lock, 0);
+    }
+    for (i=0; i<fleet.rx_nr; i++) {
+        log("Starting fleet collector thread # %d (port %d)", i, fleet.port);
+        snprintf(fleet.rx[i].name, sizeof(fleet.rx[i].name), "col#%d", i);
+        rc = place_create(thread, fleet_collector, (void*)(fleet.rx + i), fleet.rx[i].name, 1);
+        if (rc) {
+            log("ERROR: %s thread not started #%d: %s, exiting", fleet.rx[i].name, rc, strerror(rc));
+            return 1;
+        }
+        thread++;
+    }
+    if (fleet.rx_nr) {
+        log("Fleet: %u hosts x %u samples, every %u sec %s %s (%s)", fleet.hosts_max, fleet.history,
+            fleet.every, fleet.stream ? "appended to" : "snapshot", fleet.path, fleet.csv ? "csv" : "json");
+        if (0 == pthread_create(&fleet_thread, 0, fleet_exporter, (void*)&fleet))
+            pthread_detach(fleet_thread);
+    }
+#endif
+    /* commands take effect on threads started so far;
+     * UDP port which can not be limited to master is not opened */
+    if (0 == ctl_open(ctl_port, master_host)) {
+        if (0 == pthread_create(&ctl_thread, 0, ctl_receiver, 0))
+            pthread_detach(ctl_thread);
+    }
+    else if (ctl_port) {
+        log("ERROR: control UDP port %d not opened, exiting", ctl_port);
+        return 1;
+    }
+#if defined(__linux__)
+    /* closed loop acts through control commands as well */
+    if (TARGET_NONE != target.kind) {
+        log("Target: %s %.2f max %.2f PID %.2f/%.2f/%.2f every %u msec (%s)",
+            target_names[target.kind], target.goal, target.max,
+            target.kp, target.ki, target.kd, target.period, target.iface);
+        if (0 == pthread_create(&target_thread, 0, target_controller, (void*)&target))
+            pthread_detach(target_thread);
     }
 #endif
+    if (profile.nr) {
+        log("Profile: %s %d segments, %.0f sec%s at speed %.2f", profile.path, profile.nr,
+            profile.total, profile.loop ? " looped" : "", profile.speed);
+        if (0 == pthread_create(&profile_thread, 0, profile_runner, (void*)&profile))
+            pthread_detach(profile_thread);
+    }
     /* join all threads */
     for (i=0; i<thread_pool_size; i++) {
         rc = pthread_join(thread_pool[i], 0);
-        if (rc) {
-            /* TODO */
-        }
+        if (rc)
+            log("ERROR: join thread #%d: %s", rc, strerror(rc));
     }
 #if defined(SYSLOGGING)
     closelog();
 #endif
-    free(cpu_schedule_pool);
+    free(cpu_info_pool);
+    free(mem_info_pool);
     free(udp_pinger_pool);
 #if defined(__linux__)
-    free(raw_pinger);
+    free(raw_pinger_pool);
+    for (i=0; i<rx; i++)
+        free(rx_info_pool[i].flows);
+    free(rx_info_pool);
+    free(tcp_info_pool);
+    free(rpc_info_pool);
+    free(tcp_sink_pool);
+    free(sched_pool);
 #endif
     free(thread_pool);
+    free(placed);
+    free(gen_stats);
     return 0;
 }
 